@@ -0,0 +1,161 @@
+// batch_bench - compares the columnar batch evaluator against running the
+// program once per input row with ProgramNode::evaluate().
+//
+// Usage: simlan_batch_bench [rows] [formulas] [terms per formula] [repetitions]
+//
+// The program reads three inputs, x, y and z, and PRINTs every formula, each
+// a sum of "(x * a - y) / (z + b)" terms; z is never negative and b is at
+// least 1, so no row fails. Both sides write the same CSV table to a sink
+// that discards it, and every ISA's table is checked against the per-row one.
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "ast.hpp"
+#include "batch.hpp"
+#include "output.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A stream buffer that accepts and drops everything
+class DiscardBuffer : public std::streambuf {
+protected:
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+    int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+};
+
+std::string generateProgram(int formulas, int terms) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> digit(1, 99);
+    std::ostringstream out;
+    out << "INPUT x;\nINPUT y;\nINPUT z;\n";
+    for (int f = 0; f < formulas; ++f) {
+        out << "LET f" << f << " = ";
+        for (int t = 0; t < terms; ++t) {
+            if (t > 0) out << " + ";
+            out << "(x * " << digit(rng) << ".5 - y) / (z + " << digit(rng) << ")";
+        }
+        out << ";\nPRINT f" << f << ";\n";
+    }
+    return out.str();
+}
+
+// Runs the program once per row, printing the same table as BatchEvaluator
+void runPerRow(const ProgramNode& program, const std::vector<std::vector<double>>& columns, size_t rows,
+               OutputSink& out) {
+    std::string header;
+    for (const StatementNode& stmt : program.statements) {
+        if (stmt.kind == StatementKind::Print) {
+            header += program.symbols.name(ExprArena::indexOf(stmt.expression)) + ",";
+        }
+    }
+    out.write(header + "error\n");
+
+    std::vector<double> variables(program.symbols.size());
+    char number[OutputSink::MAX_NUMBER_LENGTH];
+    for (size_t row = 0; row < rows; ++row) {
+        size_t input = 0;
+        for (const StatementNode& stmt : program.statements) {
+            switch (stmt.kind) {
+                case StatementKind::Input:
+                    variables[stmt.slot] = columns[input++][row];
+                    break;
+                case StatementKind::Let:
+                    variables[stmt.slot] = program.evaluate(stmt.expression, variables.data());
+                    break;
+                case StatementKind::Print: {
+                    double value = program.evaluate(stmt.expression, variables.data());
+                    out.write(std::string_view(number, OutputSink::formatNumber(number, value, out.numberFormat())));
+                    out.write(",");
+                    break;
+                }
+            }
+        }
+        out.write("\n");
+    }
+}
+
+template <typename F>
+double timeSeconds(int repetitions, F&& body) {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; ++r) {
+        body();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    int formulas = argc > 2 ? std::atoi(argv[2]) : 8;
+    int terms = argc > 3 ? std::atoi(argv[3]) : 8;
+    int repetitions = argc > 4 ? std::atoi(argv[4]) : 3;
+
+    std::string source = generateProgram(formulas, terms);
+    Lexer lexer(source);
+    Parser parser(lexer);
+    std::unique_ptr<ProgramNode> program = parser.parseProgram();
+    BatchEvaluator evaluator(*program);
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> value(0.0, 1000.0);
+    std::vector<std::vector<double>> columns(evaluator.inputNames().size(), std::vector<double>(rows));
+    for (std::vector<double>& column : columns) {
+        for (double& v : column) v = value(rng);
+    }
+
+    DiscardBuffer discard;
+    std::ostream discardStream(&discard);
+    OutputSink sink(discardStream);
+
+    double nodes = static_cast<double>(rows) * formulas * (10.0 * terms - 1) * repetitions;
+    std::cout << "rows:            " << rows << ", " << formulas << " formulas x " << terms << " terms, "
+              << repetitions << " repetitions" << std::endl;
+
+    double perRowSeconds = timeSeconds(repetitions, [&] { runPerRow(*program, columns, rows, sink); });
+    std::cout << "per row:         " << perRowSeconds << " s (" << perRowSeconds * 1e9 / nodes << " ns/node)"
+              << std::endl;
+
+    // The table every ISA must produce, from a shorter run
+    size_t checkRows = rows < 5000 ? rows : 5000;
+    std::ostringstream expected;
+    {
+        OutputSink out(expected);
+        runPerRow(*program, columns, checkRows, out);
+    }
+
+    int status = 0;
+    const BatchEvaluator::Isa isas[] = {BatchEvaluator::Isa::Scalar, BatchEvaluator::Isa::AVX,
+                                         BatchEvaluator::Isa::AVX512};
+    for (BatchEvaluator::Isa isa : isas) {
+        if (!BatchEvaluator::isSupported(isa)) continue;
+        BatchEvaluator::setIsa(isa);
+
+        std::ostringstream table;
+        {
+            OutputSink out(table);
+            evaluator.run(columns, checkRows, out);
+        }
+        if (table.str() != expected.str()) {
+            std::cerr << "Result mismatch with " << BatchEvaluator::isaName(isa) << std::endl;
+            status = 1;
+        }
+
+        double seconds = timeSeconds(repetitions, [&] { evaluator.run(columns, rows, sink); });
+        std::string label = std::string("batch ") + BatchEvaluator::isaName(isa) + ":";
+        label.resize(17, ' ');
+        std::cout << label << seconds << " s (" << seconds * 1e9 / nodes << " ns/node, "
+                  << perRowSeconds / seconds << "x)" << std::endl;
+    }
+    return status;
+}
@@ -0,0 +1,95 @@
+// eval_bench - cost of evaluating a fixed set of formulas at startup: through
+// Lexer, Parser and ProgramNode::evaluate() as before, through simlan::eval()
+// at run time, and with simlan::eval() folded at compile time.
+//
+// Usage: simlan_eval_bench [repetitions]
+//
+// Each way evaluates every formula once per repetition; the best time per
+// formula is reported. The values must be the same, bit for bit, for all three.
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "ast.hpp"
+#include "simlan_eval.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#define FORMULAS(X) \
+    X("2 * (3 + 4 / 2) - 1") \
+    X("0.1 + 0.2") \
+    X("1.0825 * (1 - 0.15) * 19.99") \
+    X("(1 + 0.05 / 12) * (1 + 0.05 / 12) * (1 + 0.05 / 12) * 1000") \
+    X("9.81 * 0.5 * 3.2 * 3.2 // falling distance\n") \
+    X("(((7)))/ 3 - 2 * 0.3333333333333333") \
+    X("6.02214076 * 100000000000000000000000 / 1000") \
+    X("1 / 3 + 1 / 7 + 1 / 11 + 1 / 13 + 1 / 17 + 1 / 19 + 1 / 23")
+
+#define SOURCE(text) text,
+
+static const char* const formulas[] = {FORMULAS(SOURCE)};
+constexpr size_t FORMULA_COUNT = sizeof(formulas) / sizeof(formulas[0]);
+
+// Computed by the compiler; nothing is evaluated at run time
+#define CONSTANT(text) simlan::eval(text),
+static constexpr double constants[] = {FORMULAS(CONSTANT)};
+
+static double parseAndEvaluate(const std::string& formula) {
+    std::string source = "PRINT " + formula + "\n;";
+    Lexer lexer(source);
+    Parser parser(lexer);
+    std::unique_ptr<ProgramNode> program = parser.parseProgram();
+    return program->evaluate(program->statements[0].expression);
+}
+
+template <typename Evaluate>
+static double bestNanoseconds(int repetitions, double* values, Evaluate evaluate) {
+    double best = 0.0;
+    for (int r = 0; r < repetitions; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < FORMULA_COUNT; ++i) {
+            values[i] = evaluate(i);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (r == 0 || seconds < best) best = seconds;
+    }
+    return best * 1e9 / FORMULA_COUNT;
+}
+
+int main(int argc, char* argv[]) {
+    int repetitions = argc > 1 ? std::atoi(argv[1]) : 10000;
+
+    // Strings the compiler cannot see through, for the run-time evaluators
+    std::string sources[FORMULA_COUNT];
+    for (size_t i = 0; i < FORMULA_COUNT; ++i) {
+        sources[i] = formulas[i];
+    }
+
+    double parsed[FORMULA_COUNT];
+    double evaluated[FORMULA_COUNT];
+    double folded[FORMULA_COUNT];
+    volatile const double* table = constants;
+    double parserTime = bestNanoseconds(repetitions, parsed, [&](size_t i) { return parseAndEvaluate(sources[i]); });
+    double evalTime = bestNanoseconds(repetitions, evaluated, [&](size_t i) { return simlan::eval(sources[i]); });
+    double foldedTime = bestNanoseconds(repetitions, folded, [&](size_t i) { return table[i]; });
+
+    int status = 0;
+    for (size_t i = 0; i < FORMULA_COUNT; ++i) {
+        if (std::memcmp(&parsed[i], &evaluated[i], sizeof(double)) != 0 ||
+            std::memcmp(&parsed[i], &folded[i], sizeof(double)) != 0) {
+            std::cerr << "Value mismatch on \"" << formulas[i] << "\"" << std::endl;
+            status = 1;
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Lexer+Parser+evaluate  " << std::setw(8) << parserTime << " ns/formula\n"
+              << "simlan::eval (runtime) " << std::setw(8) << evalTime << " ns/formula\n"
+              << "simlan::eval (folded)  " << std::setw(8) << foldedTime << " ns/formula" << std::endl;
+    return status;
+}
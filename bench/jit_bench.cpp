@@ -0,0 +1,98 @@
+// jit_bench - compares the JIT against ProgramNode::evaluate() on expression-heavy
+// programs.
+//
+// Usage: simlan_jit_bench [statements] [terms per statement] [repetitions]
+//
+// The program is generated in memory: each statement is a PRINT of a sum of
+// "(a * b - c) / d" terms, so every statement has 7 * terms - 1 nodes.
+// Both engines compute every statement's value without printing it.
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "jit.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+static std::string generateProgram(int statements, int terms) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> digit(1, 99);
+    std::ostringstream out;
+    for (int s = 0; s < statements; ++s) {
+        out << "PRINT ";
+        for (int t = 0; t < terms; ++t) {
+            if (t > 0) out << " + ";
+            out << "(" << digit(rng) << " * " << digit(rng) << ".5 - " << digit(rng) << ") / " << digit(rng);
+        }
+        out << ";\n";
+    }
+    return out.str();
+}
+
+template <typename F>
+static double timeSeconds(int repetitions, F&& body) {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; ++r) {
+        body();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    int statements = argc > 1 ? std::atoi(argv[1]) : 1000;
+    int terms = argc > 2 ? std::atoi(argv[2]) : 200;
+    int repetitions = argc > 3 ? std::atoi(argv[3]) : 10;
+
+    if (!JIT::isSupported()) {
+        std::cerr << "JIT is not supported on this host." << std::endl;
+        return 1;
+    }
+
+    std::string source = generateProgram(statements, terms);
+    Lexer lexer(source);
+    Parser parser(lexer);
+    std::unique_ptr<ProgramNode> program = parser.parseProgram();
+
+
+    Compiler compiler;
+    Chunk chunk = compiler.compile(*program);
+    JIT jit;
+    double compileSeconds = timeSeconds(1, [&] { jit.compile(chunk); });
+
+    double evaluateSum = 0.0;
+    double evaluateSeconds = timeSeconds(repetitions, [&] {
+        for (const StatementNode& stmt : program->statements) {
+            evaluateSum += program->evaluate(stmt.expression);
+        }
+    });
+
+    double jitSum = 0.0;
+    double jitSeconds = timeSeconds(repetitions, [&] {
+        for (size_t i = 0; i < jit.statementCount(); ++i) {
+            double result;
+            jit.evaluate(i, result);
+            jitSum += result;
+        }
+    });
+
+    double nodes = static_cast<double>(statements) * (7.0 * terms - 1) * repetitions;
+    std::cout << "statements:      " << statements << " x " << terms << " terms, "
+              << repetitions << " repetitions" << std::endl;
+    std::cout << "evaluate():      " << evaluateSeconds << " s (" << evaluateSeconds * 1e9 / nodes << " ns/node)" << std::endl;
+    std::cout << "jit:             " << jitSeconds << " s (" << jitSeconds * 1e9 / nodes << " ns/node)" << std::endl;
+    std::cout << "jit compile:     " << compileSeconds << " s" << std::endl;
+    std::cout << "speedup:         " << evaluateSeconds / jitSeconds << "x" << std::endl;
+
+    if (evaluateSum != jitSum) {
+        std::cerr << "Result mismatch: " << evaluateSum << " vs " << jitSum << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+// lexer_bench - lexing throughput of each scanning implementation (scalar,
+// SSE2, AVX2) on generated inputs.
+//
+// Usage: simlan_lexer_bench [megabytes] [repetitions]
+//
+// Inputs:
+//   numbers   PRINT statements of long numeric literals
+//   comments  indented code with long // comment lines between statements
+//   mixed     short literals and operators, like ordinary source
+// Each input is lexed to EOF; the token count is checked to be the same for
+// every implementation.
+
+#include "lexer.hpp"
+#include "scan.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+static std::string numberDense(size_t bytes) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> digit(0, 9);
+    std::string out;
+    while (out.size() < bytes) {
+        out += "PRINT ";
+        for (int t = 0; t < 8; ++t) {
+            if (t > 0) out += " + ";
+            out += static_cast<char>('1' + digit(rng) % 9);
+            for (int d = 0; d < 14; ++d) out += static_cast<char>('0' + digit(rng));
+            out += '.';
+            for (int d = 0; d < 17; ++d) out += static_cast<char>('0' + digit(rng));
+        }
+        out += ";\n";
+    }
+    return out;
+}
+
+static std::string commentHeavy(size_t bytes) {
+    std::string out;
+    int n = 0;
+    while (out.size() < bytes) {
+        out += "        // ";
+        out += std::string(60 + n % 40, 'c');
+        out += "\n                // indented comment with some words in it, like real notes\n";
+        out += "        PRINT 1 + 2;\n\n\n";
+        n++;
+    }
+    return out;
+}
+
+static std::string mixed(size_t bytes) {
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> number(0, 999);
+    std::string out;
+    while (out.size() < bytes) {
+        out += "PRINT (" + std::to_string(number(rng)) + " + " + std::to_string(number(rng)) + ".5) * " +
+               std::to_string(number(rng)) + " / 3;\n";
+    }
+    return out;
+}
+
+static size_t lexAll(const std::string& source) {
+    Lexer lexer(source);
+    size_t tokens = 0;
+    while (lexer.getNextToken().type != TokenType::TOKEN_EOF) {
+        tokens++;
+    }
+    return tokens;
+}
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = argc > 1 ? static_cast<size_t>(std::atoi(argv[1])) : 32;
+    int repetitions = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    struct Input {
+        const char* name;
+        std::string text;
+    };
+    const size_t bytes = megabytes << 20;
+    Input inputs[] = {
+        {"numbers", numberDense(bytes)},
+        {"comments", commentHeavy(bytes)},
+        {"mixed", mixed(bytes)},
+    };
+    const scan::Isa isas[] = {scan::Isa::Scalar, scan::Isa::SSE2, scan::Isa::AVX2};
+
+    std::cout << std::fixed << std::setprecision(2);
+    int status = 0;
+    for (const Input& input : inputs) {
+        size_t expectedTokens = 0;
+        for (scan::Isa isa : isas) {
+            if (!scan::isSupported(isa)) {
+                continue;
+            }
+            scan::setIsa(isa);
+
+            size_t tokens = 0;
+            double best = 0.0;
+            for (int r = 0; r < repetitions; ++r) {
+                auto start = std::chrono::steady_clock::now();
+                tokens = lexAll(input.text);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (r == 0 || seconds < best) best = seconds;
+            }
+
+            if (expectedTokens == 0) {
+                expectedTokens = tokens;
+            } else if (tokens != expectedTokens) {
+                std::cerr << "Token count mismatch on " << input.name << ": " << tokens
+                          << " vs " << expectedTokens << std::endl;
+                status = 1;
+            }
+
+            std::cout << std::left << std::setw(10) << input.name << std::setw(8) << scan::isaName(isa)
+                      << std::right << std::setw(8) << input.text.size() / best / 1e9 << " GB/s  "
+                      << std::setw(8) << tokens / best / 1e6 << " Mtokens/s" << std::endl;
+        }
+    }
+    return status;
+}
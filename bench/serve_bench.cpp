@@ -0,0 +1,426 @@
+// serve_bench - programs per second of simlanc --serve against starting a
+// simlanc process for every program, reported as JSON.
+//
+// Usage: simlan_serve_bench [--simlanc=PATH] [--scripts=N] [--statements=N]
+//                           [--clients=N] [--json=FILE]
+//
+// Stages (the same generated scripts, run in turn):
+//   fork    posix_spawn("simlanc file") and wait, once per script
+//   stdin   one "simlanc --serve", requests and replies over pipes
+//   socket  one "simlanc --serve=SOCKET --threads=C", with C clients each
+//           sending their share of the scripts over their own connection
+// Every reply is checked against the output of the fork stage. simlanc is
+// looked for next to this program unless --simlanc is given.
+
+#include "workload.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace {
+
+struct Reply {
+    std::string out;
+    std::string err;
+    int status = -1;
+};
+
+bool writeAll(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads the framed replies of simlanc --serve
+class ReplyReader {
+public:
+    explicit ReplyReader(int fd) : fd(fd) {}
+
+    bool read(Reply& reply) {
+        reply = Reply();
+        while (true) {
+            std::string header;
+            if (!readLine(header)) {
+                return false;
+            }
+            size_t space = header.find(' ');
+            if (space == std::string::npos) {
+                return false;
+            }
+            std::string kind = header.substr(0, space);
+            long long number = std::atoll(header.c_str() + space + 1);
+            if (kind == "exit") {
+                reply.status = static_cast<int>(number);
+                return true;
+            }
+            std::string payload;
+            if (!readBytes(static_cast<size_t>(number), payload)) {
+                return false;
+            }
+            (kind == "out" ? reply.out : reply.err) += payload;
+        }
+    }
+
+private:
+    int fd;
+    char buffer[64 * 1024];
+    size_t start = 0;
+    size_t end = 0;
+
+    bool fill() {
+        while (true) {
+            ssize_t n = ::read(fd, buffer, sizeof buffer);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            start = 0;
+            end = static_cast<size_t>(n);
+            return true;
+        }
+    }
+
+    bool readLine(std::string& line) {
+        while (true) {
+            if (start == end && !fill()) return false;
+            char c = buffer[start++];
+            if (c == '\n') return true;
+            line += c;
+        }
+    }
+
+    bool readBytes(size_t count, std::string& out) {
+        while (out.size() < count) {
+            if (start == end && !fill()) return false;
+            size_t n = std::min(count - out.size(), end - start);
+            out.append(buffer + start, n);
+            start += n;
+        }
+        return true;
+    }
+};
+
+std::string request(const std::string& script) {
+    return std::to_string(script.size()) + "\n" + script;
+}
+
+// Starts simlanc with args; stdin and stdout are pipes if the fds are given
+pid_t spawn(const std::string& simlanc, const std::vector<std::string>& args, int* toChild, int* fromChild) {
+    int in[2] = {-1, -1};
+    int out[2] = {-1, -1};
+    if ((toChild && ::pipe(in) != 0) || (fromChild && ::pipe(out) != 0)) {
+        return -1;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (toChild) {
+        posix_spawn_file_actions_adddup2(&actions, in[0], 0);
+        posix_spawn_file_actions_addclose(&actions, in[0]);
+        posix_spawn_file_actions_addclose(&actions, in[1]);
+    }
+    if (fromChild) {
+        posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+        posix_spawn_file_actions_addclose(&actions, out[0]);
+        posix_spawn_file_actions_addclose(&actions, out[1]);
+    }
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(simlanc.c_str()));
+    for (const std::string& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    pid_t pid = -1;
+    if (posix_spawn(&pid, simlanc.c_str(), &actions, nullptr, argv.data(), environ) != 0) {
+        pid = -1;
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    if (toChild) {
+        ::close(in[0]);
+        *toChild = in[1];
+    }
+    if (fromChild) {
+        ::close(out[1]);
+        *fromChild = out[0];
+    }
+    return pid;
+}
+
+int waitExit(pid_t pid) {
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int connectTo(const std::string& path) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof address.sun_path - 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof address) != 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+bool parseOption(const std::string& arg, const char* name, std::string& value) {
+    std::string prefix = std::string("--") + name + "=";
+    if (arg.rfind(prefix, 0) != 0) {
+        return false;
+    }
+    value = arg.substr(prefix.size());
+    return true;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string simlanc;
+    size_t scripts = 1000;
+    size_t statements = 20;
+    size_t clients = 4;
+    std::string jsonPath;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value;
+        if (parseOption(arg, "simlanc", value)) {
+            simlanc = value;
+        } else if (parseOption(arg, "scripts", value)) {
+            scripts = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (parseOption(arg, "statements", value)) {
+            statements = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (parseOption(arg, "clients", value)) {
+            clients = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (parseOption(arg, "json", value)) {
+            jsonPath = value;
+        } else {
+            std::cerr << "Usage: simlan_serve_bench [--simlanc=PATH] [--scripts=N] [--statements=N]"
+                         " [--clients=N] [--json=FILE]" << std::endl;
+            return 1;
+        }
+    }
+    if (scripts < 1 || clients < 1) {
+        std::cerr << "Error: scripts and clients must be at least 1" << std::endl;
+        return 1;
+    }
+    if (simlanc.empty()) {
+        std::string self = argv[0];
+        size_t slash = self.find_last_of('/');
+        simlanc = (slash == std::string::npos ? std::string(".") : self.substr(0, slash)) + "/simlanc";
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // A few distinct scripts, used in turn, written out for the fork stage
+    constexpr size_t DISTINCT = 16;
+    char dirTemplate[] = "/tmp/simlan_serve_bench.XXXXXX";
+    if (!::mkdtemp(dirTemplate)) {
+        std::cerr << "Error: Could not create a temporary directory" << std::endl;
+        return 1;
+    }
+    const std::string dir = dirTemplate;
+    const std::string socketPath = dir + "/serve.sock";
+    std::vector<std::string> sources, paths;
+    for (size_t k = 0; k < DISTINCT; ++k) {
+        WorkloadOptions options;
+        options.statements = statements;
+        options.seed = static_cast<uint32_t>(k + 1);
+        sources.push_back(generateWorkload(options));
+        paths.push_back(dir + "/script" + std::to_string(k) + ".simlan");
+        std::ofstream(paths.back()) << sources.back();
+    }
+    auto cleanUp = [&] {
+        for (const std::string& path : paths) {
+            ::unlink(path.c_str());
+        }
+        ::unlink(socketPath.c_str());
+        ::rmdir(dir.c_str());
+    };
+
+    std::vector<std::string> expected(DISTINCT);
+    size_t mismatches = 0;
+    auto check = [&](size_t script, const Reply& reply) {
+        if (reply.status != 0 || !reply.err.empty() || reply.out != expected[script % DISTINCT]) {
+            mismatches++;
+        }
+    };
+
+    // 1. A process per script
+    auto runProcess = [&](size_t script, Reply& reply) {
+        int fromChild = -1;
+        pid_t pid = spawn(simlanc, {paths[script % DISTINCT]}, nullptr, &fromChild);
+        if (pid < 0) {
+            return false;
+        }
+        char buffer[4096];
+        ssize_t n;
+        reply = Reply();
+        while ((n = ::read(fromChild, buffer, sizeof buffer)) != 0) {
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) break;
+            reply.out.append(buffer, static_cast<size_t>(n));
+        }
+        ::close(fromChild);
+        reply.status = waitExit(pid);
+        return true;
+    };
+    for (size_t k = 0; k < DISTINCT; ++k) {
+        Reply reply;
+        if (!runProcess(k, reply) || reply.status != 0) {
+            std::cerr << "Error: Could not run " << simlanc << std::endl;
+            cleanUp();
+            return 1;
+        }
+        expected[k] = reply.out;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < scripts; ++i) {
+        Reply reply;
+        runProcess(i, reply);
+        check(i, reply);
+    }
+    double forkSeconds = secondsSince(start);
+
+    // 2. One server on stdin/stdout
+    int toServer = -1, fromServer = -1;
+    start = std::chrono::steady_clock::now();
+    pid_t server = spawn(simlanc, {"--serve"}, &toServer, &fromServer);
+    if (server < 0) {
+        std::cerr << "Error: Could not run " << simlanc << std::endl;
+        cleanUp();
+        return 1;
+    }
+    {
+        ReplyReader reader(fromServer);
+        for (size_t i = 0; i < scripts; ++i) {
+            Reply reply;
+            if (!writeAll(toServer, request(sources[i % DISTINCT])) || !reader.read(reply)) {
+                mismatches++;
+                break;
+            }
+            check(i, reply);
+        }
+    }
+    ::close(toServer);
+    ::close(fromServer);
+    int stdinStatus = waitExit(server);
+    double stdinSeconds = secondsSince(start);
+
+    // 3. One server on a socket, several clients at once
+    start = std::chrono::steady_clock::now();
+    server = spawn(simlanc, {"--serve=" + socketPath, "--threads=" + std::to_string(clients)}, nullptr, nullptr);
+    std::vector<int> connections;
+    for (int attempt = 0; server >= 0 && attempt < 5000 && connections.empty(); ++attempt) {
+        int fd = connectTo(socketPath);
+        if (fd >= 0) {
+            connections.push_back(fd);
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    while (!connections.empty() && connections.size() < clients) {
+        connections.push_back(connectTo(socketPath));
+    }
+    std::vector<size_t> clientMismatches(clients, 0);
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < connections.size(); ++c) {
+        threads.emplace_back([&, c] {
+            int fd = connections[c];
+            ReplyReader reader(fd);
+            for (size_t i = c; i < scripts; i += clients) {
+                Reply reply;
+                if (fd < 0 || !writeAll(fd, request(sources[i % DISTINCT])) || !reader.read(reply)) {
+                    clientMismatches[c]++;
+                    break;
+                }
+                if (reply.status != 0 || !reply.err.empty() || reply.out != expected[i % DISTINCT]) {
+                    clientMismatches[c]++;
+                }
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double socketSeconds = secondsSince(start);
+    int socketStatus = -1;
+    if (server >= 0) {
+        ::kill(server, SIGTERM);
+        socketStatus = waitExit(server);
+    }
+    if (connections.empty()) {
+        mismatches++;
+    }
+    for (size_t count : clientMismatches) {
+        mismatches += count;
+    }
+    cleanUp();
+
+    std::ostringstream json;
+    json.precision(6);
+    json << "{\n"
+         << "  \"benchmark\": \"simlan_serve_bench\",\n"
+         << "  \"scripts\": " << scripts << ",\n"
+         << "  \"statements_per_script\": " << statements << ",\n"
+         << "  \"clients\": " << clients << ",\n"
+         << "  \"stages\": [\n"
+         << "    {\"name\": \"fork\", \"seconds\": " << forkSeconds
+         << ", \"programs_per_s\": " << scripts / forkSeconds << "},\n"
+         << "    {\"name\": \"stdin\", \"seconds\": " << stdinSeconds
+         << ", \"programs_per_s\": " << scripts / stdinSeconds
+         << ", \"speedup\": " << forkSeconds / stdinSeconds << "},\n"
+         << "    {\"name\": \"socket\", \"seconds\": " << socketSeconds
+         << ", \"programs_per_s\": " << scripts / socketSeconds
+         << ", \"speedup\": " << forkSeconds / socketSeconds << "}\n"
+         << "  ]\n"
+         << "}\n";
+
+    if (jsonPath.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream file(jsonPath);
+        file << json.str();
+        if (!file) {
+            std::cerr << "Error: Could not write " << jsonPath << std::endl;
+            return 1;
+        }
+    }
+
+    if (mismatches > 0 || stdinStatus != 0 || socketStatus != 0) {
+        std::cerr << "Server replies differ from simlanc runs (" << mismatches << " scripts)" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,350 @@
+// simlan_bench - per-stage timings of the compiler on a generated workload,
+// reported as JSON.
+//
+// Usage: simlan_bench [--statements=N] [--depth=N] [--width=N]
+//                     [--literal-density=X] [--comment-ratio=X] [--seed=N]
+//                     [--repetitions=N] [--json=FILE]
+//
+// Stages (each timed on its own, best of the repetitions):
+//   lex       Lexer::getNextToken() to EOF
+//   parse     Parser::parseProgram(), lexing included
+//   edit      IncrementalParser::applyEdit() for a one-digit insertion and
+//             its undo at spread-out places (time per edit)
+//   optimize  Optimizer::optimize() (-O1)
+//   evaluate  ProgramNode::evaluate() of every statement, nothing printed
+//   output    OutputSink::printNumber() of every statement's value
+//   execute   ProgramNode::execute(): evaluate and output together
+//   vm        Compiler::compile() and VM::run()
+//   jit       JIT::compile() and JIT::run() (x86-64 only)
+// Printed output goes to a sink that discards it. The JSON goes to stdout,
+// or to FILE with --json. A rate with nothing to divide by (no statements, or
+// a stage faster than the clock) is written as null.
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "incremental.hpp"
+#include "ast.hpp"
+#include "optimizer.hpp"
+#include "bytecode.hpp"
+#include "vm.hpp"
+#include "jit.hpp"
+#include "output.hpp"
+#include "workload.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// A stream buffer that accepts and drops everything
+class DiscardBuffer : public std::streambuf {
+protected:
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+    int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+};
+
+// Peak resident set size of the process so far, in KiB (0 if unknown)
+long peakRssKb() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024; // Bytes on macOS
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0;
+}
+
+// Fastest of the repetitions, in seconds
+template <typename F>
+double bestSeconds(int repetitions, F&& body) {
+    double best = 0.0;
+    for (int r = 0; r < repetitions; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (r == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    return best;
+}
+
+// amount / per, or NaN (written as null) if per is zero
+double ratio(double amount, double per) {
+    return per > 0.0 ? amount / per : std::nan("");
+}
+
+// JSON has no inf or nan
+void writeNumber(std::ostream& out, double value) {
+    if (std::isfinite(value)) {
+        out << value;
+    } else {
+        out << "null";
+    }
+}
+
+struct StageResult {
+    std::string name;
+    double seconds;
+    long rssKb; // Peak RSS after the stage
+    std::vector<std::pair<std::string, double>> metrics;
+};
+
+bool parseOption(const std::string& arg, const char* name, std::string& value) {
+    std::string prefix = std::string("--") + name + "=";
+    if (arg.rfind(prefix, 0) != 0) {
+        return false;
+    }
+    value = arg.substr(prefix.size());
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    WorkloadOptions options;
+    int repetitions = 5;
+    std::string jsonPath;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value;
+        if (parseOption(arg, "statements", value)) {
+            options.statements = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (parseOption(arg, "depth", value)) {
+            options.depth = std::atoi(value.c_str());
+        } else if (parseOption(arg, "width", value)) {
+            options.width = std::atoi(value.c_str());
+        } else if (parseOption(arg, "literal-density", value)) {
+            options.literalDensity = std::atof(value.c_str());
+        } else if (parseOption(arg, "comment-ratio", value)) {
+            options.commentRatio = std::atof(value.c_str());
+        } else if (parseOption(arg, "seed", value)) {
+            options.seed = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (parseOption(arg, "repetitions", value)) {
+            repetitions = std::atoi(value.c_str());
+        } else if (parseOption(arg, "json", value)) {
+            jsonPath = value;
+        } else {
+            std::cerr << "Usage: simlan_bench [--statements=N] [--depth=N] [--width=N] [--literal-density=X]"
+                         " [--comment-ratio=X] [--seed=N] [--repetitions=N] [--json=FILE]" << std::endl;
+            return 1;
+        }
+    }
+    if (repetitions < 1 || options.width < 1 || options.depth < 0) {
+        std::cerr << "Error: repetitions and width must be at least 1, depth at least 0" << std::endl;
+        return 1;
+    }
+
+    const std::string source = generateWorkload(options);
+    DiscardBuffer discardBuffer;
+    std::ostream discard(&discardBuffer);
+
+    // Reference run: token and node counts, and the tree the later stages use
+    size_t tokens = 0;
+    {
+        Lexer lexer(source);
+        while (lexer.getNextToken().type != TokenType::TOKEN_EOF) {
+            tokens++;
+        }
+    }
+    std::unique_ptr<ProgramNode> program;
+    {
+        Lexer lexer(source);
+        Parser parser(lexer);
+        program = parser.parseProgram();
+    }
+    const double statements = static_cast<double>(program->statements.size());
+    const double nodes = static_cast<double>(program->arena.nodeCount());
+    const double bytes = static_cast<double>(source.size());
+
+    std::vector<StageResult> stages;
+    auto record = [&](const std::string& name, double seconds, std::vector<std::pair<std::string, double>> metrics) {
+        stages.push_back(StageResult{name, seconds, peakRssKb(), std::move(metrics)});
+    };
+
+    double lexSeconds = bestSeconds(repetitions, [&] {
+        Lexer lexer(source);
+        while (lexer.getNextToken().type != TokenType::TOKEN_EOF) {
+        }
+    });
+    record("lex", lexSeconds, {{"ns_per_token", ratio(lexSeconds * 1e9, tokens)},
+                               {"mb_per_s", ratio(bytes / 1e6, lexSeconds)}});
+
+    double parseSeconds = bestSeconds(repetitions, [&] {
+        Lexer lexer(source);
+        Parser parser(lexer);
+        std::unique_ptr<ProgramNode> parsed = parser.parseProgram();
+    });
+    record("parse", parseSeconds, {{"ns_per_token", ratio(parseSeconds * 1e9, tokens)},
+                                   {"ns_per_node", ratio(parseSeconds * 1e9, nodes)},
+                                   {"statements_per_s", ratio(statements, parseSeconds)}});
+
+    // Edits land after a digit, so they never break a statement. Only
+    // applyEdit() is timed, not building the edited texts.
+    constexpr size_t EDITS = 64;
+    double editSeconds = 0.0;
+    {
+        IncrementalParser incremental(source);
+        std::string edited;
+        for (int r = 0; r < repetitions; ++r) {
+            double seconds = 0.0;
+            size_t edits = 0;
+            for (size_t k = 0; k < EDITS; ++k) {
+                size_t offset = source.find_first_of("0123456789", source.size() * k / EDITS);
+                if (offset == std::string::npos) {
+                    break;
+                }
+                offset++;
+                edited.assign(source, 0, offset);
+                edited += '1';
+                edited.append(source, offset, std::string::npos);
+                auto start = std::chrono::steady_clock::now();
+                incremental.applyEdit(TextEdit{offset, 0, "1"}, edited);
+                incremental.applyEdit(TextEdit{offset, 1, ""}, source);
+                seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                edits += 2;
+            }
+            seconds = ratio(seconds, static_cast<double>(edits));
+            if (r == 0 || seconds < editSeconds || std::isnan(editSeconds)) {
+                editSeconds = seconds;
+            }
+        }
+    }
+    record("edit", editSeconds, {{"us_per_edit", editSeconds * 1e6}});
+
+    double optimizeSeconds = bestSeconds(repetitions, [&] {
+        Optimizer optimizer;
+        std::unique_ptr<ProgramNode> optimized = optimizer.optimize(*program);
+    });
+    record("optimize", optimizeSeconds, {{"ns_per_node", ratio(optimizeSeconds * 1e9, nodes)}});
+
+    std::vector<double> values(program->statements.size());
+    double evaluateSeconds = bestSeconds(repetitions, [&] {
+        for (size_t i = 0; i < program->statements.size(); ++i) {
+            values[i] = program->evaluate(program->statements[i].expression);
+        }
+    });
+    record("evaluate", evaluateSeconds, {{"ns_per_node", ratio(evaluateSeconds * 1e9, nodes)},
+                                         {"statements_per_s", ratio(statements, evaluateSeconds)}});
+
+    double outputSeconds = bestSeconds(repetitions, [&] {
+        OutputSink sink(discard);
+        for (double value : values) {
+            sink.printNumber(value);
+        }
+    });
+    record("output", outputSeconds, {{"ns_per_statement", ratio(outputSeconds * 1e9, statements)},
+                                     {"statements_per_s", ratio(statements, outputSeconds)}});
+
+    double executeSeconds = bestSeconds(repetitions, [&] {
+        OutputSink sink(discard);
+        program->execute(sink);
+    });
+    record("execute", executeSeconds, {{"ns_per_node", ratio(executeSeconds * 1e9, nodes)},
+                                       {"statements_per_s", ratio(statements, executeSeconds)}});
+
+    double vmSeconds = bestSeconds(repetitions, [&] {
+        Compiler compiler;
+        Chunk chunk = compiler.compile(*program);
+        OutputSink sink(discard);
+        VM vm;
+        vm.run(chunk, sink);
+    });
+    record("vm", vmSeconds, {{"ns_per_node", ratio(vmSeconds * 1e9, nodes)},
+                             {"statements_per_s", ratio(statements, vmSeconds)}});
+
+    if (JIT::isSupported()) {
+        Compiler compiler;
+        Chunk chunk = compiler.compile(*program);
+        double jitSeconds = bestSeconds(repetitions, [&] {
+            JIT jit;
+            if (jit.compile(chunk)) {
+                OutputSink sink(discard);
+                jit.run(sink);
+            }
+        });
+        record("jit", jitSeconds, {{"ns_per_node", ratio(jitSeconds * 1e9, nodes)},
+                                   {"statements_per_s", ratio(statements, jitSeconds)}});
+    }
+
+    std::ostringstream json;
+    json.precision(6);
+    json << "{\n"
+         << "  \"benchmark\": \"simlan_bench\",\n"
+         << "  \"workload\": {\n"
+         << "    \"statements\": " << options.statements << ",\n"
+         << "    \"depth\": " << options.depth << ",\n"
+         << "    \"width\": " << options.width << ",\n"
+         << "    \"literal_density\": " << options.literalDensity << ",\n"
+         << "    \"comment_ratio\": " << options.commentRatio << ",\n"
+         << "    \"seed\": " << options.seed << ",\n"
+         << "    \"bytes\": " << source.size() << ",\n"
+         << "    \"tokens\": " << tokens << ",\n"
+         << "    \"nodes\": " << program->arena.nodeCount() << "\n"
+         << "  },\n"
+         << "  \"repetitions\": " << repetitions << ",\n"
+         << "  \"stages\": [\n";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const StageResult& stage = stages[i];
+        json << "    {\"name\": \"" << stage.name << "\", \"seconds\": ";
+        writeNumber(json, stage.seconds);
+        for (const auto& metric : stage.metrics) {
+            json << ", \"" << metric.first << "\": ";
+            writeNumber(json, metric.second);
+        }
+        json << ", \"peak_rss_kb\": " << stage.rssKb << "}" << (i + 1 < stages.size() ? "," : "") << "\n";
+    }
+    json << "  ],\n"
+         << "  \"peak_rss_kb\": " << peakRssKb() << "\n"
+         << "}\n";
+
+    if (jsonPath.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream file(jsonPath);
+        file << json.str();
+        if (!file) {
+            std::cerr << "Error: Could not write " << jsonPath << std::endl;
+            return 1;
+        }
+    }
+
+    // The execution stages must agree with evaluate()
+    std::ostringstream expected, actual;
+    {
+        OutputSink sink(expected);
+        for (double value : values) {
+            sink.printNumber(value);
+        }
+    }
+    {
+        Compiler compiler;
+        Chunk chunk = compiler.compile(*program);
+        OutputSink sink(actual);
+        VM vm;
+        vm.run(chunk, sink);
+    }
+    if (expected.str() != actual.str()) {
+        std::cerr << "Result mismatch between evaluate() and the VM" << std::endl;
+        return 1;
+    }
+    return 0;
+}
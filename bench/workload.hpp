@@ -0,0 +1,74 @@
+// workload.hpp - generator for synthetic Simlan programs, shared by the
+// benchmarks.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+
+struct WorkloadOptions {
+    size_t statements = 10000;
+    int depth = 3;                  // Deepest nesting of parenthesized subexpressions
+    int width = 4;                  // Operands per (sub)expression
+    double literalDensity = 0.6;    // Chance that an operand above the deepest level is a literal
+    double commentRatio = 0.1;      // Comment lines per statement
+    uint32_t seed = 42;
+};
+
+namespace workload_detail {
+
+inline void appendLiteral(std::string& out, std::mt19937& rng, bool nonZero) {
+    std::uniform_int_distribution<int> whole(nonZero ? 1 : 0, 9999);
+    std::uniform_int_distribution<int> fraction(0, 99);
+    out += std::to_string(whole(rng));
+    if (fraction(rng) < 30) {
+        out += '.';
+        out += std::to_string(fraction(rng));
+    }
+}
+
+inline void appendExpression(std::string& out, std::mt19937& rng, const WorkloadOptions& options, int level) {
+    static const char ops[] = {'+', '-', '*', '/'};
+    std::uniform_int_distribution<int> op(0, 3);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    for (int i = 0; i < options.width; ++i) {
+        char o = ops[op(rng)];
+        if (i > 0) {
+            out += ' ';
+            out += o;
+            out += ' ';
+        }
+        // Only literals are ever divisors, so the program runs to the end
+        bool literal = level >= options.depth || (i > 0 && o == '/') || chance(rng) < options.literalDensity;
+        if (literal) {
+            appendLiteral(out, rng, i > 0 && o == '/');
+        } else {
+            out += '(';
+            appendExpression(out, rng, options, level + 1);
+            out += ')';
+        }
+    }
+}
+
+} // namespace workload_detail
+
+// A program of options.statements PRINT statements, one per line, with
+// comment lines spread evenly between them
+inline std::string generateWorkload(const WorkloadOptions& options) {
+    std::mt19937 rng(options.seed);
+    std::string out;
+    double comments = 0.0; // Comment lines owed so far
+    for (size_t s = 0; s < options.statements; ++s) {
+        for (comments += options.commentRatio; comments >= 1.0; comments -= 1.0) {
+            out += "// statement ";
+            out += std::to_string(s);
+            out += ": generated; not executed\n";
+        }
+        out += "PRINT ";
+        workload_detail::appendExpression(out, rng, options, 0);
+        out += ";\n";
+    }
+    return out;
+}
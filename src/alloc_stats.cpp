@@ -0,0 +1,75 @@
+// Replacement global operator new/delete that count heap allocations for
+// --stats. Linked into simlanc only; a library must not replace them.
+#include "stats.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<bool> counting(false);
+std::atomic<uint64_t> allocationCount(0);
+std::atomic<uint64_t> allocationBytes(0);
+
+void* allocate(std::size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+} // namespace
+
+void enableAllocationCounting() {
+    counting.store(true, std::memory_order_relaxed);
+}
+
+void readAllocationCounts(uint64_t& allocations, uint64_t& bytes) {
+    allocations = allocationCount.load(std::memory_order_relaxed);
+    bytes = allocationBytes.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size) {
+    void* p = allocate(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
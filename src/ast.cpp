@@ -1,113 +1,388 @@
 #include "ast.hpp"
+#include "bytecode.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include <algorithm>
 #include <iostream>
 #include <stdexcept> // Required for std::runtime_error
 #include <string>    // Required for std::string in error messages
-#include <iomanip>   // For std::fixed and std::setprecision (optional formatting)
+#include <vector>
 
 //------------------------------------------------------------------------------
-// NumberNode
+// ExprArena
 //------------------------------------------------------------------------------
-void NumberNode::print(int indentLevel) const {
-    printIndent(indentLevel);
-    std::cout << "NumberNode: " << value << std::endl;
+ExprId ExprArena::addNumber(double value) {
+    if (numbers.size() > EXPR_INDEX_MASK) {
+        throw std::length_error("AST arena is full: too many number nodes");
+    }
+    ExprId id = static_cast<ExprId>(numbers.size());
+    numbers.push_back(NumberNode{value});
+    return id;
 }
 
-double NumberNode::evaluate() const {
-    return value;
+ExprId ExprArena::addBinary(char op, ExprId left, ExprId right) {
+    if (binaries.size() > EXPR_INDEX_MASK) {
+        throw std::length_error("AST arena is full: too many binary operation nodes");
+    }
+    ExprId id = static_cast<ExprId>(binaries.size()) | EXPR_BINARY_BIT;
+    binaries.push_back(BinaryOpNode{op, left, right});
+    return id;
+}
+
+size_t ExprArena::memoryBytes() const {
+    return numbers.capacity() * sizeof(NumberNode) + binaries.capacity() * sizeof(BinaryOpNode);
+}
+
+void ExprArena::clear() {
+    // Swap with empty vectors so the memory is actually returned
+    std::vector<NumberNode>().swap(numbers);
+    std::vector<BinaryOpNode>().swap(binaries);
 }
 
 //------------------------------------------------------------------------------
-// BinaryOpNode
+// SymbolTable
 //------------------------------------------------------------------------------
-void BinaryOpNode::print(int indentLevel) const {
-    printIndent(indentLevel);
-    std::cout << "BinaryOpNode: '" << op << "'" << std::endl;
+size_t SymbolTable::bucketOf(std::string_view name) const {
+    // FNV-1a; names are short
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : name) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    }
+    size_t mask = buckets.size() - 1;
+    size_t bucket = static_cast<size_t>(hash ^ (hash >> 32)) & mask;
+    while (buckets[bucket] != 0 && names[buckets[bucket] - 1] != name) {
+        bucket = (bucket + 1) & mask;
+    }
+    return bucket;
+}
 
-    printIndent(indentLevel + 1);
-    std::cout << "Left:" << std::endl;
-    if (left) {
-        left->print(indentLevel + 2);
-    } else {
-        printIndent(indentLevel + 2);
-        std::cout << "<null>" << std::endl;
+uint32_t SymbolTable::find(std::string_view name) const {
+    if (buckets.empty()) {
+        return NO_SLOT;
     }
+    uint32_t entry = buckets[bucketOf(name)];
+    return entry == 0 ? NO_SLOT : entry - 1;
+}
+
+uint32_t SymbolTable::intern(std::string_view name) {
+    if (buckets.empty()) {
+        buckets.assign(16, 0);
+    }
+    size_t bucket = bucketOf(name);
+    if (buckets[bucket] != 0) {
+        return buckets[bucket] - 1;
+    }
+    if (names.size() >= EXPR_INDEX_MASK) {
+        throw std::length_error("Symbol table is full: too many variables");
+    }
+    uint32_t slot = static_cast<uint32_t>(names.size());
+    names.emplace_back(name);
+    buckets[bucket] = slot + 1;
 
-    printIndent(indentLevel + 1);
-    std::cout << "Right:" << std::endl;
-    if (right) {
-        right->print(indentLevel + 2);
-    } else {
-        printIndent(indentLevel + 2);
-        std::cout << "<null>" << std::endl;
+    // Keep the table at most half full
+    if (names.size() * 2 > buckets.size()) {
+        buckets.assign(buckets.size() * 2, 0);
+        for (uint32_t s = 0; s < names.size(); ++s) {
+            buckets[bucketOf(names[s])] = s + 1;
+        }
     }
+    return slot;
+}
+
+void SymbolTable::clear() {
+    names.clear();
+    buckets.clear();
 }
 
-double BinaryOpNode::evaluate() const {
-    if (!left || !right) {
-        throw std::runtime_error("Runtime Error: Null operand in binary operation");
+//------------------------------------------------------------------------------
+// Expressions (NumberNode / BinaryOpNode / variables)
+//------------------------------------------------------------------------------
+// The traversals below keep their pending work in vectors rather than on the
+// machine stack, so an expression may be nested as deeply as the parser allows.
+
+namespace {
+
+// A stack of trivially copyable values that lives in a fixed array until it
+// outgrows it, so evaluating a shallow expression allocates nothing
+template <typename T, size_t N>
+class InlineStack {
+public:
+    bool empty() const { return count == 0; }
+    T& back() { return data[count - 1]; }
+    void pop() { --count; }
+    void push(const T& value) {
+        if (count == capacity) {
+            grow();
+        }
+        data[count++] = value;
     }
-    double leftVal = left->evaluate();
-    double rightVal = right->evaluate();
 
+private:
+    T local[N];
+    std::vector<T> heap;
+    T* data = local;
+    size_t count = 0;
+    size_t capacity = N;
+
+    void grow() {
+        std::vector<T> bigger(capacity * 2);
+        std::copy(data, data + count, bigger.begin());
+        heap.swap(bigger);
+        data = heap.data();
+        capacity = heap.size();
+    }
+};
+
+inline double applyOperator(char op, double left, double right) {
     switch (op) {
-        case '+': return leftVal + rightVal;
-        case '-': return leftVal - rightVal;
-        case '*': return leftVal * rightVal;
+        case '+': return left + right;
+        case '-': return left - right;
+        case '*': return left * right;
         case '/':
-            if (rightVal == 0) {
+            if (right == 0) {
                 throw std::runtime_error("Runtime Error: Division by zero");
             }
-            return leftVal / rightVal;
+            return left / right;
         default:
             // Create a string from the char for the error message
             throw std::runtime_error("Runtime Error: Unknown binary operator '" + std::string(1, op) + "'");
     }
 }
 
+// ProgramNode::evaluate(). With Counting, every operator is counted before
+// it is applied, so a division that fails is counted too.
+template <bool Counting>
+double evaluateExpression(const ExprArena& arena, ExprId expr, const double* variables, OperatorCounts* counts) {
+    // Operators whose left operand is being evaluated (hasLeft false) or whose
+    // right operand is, innermost last
+    struct Pending {
+        double left;
+        ExprId right;
+        char op;
+        bool hasLeft;
+    };
+    InlineStack<Pending, 32> pending;
+    auto leaf = [&](ExprId id) {
+        return ExprArena::isVariable(id) ? variables[ExprArena::indexOf(id)] : arena.number(id).value;
+    };
+    auto apply = [&](char op, double left, double right) {
+        if constexpr (Counting) {
+            (*counts)[operatorIndex(op)]++;
+        }
+        return applyOperator(op, left, right);
+    };
+
+    for (;;) {
+        // Walk down the left operands to a leaf, or to an operator whose
+        // operands are both leaves
+        double value;
+        for (;;) {
+            if (!ExprArena::isBinary(expr)) {
+                value = leaf(expr);
+                break;
+            }
+            const BinaryOpNode& node = arena.binary(expr);
+            if (ExprArena::isBinary(node.left)) {
+                pending.push(Pending{0.0, node.right, node.op, false});
+                expr = node.left;
+            } else if (ExprArena::isBinary(node.right)) {
+                pending.push(Pending{leaf(node.left), node.right, node.op, true});
+                expr = node.right;
+            } else {
+                value = apply(node.op, leaf(node.left), leaf(node.right));
+                break;
+            }
+        }
+
+        // Apply every operator whose operands are both known; stop at the
+        // first one whose right operand is a tree still to be evaluated
+        for (;;) {
+            if (pending.empty()) {
+                return value;
+            }
+            Pending& top = pending.back();
+            if (top.hasLeft) {
+                value = apply(top.op, top.left, value);
+            } else if (ExprArena::isBinary(top.right)) {
+                top.left = value;
+                top.hasLeft = true;
+                expr = top.right;
+                break;
+            } else {
+                value = apply(top.op, value, leaf(top.right));
+            }
+            pending.pop();
+        }
+    }
+}
+
+} // namespace
+
+void ProgramNode::printExpression(std::ostream& out, ExprId expr, int indentLevel) const {
+    struct Frame {
+        ExprId id;
+        int indentLevel;
+        bool rightLabel; // Print "Right:" rather than the node id
+    };
+    std::vector<Frame> work{{expr, indentLevel, false}};
+    while (!work.empty()) {
+        Frame frame = work.back();
+        work.pop_back();
+        printIndent(out, frame.indentLevel);
+        if (frame.rightLabel) {
+            out << "Right:\n";
+        } else if (ExprArena::isVariable(frame.id)) {
+            out << "VariableNode: " << symbols.name(ExprArena::indexOf(frame.id)) << '\n';
+        } else if (!ExprArena::isBinary(frame.id)) {
+            out << "NumberNode: " << arena.number(frame.id).value << '\n';
+        } else {
+            const BinaryOpNode& node = arena.binary(frame.id);
+            out << "BinaryOpNode: '" << node.op << "'\n";
+            printIndent(out, frame.indentLevel + 1);
+            out << "Left:\n";
+            work.push_back({node.right, frame.indentLevel + 2, false});
+            work.push_back({0, frame.indentLevel + 1, true});
+            work.push_back({node.left, frame.indentLevel + 2, false}); // Printed first
+        }
+    }
+}
+
+double ProgramNode::evaluate(ExprId expr, const double* variables) const {
+    return evaluateExpression<false>(arena, expr, variables, nullptr);
+}
+
+double ProgramNode::evaluate(ExprId expr, const double* variables, OperatorCounts& counts) const {
+    return evaluateExpression<true>(arena, expr, variables, &counts);
+}
+
+void ProgramNode::compileExpression(ExprId expr, Compiler& compiler) const {
+    struct Frame {
+        ExprId id;
+        bool operandsDone;
+    };
+    std::vector<Frame> work{{expr, false}};
+    while (!work.empty()) {
+        Frame frame = work.back();
+        work.pop_back();
+        if (ExprArena::isVariable(frame.id)) {
+            compiler.emitLoad(ExprArena::indexOf(frame.id));
+            continue;
+        }
+        if (!ExprArena::isBinary(frame.id)) {
+            compiler.emitConstant(arena.number(frame.id).value);
+            continue;
+        }
+        const BinaryOpNode& node = arena.binary(frame.id);
+        if (frame.operandsDone) {
+            compiler.emitBinary(node.op);
+            continue;
+        }
+        work.push_back({frame.id, true});
+        work.push_back({node.right, false});
+        work.push_back({node.left, false}); // Emitted first
+    }
+}
+
 //------------------------------------------------------------------------------
-// PrintNode
+// Statements (PRINT, LET, INPUT)
 //------------------------------------------------------------------------------
-void PrintNode::print(int indentLevel) const {
-    printIndent(indentLevel);
-    std::cout << "PrintNode:" << std::endl;
-    if (expression) {
-        expression->print(indentLevel + 1);
-    } else {
-        printIndent(indentLevel + 1);
-        std::cout << "<null expression>" << std::endl;
+void ProgramNode::printStatement(std::ostream& out, const StatementNode& stmt, int indentLevel) const {
+    switch (stmt.kind) {
+        case StatementKind::Print:
+            printIndent(out, indentLevel);
+            out << "PrintNode:\n";
+            printExpression(out, stmt.expression, indentLevel + 1);
+            break;
+        case StatementKind::Let:
+            printIndent(out, indentLevel);
+            out << "LetNode: " << symbols.name(stmt.slot) << '\n';
+            printExpression(out, stmt.expression, indentLevel + 1);
+            break;
+        case StatementKind::Input:
+            printIndent(out, indentLevel);
+            out << "InputNode: " << symbols.name(stmt.slot) << '\n';
+            break;
     }
 }
 
-void PrintNode::execute() const {
-    if (!expression) {
-        throw std::runtime_error("Runtime Error: PrintNode has null expression to execute");
+void ProgramNode::executeStatement(const StatementNode& stmt, OutputSink& out, double* variables,
+                                   OperatorCounts* counts) const {
+    switch (stmt.kind) {
+        case StatementKind::Print: {
+            double result = counts ? evaluate(stmt.expression, variables, *counts) : evaluate(stmt.expression, variables);
+            out.printNumber(result);
+            break;
+        }
+        case StatementKind::Let:
+            variables[stmt.slot] = counts ? evaluate(stmt.expression, variables, *counts)
+                                          : evaluate(stmt.expression, variables);
+            break;
+        case StatementKind::Input:
+            break; // The caller has put the value in variables
     }
-    double result = expression->evaluate();
-    // std::cout << std::fixed << std::setprecision(6) << result << std::endl;
-    std::cout << result << std::endl;
 }
 
 //------------------------------------------------------------------------------
 // ProgramNode
 //------------------------------------------------------------------------------
-void ProgramNode::print(int indentLevel) const {
-    printIndent(indentLevel);
-    std::cout << "ProgramNode:" << std::endl;
+void ProgramNode::print(std::ostream& out, int indentLevel) const {
+    printIndent(out, indentLevel);
+    out << "ProgramNode:\n";
     for (const auto& stmt : statements) {
-        if (stmt) {
-            stmt->print(indentLevel + 1);
-        } else {
-            printIndent(indentLevel + 1);
-            std::cout << "<null statement>" << std::endl;
+        printStatement(out, stmt, indentLevel + 1);
+    }
+}
+
+void ProgramNode::execute(OutputSink& out, OperatorCounts* counts) const {
+    std::vector<double> variables(symbols.size());
+    for (const auto& stmt : statements) {
+        executeStatement(stmt, out, variables.data(), counts);
+    }
+}
+
+// PRINT statements only read variables, so those between two LETs can be
+// evaluated in any order; only their output has to come out in source order.
+// Each LET (or INPUT) runs on its own once everything before it is done.
+void ProgramNode::execute(OutputSink& out, ThreadPool& pool, OperatorCounts* counts) const {
+    std::vector<double> variables(symbols.size());
+    const double* values = variables.data();
+    runStatementsParallel(statements.size(), [this](size_t i) {
+        return statements[i].assigns();
+    }, [this, &variables, &out, counts](size_t i) {
+        executeStatement(statements[i], out, variables.data(), counts);
+    }, [this, values](size_t i, double& result, OperatorCounts* blockCounts) {
+        result = blockCounts ? evaluate(statements[i].expression, values, *blockCounts)
+                             : evaluate(statements[i].expression, values);
+    }, out, pool, counts);
+}
+
+void ProgramNode::compile(Compiler& compiler) const {
+    compiler.setVariableCount(symbols.size());
+    for (const auto& stmt : statements) {
+        switch (stmt.kind) {
+            case StatementKind::Print:
+                compileExpression(stmt.expression, compiler);
+                compiler.emitPrint();
+                break;
+            case StatementKind::Let:
+                compileExpression(stmt.expression, compiler);
+                compiler.emitStore(stmt.slot);
+                break;
+            case StatementKind::Input:
+                break; // As in executeStatement()
         }
     }
 }
 
-void ProgramNode::execute() const {
+bool ProgramNode::hasInputs() const {
     for (const auto& stmt : statements) {
-        if (stmt) {
-            stmt->execute();
+        if (stmt.kind == StatementKind::Input) {
+            return true;
         }
-        // else: could log a warning or error if a null statement is encountered
     }
+    return false;
+}
+
+size_t ProgramNode::memoryBytes() const {
+    return arena.memoryBytes() + statements.capacity() * sizeof(StatementNode);
 }
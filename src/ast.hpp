@@ -1,91 +1,183 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <memory>
 #include <iostream> // For printing AST
 #include <stdexcept> // For std::runtime_error in evaluate/execute
+#include "operator_counts.hpp"
 
-// Forward declarations
-struct NumberNode;
-struct BinaryOpNode;
-struct PrintNode;
-struct ProgramNode;
+class Compiler;
+class OutputSink;
+class ThreadPool;
 
 //------------------------------------------------------------------------------
-// Base class for all expression nodes
+// Expression node references
 //------------------------------------------------------------------------------
-struct ExprNode {
-    virtual ~ExprNode() = default;
-    virtual void print(int indentLevel = 0) const = 0;
-    virtual double evaluate() const = 0; // To calculate the value of the expression
-};
+// Expression nodes are not allocated one by one; they live in typed vectors
+// owned by the ProgramNode (see ExprArena below) and refer to each other by
+// 32-bit ids. The top bit of an id selects the vector: clear for NumberNode,
+// set for BinaryOpNode. Bit 30 marks a variable reference, which needs no
+// node at all: its id holds the variable's slot (see SymbolTable below). The
+// remaining 30 bits are the index, so a program can have at most 2^30
+// number nodes and 2^30 binary nodes, and fewer than 2^30 variables.
+using ExprId = uint32_t;
+
+constexpr ExprId EXPR_BINARY_BIT = 0x80000000u;
+constexpr ExprId EXPR_VARIABLE_BIT = 0x40000000u;
+constexpr ExprId EXPR_INDEX_MASK = 0x3FFFFFFFu;
 
 //------------------------------------------------------------------------------
 // Represents a numeric literal
 //------------------------------------------------------------------------------
-struct NumberNode : ExprNode {
+struct NumberNode {
     double value;
-
-    explicit NumberNode(double val) : value(val) {}
-
-    void print(int indentLevel = 0) const override;
-    double evaluate() const override;
 };
 
 //------------------------------------------------------------------------------
 // Represents a binary operation
 //------------------------------------------------------------------------------
-struct BinaryOpNode : ExprNode {
+// The parser creates children before their parent, so within the binaries
+// vector a node's operands always have smaller indices than the node itself.
+struct BinaryOpNode {
     char op;
-    std::unique_ptr<ExprNode> left;
-    std::unique_ptr<ExprNode> right;
+    ExprId left;
+    ExprId right;
+};
 
-    BinaryOpNode(char operation, std::unique_ptr<ExprNode> lhs, std::unique_ptr<ExprNode> rhs)
-        : op(operation), left(std::move(lhs)), right(std::move(rhs)) {}
+//------------------------------------------------------------------------------
+// ExprArena: contiguous storage for all expression nodes of a program
+//------------------------------------------------------------------------------
+struct ExprArena {
+    std::vector<NumberNode> numbers;
+    std::vector<BinaryOpNode> binaries;
 
-    void print(int indentLevel = 0) const override;
-    double evaluate() const override;
+    ExprId addNumber(double value);
+    ExprId addBinary(char op, ExprId left, ExprId right);
+
+    static bool isBinary(ExprId id) { return (id & EXPR_BINARY_BIT) != 0; }
+    static bool isVariable(ExprId id) { return (id & EXPR_VARIABLE_BIT) != 0; }
+    static bool isNumber(ExprId id) { return (id & (EXPR_BINARY_BIT | EXPR_VARIABLE_BIT)) == 0; }
+    static uint32_t indexOf(ExprId id) { return id & EXPR_INDEX_MASK; } // Slot, for a variable
+    static ExprId variable(uint32_t slot) { return EXPR_VARIABLE_BIT | slot; }
+
+    const NumberNode& number(ExprId id) const { return numbers[indexOf(id)]; }
+    const BinaryOpNode& binary(ExprId id) const { return binaries[indexOf(id)]; }
+
+    size_t nodeCount() const { return numbers.size() + binaries.size(); }
+    size_t memoryBytes() const; // Bytes reserved by the node vectors
+
+    void clear(); // Frees every node at once
 };
 
 //------------------------------------------------------------------------------
-// Base class for all statement nodes
+// SymbolTable: variable names, interned to dense slots
 //------------------------------------------------------------------------------
-struct StatementNode {
-    virtual ~StatementNode() = default;
-    virtual void print(int indentLevel = 0) const = 0;
-    virtual void execute() const = 0; // To execute the statement
+// The parser resolves every variable to its slot (0, 1, 2, ... in order of
+// first definition), so at run time a variable is an index into a flat array
+// of doubles and names are never looked at again.
+class SymbolTable {
+public:
+    static constexpr uint32_t NO_SLOT = 0xFFFFFFFFu;
+
+    // Slot of name, or NO_SLOT
+    uint32_t find(std::string_view name) const;
+
+    // Slot of name, added as the next slot if it is new
+    uint32_t intern(std::string_view name);
+
+    const std::string& name(uint32_t slot) const { return names[slot]; }
+    size_t size() const { return names.size(); }
+
+    // Names that passes after the parser make up for their own variables
+    // (CommonSubexpressions) start with '$', which no source can contain
+    static bool isTemporary(std::string_view name) { return !name.empty() && name[0] == '$'; }
+
+    void clear();
+
+private:
+    std::vector<std::string> names;   // By slot
+    std::vector<uint32_t> buckets;    // Open addressing: slot + 1, 0 if empty
+
+    size_t bucketOf(std::string_view name) const;
 };
 
 //------------------------------------------------------------------------------
-// Represents a PRINT statement
+// Represents a statement
 //------------------------------------------------------------------------------
-struct PrintNode : StatementNode {
-    std::unique_ptr<ExprNode> expression;
+enum class StatementKind : uint8_t {
+    Print,          // PRINT expression;
+    Let,            // LET name = expression;
+    Input           // INPUT name; (expression is the variable itself)
+};
 
-    explicit PrintNode(std::unique_ptr<ExprNode> expr) : expression(std::move(expr)) {}
+// An Input statement takes the variable's value from the current input row
+// (simlanc --batch, see batch.hpp). Everywhere else it changes nothing, as
+// LET name = name; would, and programs with inputs are only run by the batch
+// evaluator.
+struct StatementNode {
+    StatementKind kind;
+    uint32_t slot;      // Variable assigned by Let or Input (0 for Print)
+    ExprId expression;
 
-    void print(int indentLevel = 0) const override;
-    void execute() const override;
+    bool assigns() const { return kind != StatementKind::Print; }
 };
 
 //------------------------------------------------------------------------------
 // Represents the entire program
 //------------------------------------------------------------------------------
+// Owns the arena, so destroying (or clearing) the ProgramNode releases the
+// whole tree in one shot instead of node by node.
 struct ProgramNode {
-    std::vector<std::unique_ptr<StatementNode>> statements;
+    ExprArena arena;
+    std::vector<StatementNode> statements;
+    SymbolTable symbols; // One slot per variable
 
-    void addStatement(std::unique_ptr<StatementNode> stmt) {
-        statements.emplace_back(std::move(stmt));
+    void addStatement(StatementNode stmt) {
+        statements.push_back(stmt);
     }
 
-    void print(int indentLevel = 0) const;
-    void execute() const; // To execute all statements in the program
+    // Debug dump of the tree. Lines are not flushed individually.
+    void print(std::ostream& out, int indentLevel = 0) const;
+    // To execute all statements in the program. With counts, every operator
+    // evaluated is counted there, up to and including one that fails.
+    void execute(OutputSink& out, OperatorCounts* counts = nullptr) const;
+    // Same, statements evaluated in parallel
+    void execute(OutputSink& out, ThreadPool& pool, OperatorCounts* counts = nullptr) const;
+    void compile(Compiler& compiler) const; // To lower all statements to bytecode
+
+    // To calculate the value of an expression. variables holds the current
+    // value of every slot (it may be null if the program has none).
+    double evaluate(ExprId expr, const double* variables = nullptr) const;
+    // Same, counting the operators it evaluates
+    double evaluate(ExprId expr, const double* variables, OperatorCounts& counts) const;
+
+    void printExpression(std::ostream& out, ExprId expr, int indentLevel) const;
+    void printStatement(std::ostream& out, const StatementNode& stmt, int indentLevel) const;
+    void executeStatement(const StatementNode& stmt, OutputSink& out, double* variables,
+                          OperatorCounts* counts = nullptr) const;
+    void compileExpression(ExprId expr, Compiler& compiler) const;
+
+    bool hasInputs() const; // Any Input statement
+
+    size_t memoryBytes() const; // Arena plus statement list
 };
 
-// Helper function for indentation in print methods
-inline void printIndent(int level) {
-    for (int i = 0; i < level; ++i) {
-        std::cout << "  ";
+// Helper function for indentation in print methods. Levels deeper than
+// MAX_PRINT_INDENT are indented as far as that one and marked with their
+// depth ("[level 300] "), so a line never costs more than a few bytes
+// however deep the tree is, and the dump stays linear in its size.
+constexpr int MAX_PRINT_INDENT = 64;
+
+inline void printIndent(std::ostream& out, int level) {
+    static const std::string indent(2 * MAX_PRINT_INDENT, ' ');
+    int shown = level < MAX_PRINT_INDENT ? level : MAX_PRINT_INDENT;
+    if (shown > 0) {
+        out.write(indent.data(), 2 * shown);
+    }
+    if (level > MAX_PRINT_INDENT) {
+        out << "[level " << level << "] ";
     }
 }
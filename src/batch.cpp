@@ -0,0 +1,626 @@
+#include "batch.hpp"
+#include "scan.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <charconv> // For std::from_chars
+#include <cstring>  // For std::memcpy
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SIMLAN_BATCH_X86 1
+#include <immintrin.h>
+#else
+#define SIMLAN_BATCH_X86 0
+#endif
+
+namespace {
+
+//------------------------------------------------------------------------------
+// CSV input
+//------------------------------------------------------------------------------
+constexpr size_t CSV_CHUNK_BYTES = 1 << 20; // Rows are parsed in chunks of about this size
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+std::string_view trim(std::string_view field) {
+    while (!field.empty() && isBlank(field.front())) field.remove_prefix(1);
+    while (!field.empty() && isBlank(field.back())) field.remove_suffix(1);
+    return field;
+}
+
+// The rows of one chunk: values by wanted column, and the first error
+struct CsvChunk {
+    std::string_view text;
+    size_t rows = 0;
+    size_t lines = 0;                       // Lines before the error, if there is one
+    std::vector<std::vector<double>> values;
+    std::string error;                      // Without the line number
+};
+
+// Parses the lines of chunk.text. wanted[j] is the output column of field j,
+// or -1 if the field is not converted.
+void parseCsvChunk(CsvChunk& chunk, const std::vector<long>& wanted, size_t columnCount) {
+    std::string_view text = chunk.text;
+    while (!text.empty()) {
+        size_t end = scan::findNewline(text.data(), text.data() + text.size());
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end < text.size() ? end + 1 : end);
+
+        if (trim(line).empty()) {
+            chunk.lines++;
+            continue;
+        }
+        size_t field = 0;
+        for (;;) {
+            size_t comma = line.find(',');
+            std::string_view value = trim(line.substr(0, comma));
+            if (field < columnCount && wanted[field] >= 0) {
+                // from_chars takes no leading '+', CSV writers may
+                const char* first = value.data();
+                const char* last = value.data() + value.size();
+                if (first != last && *first == '+') first++;
+                double number = 0;
+                auto [ptr, ec] = std::from_chars(first, last, number);
+                if (value.empty() || ec != std::errc() || ptr != last) {
+                    chunk.error = "'" + std::string(value) + "' is not a number";
+                    return;
+                }
+                chunk.values[static_cast<size_t>(wanted[field])].push_back(number);
+            }
+            field++;
+            if (comma == std::string_view::npos) break;
+            line.remove_prefix(comma + 1);
+        }
+        if (field != columnCount) {
+            chunk.error = "expected " + std::to_string(columnCount) + " fields, found " + std::to_string(field);
+            return;
+        }
+        chunk.rows++;
+        chunk.lines++;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Column kernels
+//------------------------------------------------------------------------------
+constexpr uint32_t NO_FAILURE = 0xFFFFFFFFu;
+
+// out[i] = a[i] op b[i] for i in [0, count), count a multiple of
+// BatchEvaluator::LANES; a scalar operand is a[0] (or b[0]) in every row. out
+// may be a or b. Rows that divide by zero get failedAt[i] = statement, unless
+// an earlier statement already failed them.
+using BinaryKernel = void (*)(const double* a, const double* b, double* out, size_t count,
+                              uint32_t* failedAt, uint32_t statement);
+
+inline void fail(uint32_t& failedAt, uint32_t statement) {
+    if (failedAt == NO_FAILURE) failedAt = statement;
+}
+
+// A constant divisor of zero fails every row
+inline bool failAll(const double* b, size_t count, uint32_t* failedAt, uint32_t statement) {
+    if (b[0] != 0) return false;
+    for (size_t i = 0; i < count; ++i) fail(failedAt[i], statement);
+    return true;
+}
+
+struct ScalarKernels {
+    template <char Op, bool ScalarLeft, bool ScalarRight>
+    static void binary(const double* a, const double* b, double* out, size_t count,
+                       uint32_t* failedAt, uint32_t statement) {
+        if (Op == '/' && ScalarRight) failAll(b, count, failedAt, statement);
+        for (size_t i = 0; i < count; ++i) {
+            double x = ScalarLeft ? a[0] : a[i];
+            double y = ScalarRight ? b[0] : b[i];
+            if constexpr (Op == '+') {
+                out[i] = x + y;
+            } else if constexpr (Op == '-') {
+                out[i] = x - y;
+            } else if constexpr (Op == '*') {
+                out[i] = x * y;
+            } else {
+                if (!ScalarRight && y == 0) fail(failedAt[i], statement);
+                out[i] = x / y;
+            }
+        }
+    }
+};
+
+#if SIMLAN_BATCH_X86
+
+// Fails the rows whose bits are set in lanes (the divisors that were zero)
+inline void failLanes(uint32_t* failedAt, unsigned lanes, uint32_t statement) {
+    for (; lanes != 0; lanes &= lanes - 1) {
+        fail(failedAt[__builtin_ctz(lanes)], statement);
+    }
+}
+
+// The divisor is checked before the quotient is stored, as out may be b
+struct AvxKernels {
+    template <char Op, bool ScalarLeft, bool ScalarRight>
+    __attribute__((target("avx")))
+    static void binary(const double* a, const double* b, double* out, size_t count,
+                       uint32_t* failedAt, uint32_t statement) {
+        if (Op == '/' && ScalarRight) failAll(b, count, failedAt, statement);
+        const __m256d zero = _mm256_setzero_pd();
+        for (size_t i = 0; i < count; i += 4) {
+            __m256d x = ScalarLeft ? _mm256_broadcast_sd(a) : _mm256_loadu_pd(a + i);
+            __m256d y = ScalarRight ? _mm256_broadcast_sd(b) : _mm256_loadu_pd(b + i);
+            __m256d r;
+            if constexpr (Op == '+') {
+                r = _mm256_add_pd(x, y);
+            } else if constexpr (Op == '-') {
+                r = _mm256_sub_pd(x, y);
+            } else if constexpr (Op == '*') {
+                r = _mm256_mul_pd(x, y);
+            } else {
+                if (!ScalarRight) {
+                    unsigned lanes = static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(y, zero, _CMP_EQ_OQ)));
+                    if (lanes != 0) failLanes(failedAt + i, lanes, statement);
+                }
+                r = _mm256_div_pd(x, y);
+            }
+            _mm256_storeu_pd(out + i, r);
+        }
+    }
+};
+
+struct Avx512Kernels {
+    template <char Op, bool ScalarLeft, bool ScalarRight>
+    __attribute__((target("avx512f")))
+    static void binary(const double* a, const double* b, double* out, size_t count,
+                       uint32_t* failedAt, uint32_t statement) {
+        if (Op == '/' && ScalarRight) failAll(b, count, failedAt, statement);
+        const __m512d zero = _mm512_setzero_pd();
+        for (size_t i = 0; i < count; i += 8) {
+            __m512d x = ScalarLeft ? _mm512_set1_pd(a[0]) : _mm512_loadu_pd(a + i);
+            __m512d y = ScalarRight ? _mm512_set1_pd(b[0]) : _mm512_loadu_pd(b + i);
+            __m512d r;
+            if constexpr (Op == '+') {
+                r = _mm512_add_pd(x, y);
+            } else if constexpr (Op == '-') {
+                r = _mm512_sub_pd(x, y);
+            } else if constexpr (Op == '*') {
+                r = _mm512_mul_pd(x, y);
+            } else {
+                if (!ScalarRight) {
+                    unsigned lanes = _mm512_cmp_pd_mask(y, zero, _CMP_EQ_OQ);
+                    if (lanes != 0) failLanes(failedAt + i, lanes, statement);
+                }
+                r = _mm512_div_pd(x, y);
+            }
+            _mm512_storeu_pd(out + i, r);
+        }
+    }
+};
+
+#endif // SIMLAN_BATCH_X86
+
+template <typename Kernels, char Op>
+BinaryKernel pickKernel(bool scalarLeft, bool scalarRight) {
+    if (scalarLeft) {
+        return scalarRight ? &Kernels::template binary<Op, true, true> : &Kernels::template binary<Op, true, false>;
+    }
+    return scalarRight ? &Kernels::template binary<Op, false, true> : &Kernels::template binary<Op, false, false>;
+}
+
+template <typename Kernels>
+BinaryKernel pickKernel(char op, bool scalarLeft, bool scalarRight) {
+    switch (op) {
+        case '+': return pickKernel<Kernels, '+'>(scalarLeft, scalarRight);
+        case '-': return pickKernel<Kernels, '-'>(scalarLeft, scalarRight);
+        case '*': return pickKernel<Kernels, '*'>(scalarLeft, scalarRight);
+        default:  return pickKernel<Kernels, '/'>(scalarLeft, scalarRight);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Dispatch
+//------------------------------------------------------------------------------
+BatchEvaluator::Isa bestIsa() {
+#if SIMLAN_BATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return BatchEvaluator::Isa::AVX512;
+    if (__builtin_cpu_supports("avx")) return BatchEvaluator::Isa::AVX;
+#endif
+    return BatchEvaluator::Isa::Scalar;
+}
+
+// Chosen once; setIsa() may override it before a run
+BatchEvaluator::Isa& currentIsa() {
+    static BatchEvaluator::Isa isa = bestIsa();
+    return isa;
+}
+
+BinaryKernel binaryKernel(BatchEvaluator::Isa isa, char op, bool scalarLeft, bool scalarRight) {
+#if SIMLAN_BATCH_X86
+    switch (isa) {
+        case BatchEvaluator::Isa::AVX512: return pickKernel<Avx512Kernels>(op, scalarLeft, scalarRight);
+        case BatchEvaluator::Isa::AVX: return pickKernel<AvxKernels>(op, scalarLeft, scalarRight);
+        case BatchEvaluator::Isa::Scalar: break;
+    }
+#else
+    (void)isa;
+#endif
+    return pickKernel<ScalarKernels>(op, scalarLeft, scalarRight);
+}
+
+// Columns of the block buffers are kept to about this many bytes in all
+constexpr size_t WORKSPACE_BYTES = 4 << 20;
+constexpr size_t MAX_BLOCK_ROWS = 512;
+
+// Blocks a task evaluates and formats in one go on the pool
+constexpr size_t BLOCKS_PER_TASK = 16;
+
+} // namespace
+
+bool readInputColumns(std::string_view csv, const std::vector<std::string>& names,
+                      std::vector<std::vector<double>>& columns, size_t& rows, std::string& error,
+                      ThreadPool* pool) {
+    size_t headerEnd = scan::findNewline(csv.data(), csv.data() + csv.size());
+    std::string_view header = csv.substr(0, headerEnd);
+    std::string_view body = csv.substr(headerEnd < csv.size() ? headerEnd + 1 : headerEnd);
+    if (trim(header).empty()) {
+        error = "line 1: expected a header with the column names";
+        return false;
+    }
+
+    std::vector<std::string_view> headerNames;
+    for (;;) {
+        size_t comma = header.find(',');
+        headerNames.push_back(trim(header.substr(0, comma)));
+        if (comma == std::string_view::npos) break;
+        header.remove_prefix(comma + 1);
+    }
+    std::vector<long> wanted(headerNames.size(), -1);
+    for (size_t i = 0; i < names.size(); ++i) {
+        auto column = std::find(headerNames.begin(), headerNames.end(), names[i]);
+        if (column == headerNames.end()) {
+            error = "no column named '" + names[i] + "'";
+            return false;
+        }
+        size_t field = static_cast<size_t>(column - headerNames.begin());
+        if (wanted[field] < 0) {
+            wanted[field] = static_cast<long>(i);
+        }
+    }
+
+    // Cut the rows into chunks at line ends
+    std::vector<CsvChunk> chunks;
+    while (!body.empty()) {
+        size_t size = std::min(body.size(), CSV_CHUNK_BYTES);
+        if (size < body.size()) {
+            const char* from = body.data() + size;
+            size += scan::findNewline(from, body.data() + body.size());
+            size = std::min(body.size(), size + 1);
+        }
+        CsvChunk chunk;
+        chunk.text = body.substr(0, size);
+        chunk.values.resize(names.size());
+        chunks.push_back(std::move(chunk));
+        body.remove_prefix(size);
+    }
+    auto parse = [&](size_t c) {
+        parseCsvChunk(chunks[c], wanted, headerNames.size());
+    };
+    if (pool && chunks.size() > 1) {
+        pool->parallelFor(chunks.size(), parse);
+    } else {
+        for (size_t c = 0; c < chunks.size(); ++c) parse(c);
+    }
+
+    // A name may have been asked for twice; both get the same values
+    rows = 0;
+    size_t line = 2;
+    for (const CsvChunk& chunk : chunks) {
+        if (!chunk.error.empty()) {
+            error = "line " + std::to_string(line + chunk.lines) + ": " + chunk.error;
+            return false;
+        }
+        rows += chunk.rows;
+        line += chunk.lines;
+    }
+    columns.assign(names.size(), std::vector<double>());
+    for (size_t i = 0; i < names.size(); ++i) {
+        size_t field = static_cast<size_t>(std::find(headerNames.begin(), headerNames.end(), names[i]) -
+                                           headerNames.begin());
+        size_t source = static_cast<size_t>(wanted[field]);
+        columns[i].reserve(rows);
+        for (const CsvChunk& chunk : chunks) {
+            columns[i].insert(columns[i].end(), chunk.values[source].begin(), chunk.values[source].end());
+        }
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// BatchEvaluator
+//------------------------------------------------------------------------------
+struct BatchEvaluator::Workspace {
+    size_t rows = 0;                // Rows of every column
+    std::vector<double> columns;    // Registers, then variables, then outputs
+    std::vector<uint32_t> failedAt; // Per row: statement that failed, or NO_FAILURE
+    const BinaryKernel* kernels = nullptr; // Per step
+    const double* constants = nullptr;
+    const std::vector<std::vector<double>>* inputColumns = nullptr;
+    size_t variableBase = 0;
+    size_t outputBase = 0;
+    size_t first = 0;               // Input row of the block's first row
+
+    // Offset in columns of a register, variable or output
+    size_t offsetOf(const Operand& operand) const {
+        size_t column = operand.index;
+        if (operand.kind == Operand::Kind::Variable) column += variableBase;
+        if (operand.kind == Operand::Kind::Output) column += outputBase;
+        return column * rows;
+    }
+
+    const double* read(const Operand& operand) const {
+        switch (operand.kind) {
+            case Operand::Kind::Constant: return constants + operand.index;
+            case Operand::Kind::Input: return (*inputColumns)[operand.index].data() + first;
+            default: return columns.data() + offsetOf(operand);
+        }
+    }
+
+    double* write(const Operand& operand) { return columns.data() + offsetOf(operand); }
+};
+
+BatchEvaluator::BatchEvaluator(const ProgramNode& program) {
+    variables = program.symbols.size();
+    std::vector<uint32_t> inputOfSlot(variables, SymbolTable::NO_SLOT);
+    for (size_t i = 0; i < program.statements.size(); ++i) {
+        const StatementNode& stmt = program.statements[i];
+        uint32_t statement = static_cast<uint32_t>(i);
+        Operand target{Operand::Kind::Variable, stmt.slot};
+        switch (stmt.kind) {
+            case StatementKind::Print:
+                target = Operand{Operand::Kind::Output, static_cast<uint32_t>(printStatements.size())};
+                printStatements.push_back(statement);
+                if (ExprArena::isVariable(stmt.expression) &&
+                    !SymbolTable::isTemporary(program.symbols.name(ExprArena::indexOf(stmt.expression)))) {
+                    printNames.push_back(program.symbols.name(ExprArena::indexOf(stmt.expression)));
+                } else {
+                    printNames.push_back("print" + std::to_string(printStatements.size()));
+                }
+                compileExpression(program, stmt.expression, 0, statement, &target);
+                break;
+            case StatementKind::Let:
+                compileExpression(program, stmt.expression, 0, statement, &target);
+                break;
+            case StatementKind::Input:
+                if (inputOfSlot[stmt.slot] == SymbolTable::NO_SLOT) {
+                    inputOfSlot[stmt.slot] = static_cast<uint32_t>(inputs.size());
+                    inputs.push_back(program.symbols.name(stmt.slot));
+                }
+                steps.push_back(Step{Step::Kind::Copy, 0, statement,
+                                     Operand{Operand::Kind::Input, inputOfSlot[stmt.slot]}, Operand{}, target});
+                break;
+        }
+    }
+}
+
+// Compiles expr into steps and returns where its value is. Binary nodes put
+// their value in register depth, or in *target for the statement's last step;
+// a leaf is not copied anywhere unless it is the whole statement. The tree is
+// walked with an explicit stack: the right operand's register depends on
+// where the left one's value ended up, so a binary node is visited three
+// times (before, between and after its operands).
+BatchEvaluator::Operand BatchEvaluator::compileExpression(const ProgramNode& program, ExprId expr, uint32_t depth,
+                                                          uint32_t statement, const Operand* target) {
+    enum class Stage : uint8_t { Start, LeftDone, RightDone };
+    struct Frame {
+        ExprId id;
+        uint32_t depth;
+        Stage stage;
+        const Operand* target; // Only set for expr itself
+    };
+    std::vector<Frame> work{{expr, depth, Stage::Start, target}};
+    std::vector<Operand> values;
+    while (!work.empty()) {
+        Frame frame = work.back();
+        work.pop_back();
+        Operand value;
+        if (ExprArena::isVariable(frame.id)) {
+            value = Operand{Operand::Kind::Variable, ExprArena::indexOf(frame.id)};
+        } else if (!ExprArena::isBinary(frame.id)) {
+            value = Operand{Operand::Kind::Constant, static_cast<uint32_t>(constants.size())};
+            constants.push_back(program.arena.number(frame.id).value);
+        } else {
+            const BinaryOpNode& node = program.arena.binary(frame.id);
+            if (frame.stage == Stage::Start) {
+                work.push_back({frame.id, frame.depth, Stage::LeftDone, frame.target});
+                work.push_back({node.left, frame.depth, Stage::Start, nullptr});
+                continue;
+            }
+            if (frame.stage == Stage::LeftDone) {
+                bool leftInRegister = values.back().kind == Operand::Kind::Register;
+                work.push_back({frame.id, frame.depth, Stage::RightDone, frame.target});
+                work.push_back({node.right, leftInRegister ? frame.depth + 1 : frame.depth, Stage::Start, nullptr});
+                continue;
+            }
+            Operand right = values.back();
+            values.pop_back();
+            Operand left = values.back();
+            values.pop_back();
+            if (frame.target) {
+                steps.push_back(Step{Step::Kind::Binary, node.op, statement, left, right, *frame.target});
+                values.push_back(*frame.target);
+                continue;
+            }
+            value = Operand{Operand::Kind::Register, frame.depth};
+            registers = std::max(registers, static_cast<size_t>(frame.depth) + 1);
+            steps.push_back(Step{Step::Kind::Binary, node.op, statement, left, right, value});
+        }
+        if (frame.target) {
+            steps.push_back(Step{Step::Kind::Copy, 0, statement, value, Operand{}, *frame.target});
+            value = *frame.target;
+        }
+        values.push_back(value);
+    }
+    return values.back();
+}
+
+size_t BatchEvaluator::blockRows() const {
+    size_t columns = registers + variables + printStatements.size();
+    size_t rows = columns == 0 ? MAX_BLOCK_ROWS : WORKSPACE_BYTES / (columns * sizeof(double));
+    rows = std::min(rows, MAX_BLOCK_ROWS);
+    return std::max(rows / LANES * LANES, LANES);
+}
+
+void BatchEvaluator::evaluateBlock(Workspace& workspace, const std::vector<std::vector<double>>& inputColumns,
+                                   size_t first, size_t count) const {
+    // Every step covers whole vectors; the rows past count are computed and
+    // then ignored
+    size_t width = (count + LANES - 1) / LANES * LANES;
+    workspace.first = first;
+    workspace.inputColumns = &inputColumns;
+    std::fill(workspace.failedAt.begin(), workspace.failedAt.begin() + count, NO_FAILURE);
+
+    for (size_t s = 0; s < steps.size(); ++s) {
+        const Step& step = steps[s];
+        double* out = workspace.write(step.target);
+        const double* left = workspace.read(step.left);
+        if (step.kind == Step::Kind::Copy) {
+            if (step.left.kind == Operand::Kind::Constant) {
+                std::fill(out, out + width, left[0]);
+            } else if (step.left.kind == Operand::Kind::Input) {
+                std::memcpy(out, left, count * sizeof(double));
+                std::fill(out + count, out + width, 0.0);
+            } else if (out != left) {
+                std::memcpy(out, left, width * sizeof(double));
+            }
+            continue;
+        }
+
+        const double* right = workspace.read(step.right);
+        workspace.kernels[s](left, right, out, width, workspace.failedAt.data(), step.statement);
+    }
+}
+
+size_t BatchEvaluator::formatBlock(const Workspace& workspace, size_t count, NumberFormat format,
+                                   std::string& text) const {
+    static constexpr std::string_view DIVISION_BY_ZERO = "Division by zero";
+
+    size_t failed = 0;
+    char number[OutputSink::MAX_NUMBER_LENGTH];
+    const double* outputs = workspace.columns.data() + workspace.outputBase * workspace.rows;
+    for (size_t row = 0; row < count; ++row) {
+        uint32_t failedAt = workspace.failedAt[row];
+        for (size_t p = 0; p < printStatements.size(); ++p) {
+            if (p > 0) text += ',';
+            if (printStatements[p] < failedAt) {
+                size_t length = OutputSink::formatNumber(number, outputs[p * workspace.rows + row], format);
+                text.append(number, length);
+            }
+        }
+        if (!printStatements.empty()) text += ',';
+        if (failedAt != NO_FAILURE) {
+            text += DIVISION_BY_ZERO;
+            failed++;
+        }
+        text += '\n';
+    }
+    return failed;
+}
+
+BatchEvaluator::Summary BatchEvaluator::run(const std::vector<std::vector<double>>& inputColumns, size_t rows,
+                                            OutputSink& out, ThreadPool* pool) const {
+    Summary summary;
+    summary.rows = rows;
+
+    std::string header;
+    for (const std::string& name : printNames) {
+        header += name;
+        header += ',';
+    }
+    header += "error\n";
+    out.write(header);
+
+    // The kernels of this run's ISA, one per step
+    Isa isa = activeIsa();
+    std::vector<BinaryKernel> kernels(steps.size(), nullptr);
+    for (size_t s = 0; s < steps.size(); ++s) {
+        const Step& step = steps[s];
+        if (step.kind == Step::Kind::Binary) {
+            kernels[s] = binaryKernel(isa, step.op, step.left.kind == Operand::Kind::Constant,
+                                      step.right.kind == Operand::Kind::Constant);
+        }
+    }
+
+    // Serially one block at a time; on the pool, rounds of tasks of
+    // BLOCKS_PER_TASK blocks, whose text is written in order after each round
+    size_t blockSize = blockRows();
+    size_t blocks = (rows + blockSize - 1) / blockSize;
+    size_t tasks = pool ? pool->size() * 4 : 1;
+    size_t blocksPerTask = pool ? BLOCKS_PER_TASK : 1;
+
+    std::vector<Workspace> workspaces(tasks);
+    for (Workspace& workspace : workspaces) {
+        workspace.rows = blockSize;
+        workspace.columns.assign((registers + variables + printStatements.size()) * blockSize, 0.0);
+        workspace.failedAt.assign(blockSize, NO_FAILURE);
+        workspace.kernels = kernels.data();
+        workspace.constants = constants.data();
+        workspace.variableBase = registers;
+        workspace.outputBase = registers + variables;
+    }
+    std::vector<std::string> texts(tasks);
+    std::vector<size_t> failed(tasks);
+
+    NumberFormat format = out.numberFormat();
+    for (size_t firstBlock = 0; firstBlock < blocks; firstBlock += tasks * blocksPerTask) {
+        auto runTask = [&](size_t task) {
+            texts[task].clear();
+            failed[task] = 0;
+            size_t begin = firstBlock + task * blocksPerTask;
+            size_t end = std::min(blocks, begin + blocksPerTask);
+            for (size_t block = begin; block < end; ++block) {
+                size_t first = block * blockSize;
+                size_t count = std::min(blockSize, rows - first);
+                evaluateBlock(workspaces[task], inputColumns, first, count);
+                failed[task] += formatBlock(workspaces[task], count, format, texts[task]);
+            }
+        };
+        if (pool) {
+            pool->parallelFor(tasks, runTask);
+        } else {
+            runTask(0);
+        }
+        for (size_t task = 0; task < tasks; ++task) {
+            out.write(texts[task]);
+            summary.failedRows += failed[task];
+        }
+    }
+    return summary;
+}
+
+BatchEvaluator::Isa BatchEvaluator::activeIsa() {
+    return currentIsa();
+}
+
+void BatchEvaluator::setIsa(Isa isa) {
+    currentIsa() = isSupported(isa) ? isa : bestIsa();
+}
+
+bool BatchEvaluator::isSupported(Isa isa) {
+    switch (isa) {
+        case Isa::Scalar: return true;
+#if SIMLAN_BATCH_X86
+        case Isa::AVX: __builtin_cpu_init(); return __builtin_cpu_supports("avx");
+        case Isa::AVX512: __builtin_cpu_init(); return __builtin_cpu_supports("avx512f");
+#else
+        default: return false;
+#endif
+    }
+    return false;
+}
+
+const char* BatchEvaluator::isaName(Isa isa) {
+    switch (isa) {
+        case Isa::Scalar: return "scalar";
+        case Isa::AVX: return "avx";
+        case Isa::AVX512: return "avx512";
+    }
+    return "unknown";
+}
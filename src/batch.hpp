@@ -0,0 +1,132 @@
+#pragma once
+
+#include "ast.hpp"
+#include "output.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ThreadPool;
+
+//------------------------------------------------------------------------------
+// Input columns (simlanc --batch=input.csv)
+//------------------------------------------------------------------------------
+// The first line of the CSV text names the columns; every later line that is
+// not blank is one row, with a number in every field. Fields are separated by
+// ',' and may be padded with spaces; there is no quoting. Only the columns in
+// names are converted, into columns[i] for names[i]; the others are checked
+// for their count only. With a pool, the rows are parsed in chunks on it.
+//
+// Returns false and sets error (starting with "line N: " where there is one)
+// if a name has no column or a row does not parse.
+bool readInputColumns(std::string_view csv, const std::vector<std::string>& names,
+                      std::vector<std::vector<double>>& columns, size_t& rows, std::string& error,
+                      ThreadPool* pool = nullptr);
+
+//------------------------------------------------------------------------------
+// BatchEvaluator: runs one program over many input rows
+//------------------------------------------------------------------------------
+// Each INPUT statement reads the variable's value from the column of the same
+// name. Rather than running the program once per row, the evaluator takes a
+// block of rows at a time and every operator works on whole columns of the
+// block, 4 rows per SIMD instruction with AVX and 8 with AVX-512, so the
+// cost of walking the program is shared by all the rows of a block.
+//
+// Expressions are flattened once into steps over column registers, allocated
+// like the VM's stack; a step's operands are registers, variables or
+// constants, and the last step of a statement writes straight into the LET's
+// variable or the PRINT's output column. The values are bit for bit those of
+// ProgramNode::execute().
+//
+// The output is CSV: a header with one column per PRINT (named after the
+// variable if it prints a bare variable of the source, else "printN") and a final "error"
+// column, then one line per input row, in input order. A division by zero
+// fails only its own row: the row gets the values printed before the failing
+// statement, empty fields after it, and "Division by zero" in its error
+// column, and the batch carries on.
+class BatchEvaluator {
+public:
+    enum class Isa {
+        Scalar,
+        AVX,    // 4 rows per instruction
+        AVX512  // 8 rows per instruction (AVX-512F)
+    };
+
+    // Rows per block are a multiple of this, whatever the ISA
+    static constexpr size_t LANES = 8;
+
+    struct Summary {
+        size_t rows = 0;
+        size_t failedRows = 0;
+    };
+
+    explicit BatchEvaluator(const ProgramNode& program);
+
+    // Names of the INPUT variables, in the order run() wants their columns
+    const std::vector<std::string>& inputNames() const { return inputs; }
+
+    // Evaluates the program for rows [0, rows) of inputs (one column per
+    // inputNames() entry) and writes the CSV described above to out. With a
+    // pool, blocks of rows are evaluated and formatted on it; the output is
+    // the same.
+    Summary run(const std::vector<std::vector<double>>& inputColumns, size_t rows, OutputSink& out,
+                ThreadPool* pool = nullptr) const;
+
+    // The implementation in use, and a way to force one (e.g. for benchmarks).
+    // Requests for an ISA the CPU lacks fall back to the best supported one.
+    static Isa activeIsa();
+    static void setIsa(Isa isa);
+    static bool isSupported(Isa isa);
+    static const char* isaName(Isa isa);
+
+private:
+    // Where a step reads or writes a column of the block
+    struct Operand {
+        enum class Kind : uint8_t {
+            Register,   // Temporary, index = stack depth
+            Variable,   // index = slot
+            Constant,   // index into constants (same value in every row)
+            Output,     // index = PRINT number
+            Input       // index into inputs
+        };
+        Kind kind;
+        uint32_t index;
+    };
+
+    struct Step {
+        enum class Kind : uint8_t {
+            Binary,     // target = left op right
+            Copy        // target = left
+        };
+        Kind kind;
+        char op;
+        uint32_t statement;     // Index of the statement the step belongs to
+        Operand left;
+        Operand right;
+        Operand target;
+    };
+
+    // Per worker: the columns of one block, and where each row failed
+    struct Workspace;
+
+    std::vector<Step> steps;
+    std::vector<double> constants;
+    std::vector<std::string> inputs;
+    std::vector<uint32_t> printStatements; // Statement index of each PRINT
+    std::vector<std::string> printNames;   // Output column headers
+    size_t registers = 0;
+    size_t variables = 0;
+
+    Operand compileExpression(const ProgramNode& program, ExprId expr, uint32_t depth, uint32_t statement,
+                              const Operand* target);
+    size_t blockRows() const;
+
+    // Evaluates rows [first, first + count) into workspace
+    void evaluateBlock(Workspace& workspace, const std::vector<std::vector<double>>& inputColumns,
+                       size_t first, size_t count) const;
+
+    // Appends the CSV lines of the block in workspace; returns its failed rows
+    size_t formatBlock(const Workspace& workspace, size_t count, NumberFormat format, std::string& text) const;
+};
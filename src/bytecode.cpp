@@ -0,0 +1,70 @@
+#include "bytecode.hpp"
+#include "ast.hpp"
+#include <cstring>   // For std::memcpy
+#include <stdexcept> // For std::runtime_error
+#include <string>
+
+Chunk Compiler::compile(const ProgramNode& program) {
+    chunk = Chunk();
+    stackDepth = 0;
+
+    program.compile(*this);
+    emitOp(OpCode::OP_HALT);
+    return std::move(chunk);
+}
+
+void Compiler::emitOp(OpCode op) {
+    chunk.code.push_back(static_cast<uint8_t>(op));
+}
+
+uint32_t Compiler::addConstant(double value) {
+    uint32_t index = static_cast<uint32_t>(chunk.constants.size());
+    chunk.constants.push_back(value);
+    return index;
+}
+
+void Compiler::emitOperand(OpCode op, uint32_t operand) {
+    size_t at = chunk.code.size();
+    chunk.code.resize(at + 1 + sizeof(operand));
+    chunk.code[at] = static_cast<uint8_t>(op);
+    std::memcpy(&chunk.code[at + 1], &operand, sizeof(operand));
+}
+
+void Compiler::push() {
+    stackDepth++;
+    if (stackDepth > chunk.maxStackDepth) {
+        chunk.maxStackDepth = stackDepth;
+    }
+}
+
+void Compiler::emitConstant(double value) {
+    emitOperand(OpCode::OP_CONSTANT, addConstant(value));
+    push();
+}
+
+void Compiler::emitLoad(uint32_t slot) {
+    emitOperand(OpCode::OP_LOAD, slot);
+    push();
+}
+
+void Compiler::emitStore(uint32_t slot) {
+    emitOperand(OpCode::OP_STORE, slot);
+    stackDepth--;
+}
+
+void Compiler::emitBinary(char op) {
+    switch (op) {
+        case '+': emitOp(OpCode::OP_ADD); break;
+        case '-': emitOp(OpCode::OP_SUBTRACT); break;
+        case '*': emitOp(OpCode::OP_MULTIPLY); break;
+        case '/': emitOp(OpCode::OP_DIVIDE); break;
+        default:
+            throw std::runtime_error("Compile Error: Unknown binary operator '" + std::string(1, op) + "'");
+    }
+    stackDepth--; // Two operands in, one result out
+}
+
+void Compiler::emitPrint() {
+    emitOp(OpCode::OP_PRINT);
+    stackDepth--;
+}
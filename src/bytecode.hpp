@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Bytecode Instructions
+//------------------------------------------------------------------------------
+// The compiled form of a program is a flat byte stream. Every instruction is a
+// one-byte opcode; OP_CONSTANT is followed by a 4-byte index into the constant
+// pool, OP_LOAD and OP_STORE by a 4-byte variable slot. Expressions are
+// lowered in post-order, so the operands of an operator are already on the VM
+// stack when it executes.
+enum class OpCode : uint8_t {
+    OP_CONSTANT,        // push constants[u32 operand]
+    OP_ADD,             // pop b, pop a, push a + b
+    OP_SUBTRACT,        // pop b, pop a, push a - b
+    OP_MULTIPLY,        // pop b, pop a, push a * b
+    OP_DIVIDE,          // pop b, pop a, push a / b (runtime error if b == 0)
+    OP_PRINT,           // pop a, print it
+    OP_LOAD,            // push variables[u32 operand]
+    OP_STORE,           // pop a, variables[u32 operand] = a
+    OP_HALT             // end of program
+};
+
+//------------------------------------------------------------------------------
+// Chunk: a compiled program
+//------------------------------------------------------------------------------
+struct Chunk {
+    std::vector<uint8_t> code;
+    std::vector<double> constants;
+    size_t maxStackDepth = 0; // Deepest VM stack the code can reach
+    size_t variableCount = 0; // Slots OP_LOAD and OP_STORE refer to
+};
+
+struct ProgramNode;
+
+//------------------------------------------------------------------------------
+// Compiler: lowers a ProgramNode into a Chunk
+//------------------------------------------------------------------------------
+// The AST nodes drive the lowering through their compile() methods and call
+// back into the emit helpers below, the same way print() and evaluate() work.
+class Compiler {
+public:
+    Chunk compile(const ProgramNode& program);
+
+    // Emit helpers used by the AST nodes
+    void emitConstant(double value);
+    void emitBinary(char op);
+    void emitPrint();
+    void emitLoad(uint32_t slot);
+    void emitStore(uint32_t slot);
+    void setVariableCount(size_t count) { chunk.variableCount = count; }
+
+private:
+    Chunk chunk;
+    size_t stackDepth = 0;
+
+    void emitOp(OpCode op);
+    void emitOperand(OpCode op, uint32_t operand);
+    void push();
+    uint32_t addConstant(double value);
+};
@@ -0,0 +1,382 @@
+#include "c_emitter.hpp"
+#include <cmath>   // For std::isnan, std::isinf, std::signbit
+#include <cstdint>
+#include <cstdio>  // For std::snprintf
+#include <cstring> // For std::memcpy
+#include <ostream>
+#include <vector>
+
+namespace {
+
+const char* const PROLOGUE = R"C(#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The values must be rounded to double after every operation, as in simlanc */
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD != 0
+#error "this program needs FLT_EVAL_METHOD == 0 (e.g. x86-64 or -mfpmath=sse)"
+#endif
+
+)C";
+
+// Only emitted for programs with a NaN literal (produced by -O1 folding)
+const char* const NAN_HELPER = R"C(/* A double from its bit pattern, so NaNs keep their sign and payload */
+static double simlan_bits(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+)C";
+
+// Formats like OutputSink::formatNumber(NumberFormat::Shortest), which uses
+// std::to_chars. snprintf and strtod are correctly rounded in every common C
+// library, which is all this relies on.
+const char* const SHORTEST_PRINT = R"C(/* Decimal digits and exponent of |v|, v finite and non-zero, as printed by
+   "%.*e" with ndigits (1 to 17) significant digits */
+static int simlan_decimal(double v, int ndigits, char* digits, int* exponent) {
+    char text[40];
+    int i = 0, n = 0;
+    if (ndigits < 1 || ndigits > 17) return 0;
+    snprintf(text, sizeof text, "%.*e", ndigits - 1, fabs(v));
+    for (; text[i] != 'e'; ++i) {
+        if (text[i] != '.') digits[n++] = text[i];
+    }
+    *exponent = atoi(text + i + 1);
+    return n;
+}
+
+/* Does the decimal digits[0..n) x 10^(exponent - n + 1) read back as |v|? */
+static int simlan_reads_back(double v, const char* digits, int n, int exponent) {
+    char text[48];
+    memcpy(text, digits, (size_t)n);
+    snprintf(text + n, sizeof text - (size_t)n, "e%d", exponent - n + 1);
+    return strtod(text, NULL) == fabs(v);
+}
+
+/* Adds delta (+1 or -1) to the last digit, with carry/borrow. Returns 0 if
+   that changes the number of digits (those candidates are not needed). */
+static int simlan_step(char* digits, int n, int* exponent, int delta) {
+    int i = n - 1;
+    if (delta > 0) {
+        while (i >= 0 && digits[i] == '9') digits[i--] = '0';
+        if (i < 0) { /* 99..9 + 1 = 100..0: one digit longer, shift */
+            digits[0] = '1';
+            for (i = 1; i < n; ++i) digits[i] = '0';
+            (*exponent)++;
+            return 1;
+        }
+        digits[i]++;
+    } else {
+        while (i >= 0 && digits[i] == '0') digits[i--] = '9';
+        if (i < 0) return 0;
+        digits[i]--;
+        if (digits[0] == '0') { /* 10..0 - 1 = 99..9 with one digit less */
+            if (n == 1) return 0;
+            memmove(digits, digits + 1, (size_t)(n - 1));
+            digits[n - 1] = '9';
+            (*exponent)--;
+        }
+    }
+    return 1;
+}
+
+/* The shortest n-digit decimal that reads back as v, if there is one: the
+   correctly rounded one, or else its neighbour on the other side of v */
+static int simlan_try_digits(double v, int n, char* digits, int* exponent) {
+    double rounded;
+    char text[48];
+    if (simlan_decimal(v, n, digits, exponent) != n) return 0;
+    if (simlan_reads_back(v, digits, n, *exponent)) return 1;
+    memcpy(text, digits, (size_t)n);
+    snprintf(text + n, sizeof text - (size_t)n, "e%d", *exponent - n + 1);
+    rounded = strtod(text, NULL);
+    if (!simlan_step(digits, n, exponent, rounded < fabs(v) ? 1 : -1)) return 0;
+    return simlan_reads_back(v, digits, n, *exponent);
+}
+
+/* Formats v like C++ std::to_chars(first, last, v): the fewest significant
+   digits that read back as v, in fixed or scientific notation, whichever is
+   shorter (fixed on a tie). Returns the length; out needs 32 bytes. */
+static int simlan_format_shortest(char* out, double v) {
+    char digits[24], best[24];
+    int n = 0, exponent = 0, best_n = 0, best_exponent = 0, len = 0;
+    int lo = 1, hi = 17, sci_len, fixed_len, i;
+
+    if (signbit(v)) out[len++] = '-';
+    if (isnan(v)) { memcpy(out + len, "nan", 3); return len + 3; }
+    if (isinf(v)) { memcpy(out + len, "inf", 3); return len + 3; }
+    if (v == 0) { out[len++] = '0'; return len; }
+
+    if (fabs(v) < 9007199254740992.0 && fabs(v) == floor(fabs(v))) {
+        /* Integers below 2^53: their own digits, less trailing zeros */
+        unsigned long long whole = (unsigned long long)fabs(v);
+        char reversed[24];
+        int count = 0;
+        while (whole > 0) { reversed[count++] = (char)('0' + whole % 10); whole /= 10; }
+        for (i = 0; i < count; ++i) best[i] = reversed[count - 1 - i];
+        best_exponent = count - 1;
+        best_n = count;
+        while (best_n > 1 && best[best_n - 1] == '0') best_n--;
+    } else {
+        /* Binary search for the fewest digits; a decimal with n digits also
+           has n + 1, so "some n-digit decimal reads back" is monotone in n */
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (simlan_try_digits(v, mid, digits, &exponent)) hi = mid;
+            else lo = mid + 1;
+        }
+        simlan_try_digits(v, lo, best, &best_exponent);
+        best_n = lo;
+        while (best_n > 1 && best[best_n - 1] == '0') best_n--;
+    }
+    n = best_n;
+    exponent = best_exponent;
+
+    /* d[.ddd]e+XX against the plain decimal */
+    sci_len = n + (n > 1 ? 1 : 0) + 2 + (abs(exponent) >= 100 ? 3 : 2);
+    if (exponent >= n - 1) fixed_len = exponent + 1;
+    else if (exponent >= 0) fixed_len = n + 1;
+    else fixed_len = n + 1 - exponent;
+
+    if (fixed_len <= sci_len) {
+        if (exponent >= n - 1 && fabs(v) >= 9007199254740992.0) {
+            /* Like to_chars, print a large integer exactly, not padded with zeros */
+            len += sprintf(out + len, "%.0f", fabs(v));
+        } else if (exponent >= n - 1) {
+            memcpy(out + len, best, (size_t)n);
+            len += n;
+            for (i = n; i <= exponent; ++i) out[len++] = '0';
+        } else if (exponent >= 0) {
+            memcpy(out + len, best, (size_t)(exponent + 1));
+            len += exponent + 1;
+            out[len++] = '.';
+            memcpy(out + len, best + exponent + 1, (size_t)(n - exponent - 1));
+            len += n - exponent - 1;
+        } else {
+            out[len++] = '0';
+            out[len++] = '.';
+            for (i = -1; i > exponent; --i) out[len++] = '0';
+            memcpy(out + len, best, (size_t)n);
+            len += n;
+        }
+    } else {
+        out[len++] = best[0];
+        if (n > 1) {
+            out[len++] = '.';
+            memcpy(out + len, best + 1, (size_t)(n - 1));
+            len += n - 1;
+        }
+        len += sprintf(out + len, "e%c%02d", exponent < 0 ? '-' : '+', abs(exponent));
+    }
+    return len;
+}
+
+static void simlan_print(double v) {
+    char text[40];
+    int len = simlan_format_shortest(text, v);
+    text[len++] = '\n';
+    fwrite(text, 1, (size_t)len, stdout);
+}
+
+)C";
+
+// NumberFormat::Legacy is %g with 6 significant digits
+const char* const LEGACY_PRINT = R"C(static void simlan_print(double v) {
+    printf("%g\n", v);
+}
+
+)C";
+
+// The header comment must not end early
+std::string commentSafe(const std::string& text) {
+    std::string safe;
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '*' && i + 1 < text.size() && text[i + 1] == '/') {
+            safe += "* ";
+        } else if (static_cast<unsigned char>(c) < 0x20 || c == 0x7F) {
+            safe += '?';
+        } else {
+            safe += c;
+        }
+    }
+    return safe;
+}
+
+// A C expression with exactly the value v. Finite values are hex float
+// literals, which C reads back exactly.
+std::string literal(double v) {
+    if (std::isnan(v)) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof bits);
+        char text[48];
+        std::snprintf(text, sizeof text, "simlan_bits(0x%016llxULL)", static_cast<unsigned long long>(bits));
+        return text;
+    }
+    if (std::isinf(v)) {
+        return v < 0 ? "(-(double)INFINITY)" : "(double)INFINITY";
+    }
+    char text[48];
+    std::snprintf(text, sizeof text, std::signbit(v) ? "(%a)" : "%a", v);
+    return text;
+}
+
+} // namespace
+
+void CEmitter::emit(const ProgramNode& program, std::ostream& out) const {
+    size_t count = program.statements.size();
+    size_t functions = (count + STATEMENTS_PER_FUNCTION - 1) / STATEMENTS_PER_FUNCTION;
+
+    out << "/* Generated by simlanc --emit=c from " << commentSafe(sourceName) << ".\n"
+        << "   Compile as C99 or later without FMA contraction or fast-math,\n"
+        << "   e.g. cc -O2 -ffp-contract=off program.c -lm (with GCC, add -fsignaling-nans\n"
+        << "   so that the sign of a NaN is kept as well) */\n\n";
+    out << PROLOGUE;
+
+    bool hasNaN = false;
+    for (const NumberNode& number : program.arena.numbers) {
+        hasNaN = hasNaN || std::isnan(number.value);
+    }
+    if (hasNaN) {
+        out << NAN_HELPER;
+    }
+    bool hasPrint = false;
+    for (const StatementNode& stmt : program.statements) {
+        hasPrint = hasPrint || stmt.kind == StatementKind::Print;
+    }
+    if (hasPrint) {
+        out << (format == NumberFormat::Legacy ? LEGACY_PRINT : SHORTEST_PRINT);
+    }
+    if (program.symbols.size() > 0) {
+        out << "/* Variables by slot: ";
+        for (size_t slot = 0; slot < program.symbols.size(); ++slot) {
+            out << (slot > 0 ? ", " : "") << program.symbols.name(static_cast<uint32_t>(slot));
+        }
+        out << " */\nstatic double simlan_vars[" << program.symbols.size() << "];\n\n";
+    }
+
+    // Each function returns 1 when a statement fails, after printing the
+    // statements before it
+    for (size_t f = 0; f < functions; ++f) {
+        size_t first = f * STATEMENTS_PER_FUNCTION;
+        size_t last = first + STATEMENTS_PER_FUNCTION < count ? first + STATEMENTS_PER_FUNCTION : count;
+        emitFunction(program, f, first, last, out);
+    }
+
+    if (functions > 0) {
+        out << "static int (*const simlan_blocks[])(void) = {\n";
+        for (size_t f = 0; f < functions; ++f) {
+            out << "    simlan_block_" << f << ",\n";
+        }
+        out << "};\n\n";
+    }
+
+    out << "int main(void) {\n"
+        << "    static char buffer[64 * 1024];\n"
+        << "    int status = 0;\n";
+    if (functions > 0) {
+        out << "    size_t i;\n";
+    }
+    out << "    setvbuf(stdout, buffer, _IOFBF, sizeof buffer);\n";
+    if (functions > 0) {
+        out << "    for (i = 0; i < sizeof simlan_blocks / sizeof simlan_blocks[0]; ++i) {\n"
+            << "        if (simlan_blocks[i]()) {\n"
+            << "            fflush(stdout);\n"
+            << "            fputs(\"Runtime Execution Error: Runtime Error: Division by zero\\n\", stderr);\n"
+            << "            return 1;\n"
+            << "        }\n"
+            << "    }\n";
+    }
+    out << "    if (fflush(stdout) != 0 || ferror(stdout)) {\n"
+        << "        fputs(\"Error: Could not write program output\\n\", stderr);\n"
+        << "        status = 1;\n"
+        << "    }\n"
+        << "    return status;\n"
+        << "}\n";
+}
+
+void CEmitter::emitFunction(const ProgramNode& program, size_t index, size_t first, size_t last,
+                            std::ostream& out) const {
+    const ExprArena& arena = program.arena;
+
+    // Post-order walk with explicit stacks, so deep expressions cannot
+    // overflow the native stack. operands holds the C expression of each
+    // value computed so far: a literal, a variable, or the local "s<depth>"
+    // holding it.
+    struct Work {
+        ExprId expr;
+        bool expanded; // Operands already pushed
+    };
+    std::vector<Work> work;
+    std::vector<std::string> operands;
+    std::string code;
+    size_t slots = 0;
+
+    for (size_t i = first; i < last; ++i) {
+        const StatementNode& stmt = program.statements[i];
+        work.push_back({stmt.expression, false});
+        while (!work.empty()) {
+            Work item = work.back();
+            work.pop_back();
+            if (ExprArena::isVariable(item.expr)) {
+                operands.push_back("simlan_vars[" + std::to_string(ExprArena::indexOf(item.expr)) + "]");
+                continue;
+            }
+            if (!ExprArena::isBinary(item.expr)) {
+                operands.push_back(literal(arena.number(item.expr).value));
+                continue;
+            }
+            const BinaryOpNode& node = arena.binary(item.expr);
+            if (!item.expanded) {
+                work.push_back({item.expr, true});
+                work.push_back({node.right, false});
+                work.push_back({node.left, false});
+                continue;
+            }
+
+            std::string right = std::move(operands.back());
+            operands.pop_back();
+            std::string left = std::move(operands.back());
+            operands.pop_back();
+            size_t slot = operands.size(); // The left operand, if in a local, is in this one
+            slots = slot + 1 > slots ? slot + 1 : slots;
+
+            if (node.op == '/') {
+                if (!ExprArena::isNumber(node.right)) {
+                    code += "    if (" + right + " == 0) return 1;\n";
+                } else if (arena.number(node.right).value == 0) {
+                    code += "    return 1;\n";
+                }
+            }
+            std::string target = "s" + std::to_string(slot);
+            code += "    " + target + " = " + left + ' ' + node.op + ' ' + right + ";\n";
+            operands.push_back(std::move(target));
+        }
+
+        switch (stmt.kind) {
+            case StatementKind::Print:
+                code += "    simlan_print(" + operands.back() + ");\n";
+                break;
+            case StatementKind::Let:
+                code += "    simlan_vars[" + std::to_string(stmt.slot) + "] = " + operands.back() + ";\n";
+                break;
+            case StatementKind::Input:
+                break; // Not supported; see the class comment
+        }
+        operands.pop_back();
+    }
+
+    out << "static int simlan_block_" << index << "(void) {\n";
+    if (slots > 0) {
+        out << "    double s0";
+        for (size_t s = 1; s < slots; ++s) {
+            out << ", s" << s;
+        }
+        out << ";\n";
+    }
+    out << code << "    return 0;\n}\n\n";
+}
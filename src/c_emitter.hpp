@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ast.hpp"
+#include "output.hpp"
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <utility>
+
+//------------------------------------------------------------------------------
+// CEmitter: translates a ProgramNode into a self-contained C program
+//------------------------------------------------------------------------------
+// The generated translation unit needs nothing but the C99 standard library
+// and, once compiled, prints exactly what simlanc --emit=run prints for the
+// same program and number format: the same text for every value, the output
+// of the statements before a division by zero, then the same "Division by
+// zero" message on stderr and exit status 1.
+//
+// Every expression is flattened into assignments to local doubles (one per
+// level of the evaluation stack, as in the VM), evaluated in the same order
+// as ProgramNode::evaluate(); variables live in one file-scope array,
+// indexed by slot. A division gets a zero check only when its
+// divisor is not a nonzero literal. Statements are grouped into functions of
+// STATEMENTS_PER_FUNCTION so that C compilers do not choke on huge programs.
+// Programs with INPUT statements have nowhere to read their rows from, so
+// simlanc does not translate them.
+//
+// The result must be compiled without FMA contraction and fast-math (e.g.
+// -ffp-contract=off) on a target with FLT_EVAL_METHOD == 0, otherwise the
+// values can differ in their last bits; the file #errors on the latter.
+// GCC also needs -fsignaling-nans, or it turns x * -1 into -x, which gives
+// a NaN read from a variable the other sign.
+class CEmitter {
+public:
+    static constexpr size_t STATEMENTS_PER_FUNCTION = 256;
+
+    // sourceName only appears in the header comment
+    CEmitter(NumberFormat format, std::string sourceName)
+        : format(format), sourceName(std::move(sourceName)) {}
+
+    void emit(const ProgramNode& program, std::ostream& out) const;
+
+private:
+    NumberFormat format;
+    std::string sourceName;
+
+    // Emits the statements [first, last) as static int simlan_block_<index>(void)
+    void emitFunction(const ProgramNode& program, size_t index, size_t first, size_t last,
+                      std::ostream& out) const;
+};
@@ -0,0 +1,203 @@
+#include "cse.hpp"
+#include <cstring> // For std::memcpy
+#include <string>
+
+std::unique_ptr<ProgramNode> CommonSubexpressions::eliminate(const ProgramNode& program) {
+    values.clear();
+    buckets.assign(1024, 0);
+    currentValue.assign(program.symbols.size(), NO_VALUE);
+    total = 0;
+    interned = 0;
+    temporaries = 0;
+
+    // 1. Value numbering: the DAG node of every statement's expression, and
+    // how many times each node is used. Both passes walk their trees with
+    // explicit stacks, reused from statement to statement.
+    struct Frame {
+        uint32_t id; // ExprId in the first pass, value number in the second
+        bool operandsDone;
+    };
+    std::vector<Frame> work;
+    std::vector<uint32_t> results;
+    std::vector<uint32_t> roots(program.statements.size(), NO_VALUE);
+    size_t numberNodes = 0;
+    for (size_t i = 0; i < program.statements.size(); ++i) {
+        const StatementNode& stmt = program.statements[i];
+        if (stmt.kind == StatementKind::Input) {
+            currentValue[stmt.slot] = newVariable(stmt.slot);
+            continue;
+        }
+        work.assign(1, Frame{stmt.expression, false});
+        results.clear();
+        while (!work.empty()) {
+            Frame frame = work.back();
+            work.pop_back();
+            bool added;
+            if (ExprArena::isVariable(frame.id)) {
+                uint32_t slot = ExprArena::indexOf(frame.id);
+                if (currentValue[slot] == NO_VALUE) {
+                    currentValue[slot] = newVariable(slot);
+                }
+                results.push_back(currentValue[slot]);
+            } else if (!ExprArena::isBinary(frame.id)) {
+                total++;
+                numberNodes++;
+                results.push_back(intern(Value{Kind::Number, 0, 0, 0, program.arena.number(frame.id).value, 0,
+                                               NOT_EMITTED},
+                                         added));
+            } else if (!frame.operandsDone) {
+                const BinaryOpNode& node = program.arena.binary(frame.id);
+                work.push_back({frame.id, true});
+                work.push_back({node.right, false});
+                work.push_back({node.left, false});
+            } else {
+                total++;
+                uint32_t right = results.back();
+                results.pop_back();
+                uint32_t left = results.back();
+                results.pop_back();
+                uint32_t value = intern(Value{Kind::Binary, program.arena.binary(frame.id).op, left, right, 0.0, 0,
+                                              NOT_EMITTED},
+                                        added);
+                if (added) {
+                    // A node met again shares the operands counted the first time
+                    values[left].uses++;
+                    values[right].uses++;
+                }
+                results.push_back(value);
+            }
+        }
+        roots[i] = results.back();
+        values[roots[i]].uses++;
+        if (stmt.kind == StatementKind::Let) {
+            currentValue[stmt.slot] = newVariable(stmt.slot);
+        }
+    }
+
+    // 2. Write every DAG node once, in the order the statements first need
+    // them; a node with several uses goes to a temporary variable
+    auto optimized = std::make_unique<ProgramNode>();
+    optimized->symbols = program.symbols;
+    uint32_t nextName = 1;
+    for (size_t i = 0; i < program.statements.size(); ++i) {
+        const StatementNode& stmt = program.statements[i];
+        if (stmt.kind == StatementKind::Input) {
+            optimized->addStatement(stmt);
+            continue;
+        }
+        work.assign(1, Frame{roots[i], false});
+        results.clear();
+        while (!work.empty()) {
+            Frame frame = work.back();
+            work.pop_back();
+            Value& value = values[frame.id];
+            if (value.emitted != NOT_EMITTED) {
+                results.push_back(value.emitted);
+                continue;
+            }
+            if (value.kind == Kind::Variable) {
+                results.push_back(ExprArena::variable(value.left));
+                continue;
+            }
+            if (value.kind == Kind::Number) {
+                value.emitted = optimized->arena.addNumber(value.number);
+                results.push_back(value.emitted);
+                continue;
+            }
+            if (!frame.operandsDone) {
+                work.push_back({frame.id, true});
+                work.push_back({value.right, false});
+                work.push_back({value.left, false}); // Written (and hoisted) first
+                continue;
+            }
+            ExprId right = results.back();
+            results.pop_back();
+            ExprId left = results.back();
+            results.pop_back();
+            ExprId id = optimized->arena.addBinary(value.op, left, right);
+            if (value.uses > 1) {
+                std::string name;
+                do {
+                    name = "$" + std::to_string(nextName++);
+                } while (optimized->symbols.find(name) != SymbolTable::NO_SLOT);
+                uint32_t slot = optimized->symbols.intern(name);
+                optimized->addStatement(StatementNode{StatementKind::Let, slot, id});
+                temporaries++;
+                id = ExprArena::variable(slot);
+                value.emitted = id;
+            }
+            results.push_back(id);
+        }
+        optimized->addStatement(StatementNode{stmt.kind, stmt.slot, results.back()});
+    }
+
+    auto bytes = [](size_t numbers, size_t binaries, size_t statements) {
+        return static_cast<long long>(numbers * sizeof(NumberNode) + binaries * sizeof(BinaryOpNode) +
+                                      statements * sizeof(StatementNode));
+    };
+    saved = bytes(numberNodes, total - numberNodes, program.statements.size()) -
+            bytes(optimized->arena.numbers.size(), optimized->arena.binaries.size(),
+                  optimized->statements.size());
+
+    values.clear();
+    values.shrink_to_fit();
+    buckets.clear();
+    buckets.shrink_to_fit();
+    return optimized;
+}
+
+uint32_t CommonSubexpressions::newVariable(uint32_t slot) {
+    values.push_back(Value{Kind::Variable, 0, slot, 0, 0.0, 0, NOT_EMITTED});
+    return static_cast<uint32_t>(values.size() - 1);
+}
+
+uint32_t CommonSubexpressions::intern(const Value& probe, bool& added) {
+    size_t bucket = bucketOf(probe);
+    if (buckets[bucket] != 0) {
+        added = false;
+        return buckets[bucket] - 1;
+    }
+    uint32_t value = static_cast<uint32_t>(values.size());
+    values.push_back(probe);
+    buckets[bucket] = value + 1;
+    interned++;
+    added = true;
+
+    // Keep the table at most half full
+    if (interned * 2 > buckets.size()) {
+        buckets.assign(buckets.size() * 2, 0);
+        for (uint32_t v = 0; v < values.size(); ++v) {
+            if (values[v].kind != Kind::Variable) {
+                buckets[bucketOf(values[v])] = v + 1;
+            }
+        }
+    }
+    return value;
+}
+
+size_t CommonSubexpressions::bucketOf(const Value& probe) const {
+    // Numbers are told apart by their bits, so 0.0 and -0.0 stay different
+    uint64_t key;
+    if (probe.kind == Kind::Number) {
+        std::memcpy(&key, &probe.number, sizeof key);
+    } else {
+        key = (static_cast<uint64_t>(probe.left) << 32 | probe.right) ^ static_cast<uint64_t>(probe.op) << 56;
+    }
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+
+    size_t mask = buckets.size() - 1;
+    size_t bucket = static_cast<size_t>(key) & mask;
+    while (buckets[bucket] != 0) {
+        const Value& entry = values[buckets[bucket] - 1];
+        if (entry.kind == probe.kind &&
+            (probe.kind == Kind::Number
+                 ? std::memcmp(&entry.number, &probe.number, sizeof probe.number) == 0
+                 : entry.op == probe.op && entry.left == probe.left && entry.right == probe.right)) {
+            break;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    return bucket;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "ast.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// CommonSubexpressions: evaluates every distinct subexpression once per run
+//------------------------------------------------------------------------------
+// Runs after the Optimizer (simlanc -O2). Structurally identical subtrees are
+// hash-consed into one DAG node: numbers by their bits, operators by their
+// operator and operand nodes, and a variable by its slot and its version (the
+// LET or INPUT that last assigned it), so x + 1 before and after LET x = ...
+// are different nodes.
+//
+// A DAG node with a single use is written back in place. One used more than
+// once (by several parents, or as the whole expression of several statements)
+// is computed into a new variable ("$1", "$2", ..., see
+// SymbolTable::isTemporary()) by a LET inserted before the statement that
+// first needs it, and every use reads that variable. Every engine then
+// computes each distinct node once per run.
+//
+// The values printed are unchanged, and so is the failing statement: a
+// hoisted division by zero fails in the inserted LET, just before the
+// statement that contained it, with the same message, and every statement
+// before that one still runs.
+class CommonSubexpressions {
+public:
+    std::unique_ptr<ProgramNode> eliminate(const ProgramNode& program);
+
+    // Number and operator nodes in the input trees, and how many of them are
+    // distinct (the nodes the output has)
+    size_t totalNodes() const { return total; }
+    size_t uniqueNodes() const { return interned; }
+    size_t temporaryCount() const { return temporaries; }
+
+    // Node and statement bytes the output needs less than the input
+    // (negative if the added LETs cost more than the nodes saved)
+    long long savedBytes() const { return saved; }
+
+private:
+    enum class Kind : uint8_t { Number, Variable, Binary };
+
+    // One DAG node, identified by its index (value number)
+    struct Value {
+        Kind kind;
+        char op;
+        uint32_t left;      // Value numbers of the operands, or the slot
+        uint32_t right;
+        double number;
+        uint32_t uses;      // Distinct parents plus statements it is the root of
+        ExprId emitted;     // Its id in the output once written, else NOT_EMITTED
+    };
+
+    static constexpr ExprId NOT_EMITTED = 0xFFFFFFFFu;
+    static constexpr uint32_t NO_VALUE = 0xFFFFFFFFu;
+
+    std::vector<Value> values;
+    std::vector<uint32_t> buckets;      // Numbers and operators; value number + 1, 0 if empty
+    std::vector<uint32_t> currentValue; // Per slot: value number of its current version, or NO_VALUE
+    size_t total = 0;
+    size_t interned = 0;
+    size_t temporaries = 0;
+    long long saved = 0;
+
+    // Value number of the number or operator node described by probe, added
+    // if it is new
+    uint32_t intern(const Value& probe, bool& added);
+    size_t bucketOf(const Value& probe) const;
+
+    // A new version of the variable in slot
+    uint32_t newVariable(uint32_t slot);
+};
@@ -0,0 +1,474 @@
+#include "incremental.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "scan.hpp"
+#include <algorithm> // For std::fill
+#include <iterator>  // For std::make_move_iterator
+#include <stdexcept> // For std::invalid_argument
+#include <utility>
+
+namespace {
+
+// End of the segment that starts at from: just past the first ';' outside a
+// comment (terminated), or the end of the text. Every such ';' is a
+// SEMICOLON token, and no statement goes past its first one. from is a clean
+// lexer state, so comments can be followed from there instead of looked up
+// per line.
+size_t segmentEnd(std::string_view text, size_t from, bool& terminated) {
+    size_t pos = from;
+    terminated = false;
+    while (pos < text.size()) {
+        size_t next = text.find_first_of(";/", pos);
+        if (next == std::string_view::npos) {
+            break;
+        }
+        if (text[next] == ';') {
+            terminated = true;
+            return next + 1;
+        }
+        if (next + 1 < text.size() && text[next + 1] == '/') {
+            next = text.find('\n', next);
+            if (next == std::string_view::npos) {
+                break;
+            }
+        }
+        pos = next + 1;
+    }
+    return text.size();
+}
+
+// Copies the expression tree at expr from one arena into another, children
+// first, without recursion
+ExprId copyExpression(const ExprArena& from, ExprArena& to, ExprId expr,
+                      std::vector<std::pair<ExprId, bool>>& work, std::vector<ExprId>& done) {
+    work.push_back({expr, false});
+    while (!work.empty()) {
+        auto [id, expanded] = work.back();
+        work.pop_back();
+        if (ExprArena::isVariable(id)) {
+            done.push_back(id); // Not a node
+            continue;
+        }
+        if (!ExprArena::isBinary(id)) {
+            done.push_back(to.addNumber(from.number(id).value));
+            continue;
+        }
+        const BinaryOpNode& node = from.binary(id);
+        if (!expanded) {
+            work.push_back({id, true});
+            work.push_back({node.right, false});
+            work.push_back({node.left, false});
+            continue;
+        }
+        ExprId right = done.back();
+        done.pop_back();
+        ExprId left = done.back();
+        done.pop_back();
+        done.push_back(to.addBinary(node.op, left, right));
+    }
+    ExprId copy = done.back();
+    done.pop_back();
+    return copy;
+}
+
+// Starts a new round of marks: no slot is marked afterwards
+void nextEpoch(std::vector<uint32_t>& marks, uint32_t& epoch) {
+    if (++epoch == 0) {
+        std::fill(marks.begin(), marks.end(), 0);
+        epoch = 1;
+    }
+}
+
+} // namespace
+
+// marks must have an entry for every slot
+void IncrementalParser::Block::recount(std::vector<uint32_t>& marks, uint32_t& epoch) {
+    length = 0;
+    newlines = 0;
+    tail = 0;
+    errors = 0;
+    defines.clear();
+    reads.clear();
+    nextEpoch(marks, epoch); // Marks the slots defined or read so far in the block
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const Segment& segment = segments[i];
+        length += segment.length;
+        newlines += segment.newlines;
+        tail = segment.newlines > 0 ? segment.tail : tail + segment.length;
+        errors += segment.error ? 1 : 0;
+        for (size_t u = 0; u < segment.uses.size(); ++u) {
+            uint32_t slot = segment.uses[u].slot;
+            if (marks[slot] != epoch) {
+                marks[slot] = epoch;
+                reads.push_back(BlockUse{slot, static_cast<uint32_t>(i), static_cast<uint32_t>(u)});
+            }
+        }
+        if (segment.defines != SymbolTable::NO_SLOT) {
+            marks[segment.defines] = epoch; // Later reads in the block are covered
+            defines.push_back(segment.defines);
+        }
+    }
+}
+
+IncrementalParser::IncrementalParser(std::string_view source) {
+    TextEdit edit;
+    edit.inserted = source;
+    applyEdit(edit, source);
+}
+
+IncrementalParser::Position IncrementalParser::findDamaged(size_t offset) const {
+    // A segment that ends before offset keeps its tokens: nothing after a
+    // ';' can change it. One that ends at offset only does if it ends with
+    // that ';'; an unterminated last segment would grow.
+    Position position;
+    for (; position.block < blocks.size(); ++position.block) {
+        const Block& block = blocks[position.block];
+        bool last = position.block + 1 == blocks.size();
+        size_t end = position.offset + block.length;
+        if (end > offset || (last && end == offset && !block.segments.back().terminated)) {
+            break;
+        }
+        position.offset = end;
+        position.line += block.newlines;
+        if (block.newlines > 0) {
+            position.lineStart = end - block.tail;
+        }
+    }
+    if (position.block == blocks.size()) {
+        return position; // Past the last segment
+    }
+    const Block& block = blocks[position.block];
+    for (; position.index < block.segments.size(); ++position.index) {
+        const Segment& segment = block.segments[position.index];
+        size_t end = position.offset + segment.length;
+        if (end > offset || (end == offset && !segment.terminated)) {
+            break;
+        }
+        position.offset = end;
+        position.line += segment.newlines;
+        if (segment.newlines > 0) {
+            position.lineStart = end - segment.tail;
+        }
+    }
+    return position;
+}
+
+bool IncrementalParser::parseSegment(size_t pos, size_t line, size_t lineStart, Segment& segment) {
+    size_t end = segmentEnd(text, pos, segment.terminated);
+    segment.length = end - pos;
+    segment.newlines = scan::countNewlines(text.data() + pos, text.data() + end);
+    // The last '\n' is in the segment, so the search stays inside it too
+    segment.tail = segment.newlines > 0 ? end - text.rfind('\n', end - 1) - 1 : segment.length;
+    segment.nodes = 0;
+    segment.defines = SymbolTable::NO_SLOT;
+    segment.uses.clear();
+    segment.error.reset();
+    StatementNode& stmt = segment.statement;
+    stmt = StatementNode{StatementKind::Print, 0, 0};
+    parsedUses.clear();
+
+    ExprArena& arena = programNode.arena;
+    size_t numbers = arena.numbers.size();
+    size_t binaries = arena.binaries.size();
+    try {
+        // The lexer stops at end, so the parser cannot look past the ';'
+        Lexer lexer(text, pos, end, static_cast<int>(line), lineStart);
+        Parser parser(lexer);
+        parser.deferVariableChecks(parsedUses);
+        if (parser.atEnd()) {
+            return false; // Trailing whitespace and comments
+        }
+        stmt = parser.parseStatementInto(programNode);
+        segment.nodes = arena.numbers.size() - numbers + arena.binaries.size() - binaries;
+        if (stmt.assigns()) {
+            segment.defines = stmt.slot;
+        }
+    } catch (const ParseError& e) {
+        // Drop the nodes of the partial statement
+        arena.numbers.resize(numbers);
+        arena.binaries.resize(binaries);
+
+        std::string message = e.what();
+        std::string where = " at line " + std::to_string(e.getLine()) + ", column " + std::to_string(e.getColumn());
+        message.resize(message.size() - where.size());
+        bool lexical = dynamic_cast<const LexError*>(&e) != nullptr;
+        if (lexical) {
+            message.erase(0, std::string("Lexical Error: ").size());
+        }
+
+        auto error = std::make_unique<SegmentError>();
+        error->message = std::move(message);
+        error->lexical = lexical;
+        error->lineDelta = static_cast<size_t>(e.getLine()) - line;
+        int startColumn = static_cast<int>(pos - lineStart) + 1;
+        error->column = error->lineDelta == 0 ? e.getColumn() - startColumn : e.getColumn();
+        segment.error = std::move(error);
+    }
+
+    int startColumn = static_cast<int>(pos - lineStart) + 1;
+    segment.uses.reserve(parsedUses.size());
+    for (const VariableUse& use : parsedUses) {
+        uint32_t lineDelta = static_cast<uint32_t>(static_cast<size_t>(use.line) - line);
+        segment.uses.push_back(SegmentUse{use.slot, lineDelta, lineDelta == 0 ? use.column - startColumn : use.column});
+    }
+    return true;
+}
+
+void IncrementalParser::applyEdit(const TextEdit& edit, std::string_view newSource) {
+    size_t oldSize = text.size();
+    if (edit.offset > oldSize || edit.removed > oldSize - edit.offset ||
+        newSource.size() != oldSize - edit.removed + edit.inserted.size()) {
+        throw std::invalid_argument("Edit does not match the source text");
+    }
+    text = newSource;
+    lastParsed = 0;
+
+    // 1. Where re-lexing starts: the end of the last segment before the edit
+    Position start = findDamaged(edit.offset);
+    size_t editEnd = edit.offset + edit.removed; // In the old text
+
+    // Old segments from start on, walked alongside the new ones
+    size_t cursorBlock = start.block;
+    size_t cursorIndex = start.index;
+    size_t cursorOffset = start.offset; // Old offset of the cursor segment
+    size_t replaced = 0;                // Old segments the cursor has passed
+    auto cursorAtEnd = [&] { return cursorBlock == blocks.size(); };
+    auto advanceCursor = [&] {
+        cursorOffset += blocks[cursorBlock].segments[cursorIndex].length;
+        replaced++;
+        if (++cursorIndex == blocks[cursorBlock].segments.size()) {
+            cursorBlock++;
+            cursorIndex = 0;
+        }
+    };
+
+    // 2. Re-parse segment by segment until the new segments line up with an
+    // old boundary behind the edit
+    std::vector<Segment> fresh;
+    size_t pos = start.offset;
+    size_t line = start.line;
+    size_t lineStart = start.lineStart;
+    bool resynced = false;
+    while (true) {
+        while (!cursorAtEnd() && (cursorOffset < editEnd || cursorOffset - edit.removed + edit.inserted.size() < pos)) {
+            advanceCursor();
+        }
+        if (cursorOffset >= editEnd && cursorOffset - edit.removed + edit.inserted.size() == pos) {
+            resynced = true; // The rest of the text, cursor segment on, is unchanged
+            break;
+        }
+
+        Segment segment;
+        if (!parseSegment(pos, line, lineStart, segment)) {
+            break;
+        }
+        lastParsed++;
+        size_t end = pos + segment.length;
+        if (segment.newlines > 0) {
+            line += segment.newlines;
+            lineStart = end - segment.tail;
+        }
+        pos = end;
+        bool terminated = segment.terminated;
+        fresh.push_back(std::move(segment));
+        if (!terminated) {
+            break; // Reached the end of the text
+        }
+    }
+    if (!resynced) {
+        // Whatever was left of the old segments is gone
+        while (!cursorAtEnd()) {
+            advanceCursor();
+        }
+    }
+
+    // 3. Replace the old segments [start, cursor) with the new ones. The
+    // blocks they were in are rebuilt from what is left of them.
+    size_t firstBlock = start.block;
+    size_t firstIndex = start.index;
+    if (firstBlock == blocks.size() && !blocks.empty()) {
+        firstBlock = blocks.size() - 1; // Appending: extend the last block
+        firstIndex = blocks[firstBlock].segments.size();
+    }
+    size_t endBlock = cursorAtEnd() ? blocks.size() : cursorBlock + 1;
+
+    std::vector<Segment> merged;
+    if (firstBlock < blocks.size()) {
+        std::vector<Segment>& head = blocks[firstBlock].segments;
+        merged.insert(merged.end(), std::make_move_iterator(head.begin()),
+                      std::make_move_iterator(head.begin() + static_cast<std::ptrdiff_t>(firstIndex)));
+    }
+    for (size_t b = firstBlock; b < endBlock; ++b) {
+        for (size_t i = b == firstBlock ? firstIndex : 0; i < blocks[b].segments.size(); ++i) {
+            if (b == cursorBlock && i == cursorIndex) {
+                break;
+            }
+            const Segment& removed = blocks[b].segments[i];
+            garbageNodes += removed.nodes;
+        }
+        errorCount -= blocks[b].errors;
+    }
+    merged.insert(merged.end(), std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+    if (!cursorAtEnd()) {
+        std::vector<Segment>& tail = blocks[cursorBlock].segments;
+        merged.insert(merged.end(), std::make_move_iterator(tail.begin() + static_cast<std::ptrdiff_t>(cursorIndex)),
+                      std::make_move_iterator(tail.end()));
+    }
+
+    std::vector<Block> rebuilt((merged.size() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    marks.resize(programNode.symbols.size(), 0);
+    for (size_t b = 0; b < rebuilt.size(); ++b) {
+        size_t from = merged.size() * b / rebuilt.size();
+        size_t to = merged.size() * (b + 1) / rebuilt.size();
+        rebuilt[b].segments.assign(std::make_move_iterator(merged.begin() + static_cast<std::ptrdiff_t>(from)),
+                                   std::make_move_iterator(merged.begin() + static_cast<std::ptrdiff_t>(to)));
+        rebuilt[b].recount(marks, epoch);
+        errorCount += rebuilt[b].errors;
+    }
+    blocks.erase(blocks.begin() + static_cast<std::ptrdiff_t>(firstBlock),
+                 blocks.begin() + static_cast<std::ptrdiff_t>(endBlock));
+    blocks.insert(blocks.begin() + static_cast<std::ptrdiff_t>(firstBlock),
+                  std::make_move_iterator(rebuilt.begin()), std::make_move_iterator(rebuilt.end()));
+
+    segmentCount = segmentCount - replaced + fresh.size();
+    statementsStale = true;
+
+    checkVariables();
+
+    // 4. Drop dead nodes once they are the majority
+    constexpr size_t MIN_GARBAGE = 64 * 1024;
+    if (garbageNodes >= MIN_GARBAGE && garbageNodes > programNode.arena.nodeCount() - garbageNodes) {
+        compact();
+    }
+}
+
+void IncrementalParser::checkVariables() {
+    undefined = UndefinedUse();
+    nextEpoch(marks, epoch); // Marks the slots defined so far
+    size_t offset = 0;
+    size_t line = 1;
+    size_t lineStart = 0;
+    for (const Block& block : blocks) {
+        for (const BlockUse& read : block.reads) {
+            if (marks[read.slot] == epoch) {
+                continue;
+            }
+            // The first read of a slot not defined before the block. Reads
+            // are in source order, so no undefined use comes before it.
+            for (uint32_t i = 0; i < read.segment; ++i) {
+                const Segment& segment = block.segments[i];
+                offset += segment.length;
+                line += segment.newlines;
+                if (segment.newlines > 0) {
+                    lineStart = offset - segment.tail;
+                }
+            }
+            const SegmentUse& use = block.segments[read.segment].uses[read.use];
+            undefined.found = true;
+            undefined.slot = read.slot;
+            undefined.line = static_cast<int>(line + use.lineDelta);
+            undefined.column = use.column;
+            if (use.lineDelta == 0) {
+                undefined.column += static_cast<int>(offset - lineStart) + 1;
+            }
+            return;
+        }
+        for (uint32_t slot : block.defines) {
+            marks[slot] = epoch;
+        }
+        offset += block.length;
+        line += block.newlines;
+        if (block.newlines > 0) {
+            lineStart = offset - block.tail;
+        }
+    }
+}
+
+void IncrementalParser::compact() {
+    ExprArena fresh;
+    size_t live = programNode.arena.nodeCount() - garbageNodes;
+    fresh.numbers.reserve(live);
+    fresh.binaries.reserve(live / 2);
+
+    std::vector<std::pair<ExprId, bool>> work;
+    std::vector<ExprId> done;
+    for (Block& block : blocks) {
+        for (Segment& segment : block.segments) {
+            if (!segment.error) {
+                segment.statement.expression =
+                    copyExpression(programNode.arena, fresh, segment.statement.expression, work, done);
+            }
+        }
+    }
+    programNode.arena = std::move(fresh);
+    garbageNodes = 0;
+    statementsStale = true;
+}
+
+const ProgramNode& IncrementalParser::program() const {
+    if (statementsStale) {
+        std::vector<StatementNode>& statements = programNode.statements;
+        statements.clear();
+        statements.reserve(segmentCount);
+        for (const Block& block : blocks) {
+            for (const Segment& segment : block.segments) {
+                statements.push_back(segment.statement);
+            }
+        }
+        statementsStale = false;
+    }
+    return programNode;
+}
+
+void IncrementalParser::throwError() const {
+    if (!hasError()) {
+        return;
+    }
+    // The parse error that comes first: an undefined variable or a syntax
+    // error, whichever is earlier in the text
+    auto throwUndefined = [this] {
+        throw Parser::undefinedVariable(programNode.symbols.name(undefined.slot), undefined.line, undefined.column);
+    };
+    auto before = [this](int line, int column) {
+        return undefined.found && (undefined.line < line || (undefined.line == line && undefined.column < column));
+    };
+    if (errorCount == 0) {
+        throwUndefined();
+    }
+    size_t offset = 0;
+    size_t line = 1;
+    size_t lineStart = 0;
+    for (const Block& block : blocks) {
+        if (block.errors == 0) {
+            offset += block.length;
+            line += block.newlines;
+            if (block.newlines > 0) {
+                lineStart = offset - block.tail;
+            }
+            continue;
+        }
+        for (const Segment& segment : block.segments) {
+            if (!segment.error) {
+                offset += segment.length;
+                line += segment.newlines;
+                if (segment.newlines > 0) {
+                    lineStart = offset - segment.tail;
+                }
+                continue;
+            }
+            const SegmentError& error = *segment.error;
+            int errorLine = static_cast<int>(line + error.lineDelta);
+            int errorColumn = error.column;
+            if (error.lineDelta == 0) {
+                errorColumn += static_cast<int>(offset - lineStart) + 1;
+            }
+            if (before(errorLine, errorColumn)) {
+                throwUndefined();
+            }
+            if (error.lexical) {
+                throw LexError(error.message, errorLine, errorColumn);
+            }
+            throw ParseError(error.message, errorLine, errorColumn);
+        }
+    }
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "ast.hpp"
+#include "parser.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// TextEdit: one change to a source text
+//------------------------------------------------------------------------------
+struct TextEdit {
+    size_t offset = 0;          // Where the change starts, in the text before it
+    size_t removed = 0;         // Bytes removed at offset
+    std::string_view inserted;  // Text put in their place
+};
+
+//------------------------------------------------------------------------------
+// IncrementalParser: keeps a ProgramNode up to date with an edited source
+//------------------------------------------------------------------------------
+// For tools that re-parse on every keystroke. The source is split into
+// segments, one per statement: a segment runs from the end of the previous
+// one through the ';' that ends its statement, so the whitespace and comments
+// before a statement belong to it. Only the segment boundaries are kept, not
+// the tokens. Each segment holds its statement, so an edit touches only the
+// blocks it falls in; program() puts the statements in one list when it is
+// next asked for them.
+//
+// After an edit, lexing restarts at the end of the last segment before the
+// change, which is a clean lexer state (just past a ';'). Segments are
+// re-parsed one by one until one of them ends exactly where an old segment
+// boundary behind the change has moved to: from there on the text, and so
+// every token and statement, is what it was. A "//" typed or removed only
+// affects the rest of its line, so the work done depends on the size of the
+// change, not of the file. Segments are kept in blocks with cached lengths
+// and line starts, so finding the change, and the line and column it starts
+// at, only takes a walk over the blocks.
+//
+// A statement that does not parse becomes an error segment, ending at the
+// first ';' after its start, and parsing carries on behind it; the program
+// is only complete while hasError() is false. The nodes of replaced
+// statements stay in the arena until they outnumber the live ones, then the
+// arena is compacted.
+//
+// Variable names are interned as they are seen, so a slot outlives the
+// statements that use it. Whether every use follows a LET is checked after
+// each edit from per-block summaries of what the block defines and what it
+// reads before defining it; that takes time in the number of blocks and of
+// variables, not of statements.
+//
+// The caller owns the text, as with Lexer: the text passed to the
+// constructor or to the last applyEdit() must stay alive until the next
+// applyEdit().
+class IncrementalParser {
+public:
+    explicit IncrementalParser(std::string_view source);
+
+    IncrementalParser(const IncrementalParser&) = delete;
+    IncrementalParser& operator=(const IncrementalParser&) = delete;
+
+    // Applies edit to the program. newSource is the whole text after the
+    // edit. Throws std::invalid_argument if the edit does not fit the old
+    // text or newSource; the parser is unchanged then.
+    void applyEdit(const TextEdit& edit, std::string_view newSource);
+
+    // The statements, as Parser::parseProgram() would return them. While
+    // hasError() is true, the statements of error segments are placeholders
+    // and the program must not be run. The first call after an edit gathers
+    // the statements from the segments, in time linear in their number.
+    const ProgramNode& program() const;
+
+    bool hasError() const { return errorCount > 0 || undefined.found; }
+
+    // Throws the LexError or ParseError that Parser::parseProgram() throws
+    // for the current text (the first one in it), if there is one
+    void throwError() const;
+
+    size_t statementCount() const { return segmentCount; }
+
+    // Statements parsed by the last applyEdit() (or the constructor)
+    size_t lastParsedCount() const { return lastParsed; }
+
+private:
+    // A parse error, placed relative to its segment so that it stays right
+    // when text before the segment changes
+    struct SegmentError {
+        std::string message;    // Without " at line L, column C"
+        bool lexical = false;   // A LexError (message without "Lexical Error: ")
+        size_t lineDelta = 0;   // Lines from the segment's start
+        int column = 0;         // Columns from the segment's start if lineDelta == 0, else absolute
+    };
+
+    // A variable reference, placed like SegmentError
+    struct SegmentUse {
+        uint32_t slot;
+        uint32_t lineDelta;
+        int column;
+    };
+
+    struct Segment {
+        size_t length = 0;      // Bytes from the end of the previous segment through this one
+        size_t newlines = 0;    // '\n' among them
+        size_t tail = 0;        // Bytes after the last '\n', or all of them if there is none
+        size_t nodes = 0;       // Arena nodes of the statement
+        StatementNode statement{StatementKind::Print, 0, 0}; // A placeholder if error is set
+        bool terminated = true; // Ends with ';' (only the last segment may not)
+        uint32_t defines = SymbolTable::NO_SLOT; // Slot a LET assigns
+        std::vector<SegmentUse> uses; // In source order, including those of an error segment
+        std::unique_ptr<SegmentError> error; // Set if the statement does not parse
+    };
+
+    // A variable a block reads before defining it, at its first such use
+    struct BlockUse {
+        uint32_t slot;
+        uint32_t segment;
+        uint32_t use;
+    };
+
+    struct Block {
+        std::vector<Segment> segments;
+        size_t length = 0;   // Sums over the segments
+        size_t newlines = 0;
+        size_t tail = 0;     // As in Segment
+        size_t errors = 0;
+        std::vector<uint32_t> defines; // Slots assigned in the block
+        std::vector<BlockUse> reads;   // In source order
+
+        void recount(std::vector<uint32_t>& marks, uint32_t& epoch);
+    };
+
+    // The first use of a variable before its definition
+    struct UndefinedUse {
+        bool found = false;
+        uint32_t slot = 0;
+        int line = 0;
+        int column = 0;
+    };
+
+    // Where a segment is: block, index in the block, and what is before it
+    struct Position {
+        size_t block = 0;
+        size_t index = 0;
+        size_t offset = 0;    // Of the segment's start
+        size_t line = 1;      // Line number at offset
+        size_t lineStart = 0; // Offset of the start of that line
+    };
+
+    static constexpr size_t BLOCK_SIZE = 512;
+
+    mutable ProgramNode programNode; // statements is filled in by program()
+    mutable bool statementsStale = false;
+    std::vector<Block> blocks;
+    size_t segmentCount = 0;
+    std::string_view text;
+    size_t errorCount = 0;
+    size_t garbageNodes = 0; // Arena nodes no statement refers to any more
+    size_t lastParsed = 0;
+    UndefinedUse undefined;
+    std::vector<VariableUse> parsedUses; // Scratch for parseSegment()
+    std::vector<uint32_t> marks;         // Per slot: epoch in which it was last marked
+    uint32_t epoch = 0;
+
+    // The first segment that an edit at offset can change
+    Position findDamaged(size_t offset) const;
+
+    // Parses one segment starting at pos; false if only whitespace and
+    // comments are left
+    bool parseSegment(size_t pos, size_t line, size_t lineStart, Segment& segment);
+
+    // Finds the first use of an undefined variable
+    void checkVariables();
+
+    void compact();
+};
@@ -0,0 +1,396 @@
+#include "jit.hpp"
+#include "parallel.hpp"
+#include <cstdint>
+#include <cstring>   // For std::memcpy
+#include <initializer_list>
+#include <stdexcept> // For std::runtime_error
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define SIMLAN_JIT_X86_64 1
+#include <sys/mman.h>
+#else
+#define SIMLAN_JIT_X86_64 0
+#endif
+
+namespace {
+
+#if SIMLAN_JIT_X86_64
+
+//------------------------------------------------------------------------------
+// Machine code emitter
+//------------------------------------------------------------------------------
+// The code buffer starts with a copy of the chunk's constant pool, followed by
+// the functions, so constants are addressed RIP-relative and most of them end
+// up as a memory operand of the instruction that consumes them. Variables are
+// addressed the same way relative to rsi.
+//
+// Register use inside a generated function:
+//   xmm0  top of the value stack
+//   xmm1  right-hand operand of the operator being emitted
+//   xmm2  scratch zero for the division check
+//   [rsp] the rest of the value stack, 8 bytes per entry
+//   rbp   frame pointer, used to unwind the value stack on return
+//   rdi   the double* result argument
+//   rsi   the const double* variables argument
+//   rdx   the uint64_t* operator counts argument (read only by counting code)
+class Emitter {
+public:
+    std::vector<uint8_t> bytes;
+    size_t codeBase = 0;    // Offset of bytes[0] from the start of the constant pool
+    bool counting = false;  // Count every operator (JIT::compile(chunk, true))
+
+    void emit(std::initializer_list<uint8_t> b) { bytes.insert(bytes.end(), b); }
+
+    void prologue() {
+        emit({0x55});                               // push rbp
+        emit({0x48, 0x89, 0xE5});                   // mov rbp, rsp
+    }
+
+    // xmm0 = constants[index]
+    void loadConstant(uint32_t index) {
+        constantOperand(0x10, 0x05, index);         // movsd xmm0, [rip + constant]
+    }
+
+    // xmm0 = xmm0 <op> constants[index]
+    void arithmeticConstant(OpCode op, uint32_t index) {
+        constantOperand(arithmeticOpcode(op), 0x05, index);
+    }
+
+    // xmm0 = variables[slot]
+    void loadVariable(uint32_t slot) {
+        variableOperand(0x10, 0x86, slot);          // movsd xmm0, [rsi + slot * 8]
+    }
+
+    // xmm1 = variables[slot]
+    void loadVariableRight(uint32_t slot) {
+        variableOperand(0x10, 0x8E, slot);          // movsd xmm1, [rsi + slot * 8]
+    }
+
+    // xmm0 = xmm0 <op> variables[slot]
+    void arithmeticVariable(OpCode op, uint32_t slot) {
+        variableOperand(arithmeticOpcode(op), 0x86, slot);
+    }
+
+    // counts[operator]++ for the operator about to be applied, when counting
+    void countOperator(OpCode op) {
+        if (!counting) {
+            return;
+        }
+        uint8_t disp = static_cast<uint8_t>((static_cast<uint8_t>(op) - static_cast<uint8_t>(OpCode::OP_ADD)) * 8);
+        emit({0x48, 0x83, 0x42, disp, 0x01});       // add qword [rdx + disp8], 1
+    }
+
+    // Pushes xmm0 onto the machine stack
+    void spill() {
+        emit({0x48, 0x83, 0xEC, 0x08});             // sub rsp, 8
+        emit({0xF2, 0x0F, 0x11, 0x04, 0x24});       // movsd [rsp], xmm0
+    }
+
+    // Moves the top of stack into xmm1 and pops the next entry into xmm0
+    void unspill() {
+        emit({0x66, 0x0F, 0x28, 0xC8});             // movapd xmm1, xmm0
+        emit({0xF2, 0x0F, 0x10, 0x04, 0x24});       // movsd xmm0, [rsp]
+        emit({0x48, 0x83, 0xC4, 0x08});             // add rsp, 8
+    }
+
+    // Jumps to the error exit if xmm1 == 0 (NaN compares unordered, not equal).
+    // Returns the offset of the rel32 displacement to patch.
+    size_t checkDivisor() {
+        emit({0x66, 0x0F, 0x57, 0xD2});             // xorpd xmm2, xmm2
+        emit({0x66, 0x0F, 0x2E, 0xCA});             // ucomisd xmm1, xmm2
+        emit({0x7A, 0x06});                         // jp +6 (over the je)
+        emit({0x0F, 0x84, 0, 0, 0, 0});             // je rel32
+        return bytes.size() - 4;
+    }
+
+    // xmm0 = xmm0 <op> xmm1
+    void arithmetic(OpCode op) {
+        emit({0xF2, 0x0F, arithmeticOpcode(op), 0xC1});
+    }
+
+    // Unconditional jump; returns the offset of the rel32 displacement to patch
+    size_t jump() {
+        emit({0xE9, 0, 0, 0, 0});                   // jmp rel32
+        return bytes.size() - 4;
+    }
+
+    // Stores xmm0 into *result and returns 0
+    void returnValue() {
+        emit({0xF2, 0x0F, 0x11, 0x07});             // movsd [rdi], xmm0
+        emit({0x31, 0xC0});                         // xor eax, eax
+        epilogue();
+    }
+
+    // Returns 1 (division by zero)
+    void returnError() {
+        emit({0xB8, 0x01, 0x00, 0x00, 0x00});       // mov eax, 1
+        epilogue();
+    }
+
+    void patchJump(size_t displacementAt, size_t target) {
+        int32_t rel = static_cast<int32_t>(target - (displacementAt + 4));
+        std::memcpy(&bytes[displacementAt], &rel, sizeof(rel));
+    }
+
+private:
+    // Second opcode byte of addsd/subsd/mulsd/divsd
+    static uint8_t arithmeticOpcode(OpCode op) {
+        switch (op) {
+            case OpCode::OP_ADD:      return 0x58;
+            case OpCode::OP_SUBTRACT: return 0x5C;
+            case OpCode::OP_MULTIPLY: return 0x59;
+            case OpCode::OP_DIVIDE:   return 0x5E;
+            default:
+                throw std::runtime_error("JIT Error: Not an arithmetic opcode");
+        }
+    }
+
+    // F2 0F <opcode> /r with a [rip + disp32] operand pointing at a constant
+    void constantOperand(uint8_t opcode, uint8_t modrm, uint32_t index) {
+        emit({0xF2, 0x0F, opcode, modrm, 0, 0, 0, 0});
+        size_t next = codeBase + bytes.size();      // RIP after this instruction
+        int64_t rel = static_cast<int64_t>(index) * 8 - static_cast<int64_t>(next);
+        int32_t disp = static_cast<int32_t>(rel);
+        std::memcpy(&bytes[bytes.size() - 4], &disp, sizeof(disp));
+    }
+
+    // F2 0F <opcode> /r with a [rsi + disp32] operand pointing at a variable
+    void variableOperand(uint8_t opcode, uint8_t modrm, uint32_t slot) {
+        emit({0xF2, 0x0F, opcode, modrm, 0, 0, 0, 0});
+        int32_t disp = static_cast<int32_t>(slot * 8);
+        std::memcpy(&bytes[bytes.size() - 4], &disp, sizeof(disp));
+    }
+
+    void epilogue() {
+        emit({0x48, 0x89, 0xEC});                   // mov rsp, rbp
+        emit({0x5D});                               // pop rbp
+        emit({0xC3});                               // ret
+    }
+};
+
+bool isArithmetic(OpCode op) {
+    return op == OpCode::OP_ADD || op == OpCode::OP_SUBTRACT ||
+           op == OpCode::OP_MULTIPLY || op == OpCode::OP_DIVIDE;
+}
+
+#endif // SIMLAN_JIT_X86_64
+
+} // namespace
+
+JIT::~JIT() {
+    release();
+}
+
+void JIT::release() {
+#if SIMLAN_JIT_X86_64
+    if (code) {
+        munmap(code, codeSize);
+    }
+#endif
+    code = nullptr;
+    codeSize = 0;
+    variables = 0;
+    counting = false;
+    entryOffsets.clear();
+    storeSlots.clear();
+}
+
+bool JIT::isSupported() {
+    return SIMLAN_JIT_X86_64 != 0;
+}
+
+bool JIT::compile(const Chunk& chunk, bool countOperators) {
+    release();
+#if SIMLAN_JIT_X86_64
+    // rel32 displacements must reach from the last instruction back to the
+    // first constant; give up on anything close to that limit.
+    size_t poolBytes = (chunk.constants.size() * sizeof(double) + 15) & ~static_cast<size_t>(15);
+    // The value stack lives on the machine stack of whichever thread runs a
+    // statement, so a very deep expression is left to the interpreters.
+    if (poolBytes + chunk.code.size() * 16 > 0x7FFFFFFFu || chunk.variableCount > 0x7FFFFFFFu / 8 ||
+        chunk.maxStackDepth > MAX_STACK_DEPTH) {
+        return false;
+    }
+    variables = chunk.variableCount;
+    counting = countOperators;
+
+    Emitter out;
+    out.codeBase = poolBytes;
+    out.counting = countOperators;
+    std::vector<size_t> errorJumps; // Jumps to the error exit of the current statement
+    size_t depth = 0;               // Value stack depth, xmm0 included
+    bool inStatement = false;
+
+    const uint8_t* ip = chunk.code.data();
+    const uint8_t* end = ip + chunk.code.size();
+    while (ip < end) {
+        OpCode op = static_cast<OpCode>(*ip++);
+
+        if (!inStatement && op != OpCode::OP_HALT) {
+            entryOffsets.push_back(poolBytes + out.bytes.size());
+            out.prologue();
+            inStatement = true;
+        }
+
+        switch (op) {
+            case OpCode::OP_CONSTANT: {
+                uint32_t index;
+                std::memcpy(&index, ip, sizeof(index));
+                ip += sizeof(index);
+
+                // A constant that is immediately consumed by an operator becomes
+                // that instruction's memory operand. Its value is known here,
+                // so a division by it needs no runtime check: it either always
+                // or never fails.
+                if (ip < end && depth > 0 && isArithmetic(static_cast<OpCode>(*ip))) {
+                    OpCode next = static_cast<OpCode>(*ip++);
+                    out.countOperator(next);
+                    if (next == OpCode::OP_DIVIDE && chunk.constants[index] == 0) {
+                        errorJumps.push_back(out.jump());
+                    } else {
+                        out.arithmeticConstant(next, index);
+                    }
+                    break;
+                }
+
+                if (depth > 0) {
+                    out.spill();
+                }
+                out.loadConstant(index);
+                depth++;
+                break;
+            }
+            case OpCode::OP_LOAD: {
+                uint32_t slot;
+                std::memcpy(&slot, ip, sizeof(slot));
+                ip += sizeof(slot);
+
+                // Fused like a constant, except that a divisor is not known
+                // until run time and has to be checked
+                if (ip < end && depth > 0 && isArithmetic(static_cast<OpCode>(*ip))) {
+                    OpCode next = static_cast<OpCode>(*ip++);
+                    out.countOperator(next);
+                    if (next == OpCode::OP_DIVIDE) {
+                        out.loadVariableRight(slot);
+                        errorJumps.push_back(out.checkDivisor());
+                        out.arithmetic(next);
+                    } else {
+                        out.arithmeticVariable(next, slot);
+                    }
+                    break;
+                }
+
+                if (depth > 0) {
+                    out.spill();
+                }
+                out.loadVariable(slot);
+                depth++;
+                break;
+            }
+            case OpCode::OP_ADD:
+            case OpCode::OP_SUBTRACT:
+            case OpCode::OP_MULTIPLY:
+            case OpCode::OP_DIVIDE:
+                out.unspill();
+                out.countOperator(op);
+                if (op == OpCode::OP_DIVIDE) {
+                    errorJumps.push_back(out.checkDivisor());
+                }
+                out.arithmetic(op);
+                depth--;
+                break;
+            case OpCode::OP_PRINT:
+            case OpCode::OP_STORE: {
+                uint32_t slot = NO_STORE;
+                if (op == OpCode::OP_STORE) {
+                    std::memcpy(&slot, ip, sizeof(slot));
+                    ip += sizeof(slot);
+                }
+                storeSlots.push_back(slot);
+                out.returnValue();
+                if (!errorJumps.empty()) {
+                    size_t errorExit = out.bytes.size();
+                    out.returnError();
+                    for (size_t jump : errorJumps) {
+                        out.patchJump(jump, errorExit);
+                    }
+                    errorJumps.clear();
+                }
+                depth = 0;
+                inStatement = false;
+                break;
+            }
+            case OpCode::OP_HALT:
+                ip = end;
+                break;
+            default:
+                throw std::runtime_error("JIT Error: Invalid opcode");
+        }
+    }
+
+    if (out.bytes.empty()) {
+        return true; // Nothing to run
+    }
+
+    // Write pool and code into a private mapping, then flip it to read+execute
+    size_t size = poolBytes + out.bytes.size();
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        release();
+        return false;
+    }
+    if (!chunk.constants.empty()) {
+        std::memcpy(mem, chunk.constants.data(), chunk.constants.size() * sizeof(double));
+    }
+    std::memcpy(static_cast<uint8_t*>(mem) + poolBytes, out.bytes.data(), out.bytes.size());
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        release();
+        return false;
+    }
+    code = mem;
+    codeSize = size;
+    return true;
+#else
+    (void)chunk;
+    return false;
+#endif
+}
+
+bool JIT::evaluate(size_t statement, double& result, const double* variables, OperatorCounts* counts) const {
+    auto fn = reinterpret_cast<StatementFn>(static_cast<uint8_t*>(code) + entryOffsets[statement]);
+    OperatorCounts unused;
+    if (counting && !counts) {
+        counts = &unused;
+    }
+    return fn(&result, variables, counts ? counts->data() : nullptr) == 0;
+}
+
+void JIT::run(OutputSink& out, OperatorCounts* counts) const {
+    std::vector<double> values(variables);
+    for (size_t i = 0; i < entryOffsets.size(); ++i) {
+        double result;
+        if (!evaluate(i, result, values.data(), counts)) {
+            throw std::runtime_error("Runtime Error: Division by zero");
+        }
+        if (isStore(i)) {
+            values[storeSlots[i]] = result;
+        } else {
+            out.printNumber(result);
+        }
+    }
+}
+
+void JIT::run(OutputSink& out, ThreadPool& pool, OperatorCounts* counts) const {
+    std::vector<double> values(variables);
+    auto evaluateOrThrow = [this, &values](size_t i, double& result, OperatorCounts* statementCounts) {
+        if (!evaluate(i, result, values.data(), statementCounts)) {
+            throw std::runtime_error("Runtime Error: Division by zero");
+        }
+    };
+    runStatementsParallel(entryOffsets.size(), [this](size_t i) {
+        return isStore(i);
+    }, [this, &values, &evaluateOrThrow, counts](size_t i) {
+        evaluateOrThrow(i, values[storeSlots[i]], counts);
+    }, evaluateOrThrow, out, pool, counts);
+}
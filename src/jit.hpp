@@ -0,0 +1,85 @@
+#pragma once
+
+#include "bytecode.hpp"
+#include "operator_counts.hpp"
+#include "output.hpp"
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+//------------------------------------------------------------------------------
+// JIT: translates a compiled Chunk into native x86-64 SSE2 code
+//------------------------------------------------------------------------------
+// Each PRINT or LET statement becomes one native function that computes the
+// value of its expression; variables are read from an array of doubles, one
+// per slot, that the caller passes in. The functions live in a single mmap'd
+// buffer that is made executable (and no longer writable) once code
+// generation is finished.
+//
+// Only x86-64 hosts with mmap are supported; isSupported() reports whether this
+// build can generate code at all, and compile() returns false if the code
+// buffer cannot be mapped or an expression needs a deeper value stack than
+// MAX_STACK_DEPTH, so callers can fall back to the interpreter.
+class JIT {
+public:
+    JIT() = default;
+    ~JIT();
+
+    JIT(const JIT&) = delete;
+    JIT& operator=(const JIT&) = delete;
+
+    static bool isSupported();
+
+    // Deepest value stack compile() accepts; the generated code keeps it on
+    // the machine stack of whichever thread runs it (128 KB at this depth).
+    // Pool, server and runner threads may have only 512 KB of stack (the
+    // default for secondary threads on macOS), so this leaves them most of
+    // it; deeper programs run on the AST interpreter.
+    static constexpr size_t MAX_STACK_DEPTH = 16384;
+
+    // Generates native code for every statement of the chunk. With
+    // countOperators, every operator also adds one to the counts passed to
+    // evaluate() or run(); without it, the code has nothing extra.
+    bool compile(const Chunk& chunk, bool countOperators = false);
+
+    // Number of compiled statements
+    size_t statementCount() const { return entryOffsets.size(); }
+
+    // Computes the value of one statement. Returns false on division by zero.
+    // variables must hold variableCount() values; it may be null if that is 0.
+    // counts is only updated by code compiled with countOperators.
+    bool evaluate(size_t statement, double& result, const double* variables = nullptr,
+                  OperatorCounts* counts = nullptr) const;
+
+    // Number of variable slots the statements read and write
+    size_t variableCount() const { return variables; }
+
+    // True if the statement is a LET, whose value goes to storeSlot(statement)
+    // rather than to the output
+    bool isStore(size_t statement) const { return storeSlots[statement] != NO_STORE; }
+    uint32_t storeSlot(size_t statement) const { return storeSlots[statement]; }
+
+    // Runs all statements in order, printing like ProgramNode::execute()
+    void run(OutputSink& out, OperatorCounts* counts = nullptr) const;
+
+    // Same, with the statements evaluated on the pool; output stays in order
+    void run(OutputSink& out, ThreadPool& pool, OperatorCounts* counts = nullptr) const;
+
+private:
+    // Signature of a generated function: stores the value in *result and
+    // returns 0, or returns 1 on division by zero. counts is indexed like
+    // OperatorCounts and only touched by code compiled with countOperators.
+    using StatementFn = int (*)(double* result, const double* variables, uint64_t* counts);
+
+    static constexpr uint32_t NO_STORE = 0xFFFFFFFFu;
+
+    void* code = nullptr;
+    size_t codeSize = 0;
+    size_t variables = 0;
+    bool counting = false;            // Compiled with countOperators
+    std::vector<size_t> entryOffsets; // Start of each statement's function in code
+    std::vector<uint32_t> storeSlots; // Per statement: slot a LET assigns, or NO_STORE
+
+    void release();
+};
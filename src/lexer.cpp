@@ -1,12 +1,25 @@
 #include "lexer.hpp"
-#include <cctype>   // For isdigit, isalpha, isspace
+#include "scan.hpp"
+#include "source.hpp"
+#include <cctype>   // For isalpha, isalnum
+#include <charconv> // For std::from_chars
+#include <cmath>    // For std::fpclassify
 #include <iostream> // For error reporting (temporary)
-#include <unordered_map>
+
+namespace {
+
+inline bool isDigit(char c) {
+    return static_cast<unsigned char>(c - '0') <= 9;
+}
+
+} // namespace
 
 // Helper to convert TokenType to string
-std::string Token::typeToString() const {
+const char* Token::typeToString() const {
     switch (type) {
         case TokenType::TOKEN_PRINT:     return "PRINT";
+        case TokenType::TOKEN_LET:       return "LET";
+        case TokenType::TOKEN_INPUT:     return "INPUT";
         case TokenType::TOKEN_NUMBER:    return "NUMBER";
         case TokenType::TOKEN_PLUS:      return "PLUS";
         case TokenType::TOKEN_MINUS:     return "MINUS";
@@ -14,6 +27,7 @@ std::string Token::typeToString() const {
         case TokenType::TOKEN_SLASH:     return "SLASH";
         case TokenType::TOKEN_LPAREN:    return "LPAREN";
         case TokenType::TOKEN_RPAREN:    return "RPAREN";
+        case TokenType::TOKEN_EQUAL:     return "EQUAL";
         case TokenType::TOKEN_SEMICOLON: return "SEMICOLON";
         case TokenType::TOKEN_EOF:       return "EOF";
         case TokenType::TOKEN_ERROR:     return "ERROR";
@@ -23,66 +37,132 @@ std::string Token::typeToString() const {
 }
 
 
-Lexer::Lexer(const std::string& source)
-    : source_code(source), current_pos(0), current_line(1), current_column_start_of_line(0) {}
+Lexer::Lexer(std::string_view source)
+    : window(source), window_start(0), input(nullptr), chunk_size(0), input_exhausted(true),
+      current_pos(0), token_start(0), current_line(1), current_column_start_of_line(0) {}
+
+void Lexer::reset(std::string_view source) {
+    window = source;
+    window_start = 0;
+    input = nullptr;
+    stream_buffer.clear();
+    chunk_size = 0;
+    input_exhausted = true;
+    current_pos = 0;
+    token_start = 0;
+    current_line = 1;
+    current_column_start_of_line = 0;
+    error_message.clear();
+}
+
+Lexer::Lexer(std::string_view source, size_t begin, size_t end, int line, size_t line_start)
+    : window(source.substr(0, end)), window_start(0), input(nullptr), chunk_size(0), input_exhausted(true),
+      current_pos(begin), token_start(begin), current_line(line), current_column_start_of_line(line_start) {}
+
+Lexer::Lexer(InputStream& in, size_t chunk)
+    : window(), window_start(0), input(&in), chunk_size(chunk > 0 ? chunk : 1), input_exhausted(false),
+      current_pos(0), token_start(0), current_line(1), current_column_start_of_line(0) {}
+
+// Slow path of peek()/peekNext(): pulls more of the stream into the window.
+// Everything before token_start has been consumed and is dropped first, so
+// the window only grows beyond two chunks for a single huge token.
+bool Lexer::fill(size_t pos) {
+    while (pos >= window_start + window.size()) {
+        if (input_exhausted) {
+            return false;
+        }
 
-char Lexer::peek() const {
+        size_t keep_from = token_start - window_start;
+        size_t kept = window.size() - keep_from;
+        if (keep_from > 0) {
+            stream_buffer.erase(0, keep_from);
+            window_start += keep_from;
+        }
+        stream_buffer.resize(kept + chunk_size);
+        size_t n = input->read(&stream_buffer[kept], chunk_size);
+        stream_buffer.resize(kept + n);
+        window = stream_buffer;
+        if (n == 0) {
+            input_exhausted = true;
+        }
+    }
+    return true;
+}
+
+char Lexer::peek() {
     if (isAtEnd()) return '\0';
-    return source_code[current_pos];
+    return window[current_pos - window_start];
+}
+
+char Lexer::peekNext() {
+    if (current_pos + 1 >= window_start + window.size() && !fill(current_pos + 1)) return '\0';
+    return window[current_pos + 1 - window_start];
 }
 
 char Lexer::advance() {
     if (isAtEnd()) return '\0';
-    char currentChar = source_code[current_pos];
+    char currentChar = window[current_pos - window_start];
     current_pos++;
     return currentChar;
 }
 
-bool Lexer::isAtEnd() const {
-    return current_pos >= source_code.length();
+bool Lexer::isAtEnd() {
+    return current_pos >= window_start + window.size() && !fill(current_pos);
 }
 
-Token Lexer::makeToken(TokenType type, const std::string& lexeme_val) const {
-    // Calculate column based on current_pos and current_column_start_of_line
-    // This is a simplified column calculation, assumes lexeme is part of the current advance()
-    // For multi-char tokens, the start_pos of the token should be used.
-    int col = (current_pos - current_column_start_of_line) - lexeme_val.length() + 1;
-     if (!lexeme_val.empty() && type != TokenType::TOKEN_EOF) { // EOF has no lexeme
-        col = (current_pos - current_column_start_of_line) - lexeme_val.length() +1;
-    } else if (type == TokenType::TOKEN_EOF) {
-        col = (current_pos - current_column_start_of_line) + 1;
-    } else { // For single char tokens where lexeme is not explicitly passed
-        col = (current_pos - current_column_start_of_line);
+std::string_view Lexer::lexeme(const Token& token) const {
+    if (token.type == TokenType::TOKEN_ERROR) {
+        return error_message;
     }
-    return Token(type, lexeme_val, 0.0, current_line, col);
+    if (token.offset < window_start || token.offset + token.length > window_start + window.size()) {
+        return std::string_view(); // No longer in memory (streaming only)
+    }
+    return window.substr(token.offset - window_start, token.length);
+}
+
+// Builds a token for the lexeme that starts at start_pos and ends at current_pos
+Token Lexer::makeToken(TokenType type, size_t start_pos) const {
+    int col = static_cast<int>(start_pos - current_column_start_of_line) + 1;
+    return Token(type, start_pos, static_cast<uint32_t>(current_pos - start_pos), current_line, col);
 }
 
 
-Token Lexer::errorToken(const std::string& message) const {
-    // Similar column calculation logic as makeToken
-    int col = (current_pos - current_column_start_of_line) + 1;
-    return Token(TokenType::TOKEN_ERROR, message, 0.0, current_line, col);
+Token Lexer::errorToken(const std::string& message) {
+    // The message is kept in the lexer; lexeme() returns it for TOKEN_ERROR
+    error_message = message;
+    int col = static_cast<int>(current_pos - current_column_start_of_line) + 1;
+    return Token(TokenType::TOKEN_ERROR, current_pos, 0, current_line, col);
 }
 
 
+// Whitespace runs and comment bodies are skipped with the vector kernels in
+// scan.cpp. They only look at the bytes already in the window; when a run
+// reaches its end, isAtEnd() refills it and the loop carries on.
 void Lexer::skipWhitespaceAndComments() {
     while (!isAtEnd()) {
-        char c = peek();
-        if (std::isspace(c)) {
-            if (c == '\n') {
-                current_line++;
-                current_column_start_of_line = current_pos + 1; // Next char is start of new line
-            }
-            advance();
-        } else if (c == '/' && current_pos + 1 < source_code.length() && source_code[current_pos + 1] == '/') {
-            // Single-line comment, skip to end of line
-            while (peek() != '\n' && !isAtEnd()) {
-                advance();
+        token_start = current_pos; // Nothing before here is needed any more
+        const char* p = window.data() + (current_pos - window_start);
+        const char* end = window.data() + window.size();
+
+        scan::WhitespaceRun run = scan::whitespace(p, end);
+        if (run.length > 0) {
+            if (run.newlines > 0) {
+                current_line += static_cast<int>(run.newlines);
+                current_column_start_of_line = current_pos + run.afterNewline; // Next char is start of new line
             }
-            if(peek() == '\n'){ // Consume the newline
-                advance();
-                current_line++;
-                current_column_start_of_line = current_pos;
+            current_pos += run.length;
+            token_start = current_pos;
+        } else if (*p == '/' && peekNext() == '/') {
+            // Single-line comment, skip to end of line. The newline itself is
+            // left for the whitespace scan, which also counts the line.
+            // (peekNext() may have refilled the window, so p is not reused.)
+            while (true) {
+                current_pos += scan::findNewline(window.data() + (current_pos - window_start),
+                                                 window.data() + window.size());
+                token_start = current_pos;
+                if (current_pos < window_start + window.size() || isAtEnd()) {
+                    break;
+                }
             }
         } else {
             break; // Not whitespace or comment
@@ -90,91 +170,105 @@ void Lexer::skipWhitespaceAndComments() {
     }
 }
 
+// Consumes a run of digits, which may straddle window refills
+void Lexer::digits() {
+    while (!isAtEnd()) {
+        const char* p = window.data() + (current_pos - window_start);
+        size_t n = scan::digits(p, window.data() + window.size());
+        current_pos += n;
+        if (current_pos < window_start + window.size()) {
+            break; // Stopped at a non-digit
+        }
+    }
+}
+
 Token Lexer::number() {
     size_t start_pos = current_pos;
-    while (std::isdigit(peek())) {
-        advance();
-    }
+    digits();
 
     // Look for a fractional part
-    if (peek() == '.' && std::isdigit(source_code[current_pos + 1])) {
+    if (peek() == '.' && isDigit(peekNext())) {
         advance(); // Consume the '.'
-        while (std::isdigit(peek())) {
-            advance();
-        }
+        digits();
     }
 
-    std::string lexeme = source_code.substr(start_pos, current_pos - start_pos);
+    // std::from_chars neither allocates nor depends on the locale. Like the
+    // std::stod call it replaces, reject literals that overflow or that only
+    // fit as a subnormal.
+    const char* first = window.data() + (start_pos - window_start);
+    const char* last = window.data() + (current_pos - window_start);
     double value = 0.0;
-    try {
-        value = std::stod(lexeme);
-    } catch (const std::out_of_range& oor) {
-        return errorToken("Numeric literal out of range: " + lexeme);
-    } catch (const std::invalid_argument& ia) {
+    auto [ptr, ec] = std::from_chars(first, last, value);
+    if (ec == std::errc::result_out_of_range || (ec == std::errc() && std::fpclassify(value) == FP_SUBNORMAL)) {
+        return errorToken("Numeric literal out of range: " + std::string(first, last));
+    }
+    if (ec != std::errc() || ptr != last) {
         // This should not happen if isdigit checks are correct
-        return errorToken("Invalid numeric literal: " + lexeme);
+        return errorToken("Invalid numeric literal: " + std::string(first, last));
     }
-    
-    int col = (start_pos - current_column_start_of_line) + 1;
-    return Token(TokenType::TOKEN_NUMBER, lexeme, value, current_line, col);
+
+    Token token = makeToken(TokenType::TOKEN_NUMBER, start_pos);
+    token.value = value;
+    return token;
 }
 
 Token Lexer::identifierOrKeyword() {
     size_t start_pos = current_pos;
-    while (std::isalnum(peek()) || peek() == '_') { // Allow underscores in identifiers
+    while (std::isalnum(static_cast<unsigned char>(peek())) || peek() == '_') { // Allow underscores in identifiers
         advance();
     }
-    std::string lexeme = source_code.substr(start_pos, current_pos - start_pos);
-    int col = (start_pos - current_column_start_of_line) + 1;
+    std::string_view lexeme = window.substr(start_pos - window_start, current_pos - start_pos);
 
-    static const std::unordered_map<std::string, TokenType> keywords = {
-        {"PRINT", TokenType::TOKEN_PRINT}
+    struct Keyword {
+        std::string_view text;
+        TokenType type;
+    };
+    static constexpr Keyword keywords[] = {
+        {"PRINT", TokenType::TOKEN_PRINT},
+        {"LET", TokenType::TOKEN_LET},
+        {"INPUT", TokenType::TOKEN_INPUT}
     };
 
-    auto it = keywords.find(lexeme);
-    if (it != keywords.end()) {
-        return Token(it->second, lexeme, 0.0, current_line, col);
+    for (const Keyword& keyword : keywords) {
+        if (lexeme == keyword.text) {
+            return makeToken(keyword.type, start_pos);
+        }
     }
-
-    // For now, we only have PRINT. If it's not PRINT, it's an error for v0.1
-    // In the future, this would be TokenType::TOKEN_IDENTIFIER
-    // return Token(TokenType::TOKEN_IDENTIFIER, lexeme, 0.0, current_line, col);
-    return errorToken("Unexpected identifier or keyword: " + lexeme);
+    return makeToken(TokenType::TOKEN_IDENTIFIER, start_pos);
 }
 
 
 Token Lexer::getNextToken() {
     skipWhitespaceAndComments();
 
-    if (isAtEnd()) return makeToken(TokenType::TOKEN_EOF);
+    token_start = current_pos;
+    if (isAtEnd()) return makeToken(TokenType::TOKEN_EOF, current_pos);
 
+    size_t start_pos = current_pos;
     char c = advance(); // Consume the character
 
-    // For single-character tokens, their lexeme is just the character itself.
-    // The column is calculated based on the position *before* advancing for this char.
-    int col = (current_pos - 1 - current_column_start_of_line) + 1;
-
-
-    if (std::isalpha(c) || c == '_') { // Start of an identifier or keyword
+    if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') { // Start of an identifier or keyword
         // Put the character back to be consumed by identifierOrKeyword
         current_pos--; 
         return identifierOrKeyword();
     }
 
-    if (std::isdigit(c)) {
+    if (isDigit(c)) {
         // Put the character back to be consumed by number()
         current_pos--;
         return number();
     }
 
+    // For single-character tokens, the lexeme is just the character itself.
     switch (c) {
-        case '(': return Token(TokenType::TOKEN_LPAREN, "(", 0.0, current_line, col);
-        case ')': return Token(TokenType::TOKEN_RPAREN, ")", 0.0, current_line, col);
-        case ';': return Token(TokenType::TOKEN_SEMICOLON, ";", 0.0, current_line, col);
-        case '+': return Token(TokenType::TOKEN_PLUS, "+", 0.0, current_line, col);
-        case '-': return Token(TokenType::TOKEN_MINUS, "-", 0.0, current_line, col);
-        case '*': return Token(TokenType::TOKEN_STAR, "*", 0.0, current_line, col);
-        case '/': return Token(TokenType::TOKEN_SLASH, "/", 0.0, current_line, col);
+        case '(': return makeToken(TokenType::TOKEN_LPAREN, start_pos);
+        case ')': return makeToken(TokenType::TOKEN_RPAREN, start_pos);
+        case ';': return makeToken(TokenType::TOKEN_SEMICOLON, start_pos);
+        case '+': return makeToken(TokenType::TOKEN_PLUS, start_pos);
+        case '-': return makeToken(TokenType::TOKEN_MINUS, start_pos);
+        case '*': return makeToken(TokenType::TOKEN_STAR, start_pos);
+        case '/': return makeToken(TokenType::TOKEN_SLASH, start_pos);
+        case '=': return makeToken(TokenType::TOKEN_EQUAL, start_pos);
         // Add other single-character tokens here
         default:
             return errorToken(std::string("Unexpected character: ") + c);
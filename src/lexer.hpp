@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 //------------------------------------------------------------------------------
@@ -9,6 +13,8 @@
 enum class TokenType {
     // Keywords
     TOKEN_PRINT,        // "PRINT"
+    TOKEN_LET,          // "LET"
+    TOKEN_INPUT,        // "INPUT"
 
     // Literals
     TOKEN_NUMBER,       // 123, 42.0
@@ -20,6 +26,7 @@ enum class TokenType {
     TOKEN_SLASH,        // /
     TOKEN_LPAREN,       // (
     TOKEN_RPAREN,       // )
+    TOKEN_EQUAL,        // =
 
     // Punctuation
     TOKEN_SEMICOLON,    // ;
@@ -27,51 +34,99 @@ enum class TokenType {
     // Special Tokens
     TOKEN_EOF,          // End of File
     TOKEN_ERROR,        // Lexical error / unrecognized token
-    TOKEN_IDENTIFIER    // For future use (variables, functions) - not used in v0.1
+    TOKEN_IDENTIFIER    // Variable name: a letter or '_', then letters, digits and '_'
 };
 
+// Number of token types, e.g. for per-type counters (TOKEN_IDENTIFIER stays last)
+constexpr size_t TOKEN_TYPE_COUNT = static_cast<size_t>(TokenType::TOKEN_IDENTIFIER) + 1;
+
 //------------------------------------------------------------------------------
 // Token Structure
 //------------------------------------------------------------------------------
+// A token does not own its text: it records where the lexeme sits in the
+// source buffer, and Lexer::lexeme() hands it out as a std::string_view.
+// Tokens are therefore cheap to copy and lexing allocates nothing per token.
 struct Token {
     TokenType type;
-    std::string lexeme; // The actual string sequence for the token (e.g. "123")
-    double value;       // Numeric value if TOKEN_NUMBER (e.g. 123)
+    uint32_t length;    // Length of the lexeme in bytes
+    size_t offset;      // Byte offset of the lexeme in the source
     int line;           // Line number where the token starts
     int column;         // Column number where the token starts
+    double value;       // Numeric value if TOKEN_NUMBER (e.g. 123)
 
-    Token(TokenType t, std::string lex = "", double val = 0.0, int l = 0, int col = 0)
-        : type(t), lexeme(std::move(lex)), value(val), line(l), column(col) {}
+    Token() : Token(TokenType::TOKEN_EOF, 0, 0, 0, 0) {}
+    Token(TokenType t, size_t off, uint32_t len, int l, int col, double val = 0.0)
+        : type(t), length(len), offset(off), line(l), column(col), value(val) {}
 
     // Helper to convert token type to string for debugging
-    std::string typeToString() const;
+    const char* typeToString() const;
 };
 
+static_assert(std::is_trivially_copyable<Token>::value, "Token must stay a plain record");
+
 //------------------------------------------------------------------------------
 // Lexer Class
 //------------------------------------------------------------------------------
+class InputStream;
+
 class Lexer {
 public:
-    // Constructor: takes the source code as a string
-    Lexer(const std::string& source);
+    // Constructor: lexes a caller-owned buffer (e.g. a memory-mapped file),
+    // which must outlive the Lexer. Nothing is copied.
+    Lexer(std::string_view source);
+
+    // Constructor: lexes only source[begin, end) of a caller-owned buffer, as
+    // part of the whole: offsets, lines and columns are those of the full
+    // source. line is the line number at begin and line_start the offset at
+    // which that line starts.
+    Lexer(std::string_view source, size_t begin, size_t end, int line, size_t line_start);
+
+    // Constructor: lexes a stream (pipe, stdin) chunk by chunk. Only a small
+    // refillable window of the input is held in memory at any time.
+    Lexer(InputStream& input, size_t chunk_size = 64 * 1024);
+
+    // Starts over on another caller-owned buffer, as if constructed with it
+    // (for callers that lex many sources, e.g. simlan::CompileContext)
+    void reset(std::string_view source);
 
     // Returns the next token from the source code
     Token getNextToken();
 
+    // The text of a token: a view into the source, or for TOKEN_ERROR the
+    // error message. Valid while the Lexer is alive (error messages only
+    // until the next error). When lexing a stream, only the text of the most
+    // recently returned token is guaranteed to still be in memory.
+    std::string_view lexeme(const Token& token) const;
+
 private:
-    std::string source_code;
-    size_t current_pos; // Current position in the source_code string
+    // The part of the input currently in memory. All positions below are
+    // absolute byte offsets into the whole input; window[0] is at window_start.
+    std::string_view window;
+    size_t window_start;
+
+    // Streaming mode only
+    InputStream* input;
+    std::string stream_buffer; // Backing storage for window
+    size_t chunk_size;
+    bool input_exhausted;
+
+    size_t current_pos; // Current position in the input
+    size_t token_start; // Start of the token being lexed; the window keeps it
     int current_line;
-    int current_column_start_of_line; // Position of the start of the current line, for column calculation
+    size_t current_column_start_of_line; // Position of the start of the current line, for column calculation
+    std::string error_message; // Text of the last TOKEN_ERROR
 
     // Helper methods
-    char peek() const;        // Look at the current character without consuming
+    char peek();              // Look at the current character without consuming
+    char peekNext();          // Look one character past the current one
     char advance();           // Consume the current character and advance
-    bool isAtEnd() const;
+    bool isAtEnd();
+    bool fill(size_t pos);    // Makes pos available in the window if the input has it
     void skipWhitespaceAndComments(); // Skips spaces, tabs, newlines, and comments
+    void digits();            // Skips a run of digits
 
-    Token makeToken(TokenType type, const std::string& lexeme = "") const;
-    Token errorToken(const std::string& message) const;
+    Token makeToken(TokenType type, size_t start_pos) const;
+    Token errorToken(const std::string& message);
     Token number();
-    Token identifierOrKeyword(); // For PRINT and future identifiers
+    Token identifierOrKeyword(); // For PRINT, LET and variable names
 };
@@ -1,97 +1,674 @@
-#include <iostream>
 #include <fstream>
-#include <sstream>
+#include <iostream>
 #include <string>
 #include <memory> // For std::unique_ptr
 #include <stdexcept> // For std::runtime_error
+#include <algorithm> // For std::find
+#include <vector>
 
 #include "lexer.hpp"
 #include "parser.hpp"
 #include "ast.hpp"
+#include "batch.hpp"
+#include "c_emitter.hpp"
+#include "jit.hpp"
+#include "optimizer.hpp"
+#include "cse.hpp"
+#include "serve.hpp"
+#include "output.hpp"
+#include "source.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+#include "run_files.hpp"
+#include "streaming.hpp"
+#include "simlan.hpp"
 
-// Function to read the entire content of a file into a string
-std::string readFile(const std::string& filepath) {
-    std::ifstream file_stream(filepath);
-    if (!file_stream.is_open()) {
-        std::cerr << "Error: Could not open file: " << filepath << std::endl;
-        return "";
+// Prints one token in the --emit=tokens format
+static void printToken(std::ostream& out, const Token& token, std::string_view text) {
+    out << "Token: " << token.typeToString() << " ('" << text << "')";
+    if (token.type != TokenType::TOKEN_EOF) {
+        out << " Value: " << token.value << " Line: " << token.line << " Col: " << token.column;
     }
-    std::stringstream buffer;
-    buffer << file_stream.rdbuf();
-    return buffer.str();
+    out << '\n';
+}
+
+// Prints the AST followed by optimizer and memory statistics, for the
+// passes that ran (non-null)
+static void printAst(std::ostream& out, const ProgramNode& program, int optimizationLevel, const Optimizer* optimizer,
+                     const CommonSubexpressions* cse) {
+    program.print(out, 0);
+
+    if (optimizer) {
+        out << "Optimizer (-O" << optimizationLevel << "): "
+            << optimizer->foldedCount() << " constant folds, "
+            << optimizer->simplifiedCount() << " identities applied\n";
+    }
+    if (cse) {
+        out << "Common subexpressions: " << cse->uniqueNodes() << " unique of " << cse->totalNodes() << " nodes, "
+            << cse->temporaryCount() << " temporaries, " << cse->savedBytes() << " bytes saved\n";
+    }
+
+    size_t nodes = program.arena.nodeCount();
+    size_t bytes = program.memoryBytes();
+    out << "AST memory: " << nodes << " nodes ("
+        << program.arena.numbers.size() << " numbers, "
+        << program.arena.binaries.size() << " binary ops), "
+        << bytes << " bytes";
+    if (nodes > 0) {
+        out << ", " << static_cast<double>(bytes) / nodes << " bytes/node";
+    }
+    out << '\n';
+}
+
+// Runs program over the rows of the CSV file at inputPath (--batch) and writes
+// the result table to out, or to outputPath if it is not empty. Returns the
+// exit status; failed rows are reported in the table, not in the status.
+static int runBatch(const ProgramNode& program, const std::string& inputPath, const std::string& outputPath,
+                    OutputSink& out, ThreadPool* pool, Stats* stats) {
+    PhaseTimer readTimer(stats, "read input");
+    SourceFile input;
+    std::string error;
+    if (!input.open(inputPath, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    BatchEvaluator evaluator(program);
+    std::vector<std::vector<double>> columns;
+    size_t rows = 0;
+    if (!readInputColumns(input.text(), evaluator.inputNames(), columns, rows, error, pool)) {
+        std::cerr << "Error: " << inputPath << ": " << error << std::endl;
+        return 1;
+    }
+    readTimer.stop();
+
+    std::ofstream file;
+    std::unique_ptr<OutputSink> fileSink;
+    if (!outputPath.empty()) {
+        file.open(outputPath, std::ios::binary | std::ios::trunc);
+        fileSink = std::make_unique<OutputSink>(file, out.numberFormat());
+    }
+    OutputSink& sink = fileSink ? *fileSink : out;
+
+    PhaseTimer executeTimer(stats, "execute");
+    BatchEvaluator::Summary summary = evaluator.run(columns, rows, sink, pool);
+    executeTimer.stop();
+    PhaseTimer flushTimer(stats, "flush");
+    sink.flush();
+    flushTimer.stop();
+
+    if (fileSink && (!file || fileSink->failed())) {
+        std::cerr << "Error: Could not write '" << outputPath << "'" << std::endl;
+        return 1;
+    }
+    if (summary.failedRows > 0) {
+        std::cerr << "Warning: " << summary.failedRows << " of " << summary.rows << " rows failed" << std::endl;
+    }
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: simlanc <filepath>" << std::endl;
+    const char* usage = "Usage: simlanc [--emit=tokens|ast|c|run[,...]] [-o file] [--engine=ast|vm|jit] [-O0|-O1|-O2] [--number-format=shortest|legacy] [--threads=N] [--max-nesting=N] [--cache | --cache-dir=DIR] [--batch=input.csv] [--stream] [--stats] [--trace=file.json] <filepath... | - | --manifest=FILE | --serve[=socket]>";
+
+    // Nothing here reads from stdio, so let iostreams buffer on their own.
+    // std::cerr is tied to std::cout, so the dumps still precede error messages;
+    // program output goes through an OutputSink, which is flushed explicitly.
+    std::ios::sync_with_stdio(false);
+
+    // "ast" walks the tree through ProgramNode::evaluate (the reference engine),
+    // "vm" compiles the tree to bytecode first and runs it on the VM, and
+    // "jit" turns that bytecode into native code (x86-64 hosts only).
+    std::string engine = "ast";
+    int optimizationLevel = 0; // -O1 runs the Optimizer (constant folding) after parsing,
+                               // -O2 also shares common subexpressions
+
+    // PRINT writes the shortest round-trip form of each value by default;
+    // "legacy" keeps the old iostream format (6 significant digits).
+    NumberFormat numberFormat = NumberFormat::Shortest;
+
+    // --threads=N lexes and parses a mapped file in chunks, and evaluates
+    // statements (ast and jit engines), on N threads. Output and errors are
+    // the same as with one thread.
+    size_t threads = 1;
+
+    // --max-nesting=N: parentheses nested deeper than N are a parse error
+    size_t maxNesting = simlan::DEFAULT_MAX_NESTING;
+
+    // --cache keeps the compiled program in a .simc file next to the source
+    // (--cache-dir=DIR: in DIR) and reuses it while the source is unchanged.
+    bool cacheEnabled = false;
+    std::string cacheDir;
+
+    // --stats prints phase timings and counters to stderr at the end;
+    // --trace=file.json writes the same as Chrome trace events.
+    bool showStats = false;
+    std::string tracePath;
+
+    // Stages to emit. The default only runs the program; --emit=tokens and
+    // --emit=ast are debug dumps. Several can be combined with commas, e.g.
+    // --emit=tokens,ast,run for the full compiler trace. --emit=c translates
+    // the program to C instead of running it; -o writes that to a file.
+    bool emitTokens = false;
+    bool emitAst = false;
+    bool emitC = false;
+    bool emitRun = true;
+    std::string outputPath;
+
+    // --serve runs programs sent on stdin (or, with --serve=SOCKET, by
+    // clients of a Unix domain socket) instead of a file; see serve.hpp
+    bool serveMode = false;
+    std::string socketPath;
+
+    // --batch=input.csv runs the program once per row of the CSV file, the
+    // INPUT variables taken from its columns, and prints a CSV table of the
+    // PRINTed values (to the -o file, if given); see batch.hpp
+    std::string batchPath;
+
+    // Several files, or --manifest=FILE (a list of files, "-" for stdin), are
+    // each run as simlanc would run them alone, on --threads=N threads; see
+    // run_files.hpp
+    std::vector<std::string> extraPaths;
+    std::string manifestPath;
+
+    // --stream runs each statement as soon as it is parsed and then drops
+    // it, so memory does not grow with the program; see streaming.hpp
+    bool streamMode = false;
+
+    std::string filepath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--engine=", 0) == 0) {
+            engine = arg.substr(9);
+            if (engine != "ast" && engine != "vm" && engine != "jit") {
+                std::cerr << "Error: Unknown engine '" << engine << "'" << std::endl;
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--emit=", 0) == 0) {
+            emitTokens = emitAst = emitC = emitRun = false;
+            std::string stages = arg.substr(7);
+            size_t start = 0;
+            while (start <= stages.size()) {
+                size_t comma = stages.find(',', start);
+                std::string stage = stages.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+                if (stage == "tokens") {
+                    emitTokens = true;
+                } else if (stage == "ast") {
+                    emitAst = true;
+                } else if (stage == "c") {
+                    emitC = true;
+                } else if (stage == "run") {
+                    emitRun = true;
+                } else {
+                    std::cerr << "Error: Unknown stage '" << stage << "'" << std::endl;
+                    std::cerr << usage << std::endl;
+                    return 1;
+                }
+                if (comma == std::string::npos) break;
+                start = comma + 1;
+            }
+        } else if (arg.rfind("--number-format=", 0) == 0) {
+            std::string format = arg.substr(16);
+            if (format == "shortest") {
+                numberFormat = NumberFormat::Shortest;
+            } else if (format == "legacy") {
+                numberFormat = NumberFormat::Legacy;
+            } else {
+                std::cerr << "Error: Unknown number format '" << format << "'" << std::endl;
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            std::string count = arg.substr(10);
+            size_t parsed = 0;
+            try {
+                threads = std::stoul(count, &parsed);
+            } catch (const std::exception&) {
+                parsed = 0;
+            }
+            if (parsed == 0 || parsed != count.size() || threads == 0) {
+                std::cerr << "Error: Invalid thread count '" << count << "'" << std::endl;
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--max-nesting=", 0) == 0) {
+            std::string depth = arg.substr(14);
+            size_t parsed = 0;
+            try {
+                maxNesting = std::stoul(depth, &parsed);
+            } catch (const std::exception&) {
+                parsed = 0;
+            }
+            if (parsed == 0 || parsed != depth.size()) {
+                std::cerr << "Error: Invalid nesting limit '" << depth << "'" << std::endl;
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+        } else if (arg == "--cache") {
+            cacheEnabled = true;
+        } else if (arg.rfind("--cache-dir=", 0) == 0) {
+            cacheDir = arg.substr(12);
+            cacheEnabled = true;
+            if (cacheDir.empty()) {
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+        } else if (arg == "--stats") {
+            showStats = true;
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            tracePath = arg.substr(8);
+            if (tracePath.empty()) {
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+        } else if (arg == "-o" || arg.rfind("--output=", 0) == 0) {
+            if (arg == "-o") {
+                if (i + 1 >= argc) {
+                    std::cerr << usage << std::endl;
+                    return 1;
+                }
+                outputPath = argv[++i];
+            } else {
+                outputPath = arg.substr(9);
+            }
+            if (outputPath.empty()) {
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+        } else if (arg == "--serve" || arg.rfind("--serve=", 0) == 0) {
+            serveMode = true;
+            if (arg != "--serve") {
+                socketPath = arg.substr(8);
+                if (socketPath.empty()) {
+                    std::cerr << usage << std::endl;
+                    return 1;
+                }
+            }
+        } else if (arg.rfind("--batch=", 0) == 0) {
+            batchPath = arg.substr(8);
+            if (batchPath.empty()) {
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+        } else if (arg == "--stream") {
+            streamMode = true;
+        } else if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+            optimizationLevel = arg[2] - '0';
+        } else if (arg.rfind("--manifest=", 0) == 0) {
+            manifestPath = arg.substr(11);
+            if (manifestPath.empty()) {
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+        } else if (filepath.empty()) {
+            filepath = arg;
+        } else {
+            extraPaths.push_back(arg);
+        }
+    }
+    if (serveMode) {
+        // Programs are only run; dumps, caching and stats are per file
+        if (!filepath.empty() || !extraPaths.empty() || !manifestPath.empty() || emitTokens || emitAst || emitC || !emitRun || cacheEnabled || showStats ||
+            !tracePath.empty() || !batchPath.empty() || streamMode) {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+        ServeOptions serveOptions;
+        simlan::engineFromName(engine, serveOptions.engine);
+        serveOptions.optimizationLevel = optimizationLevel;
+        serveOptions.numberFormat = numberFormat;
+        serveOptions.workers = threads;
+        serveOptions.maxNesting = maxNesting;
+        if (engine == "jit" && !JIT::isSupported()) {
+            std::cerr << "Warning: JIT is not available on this host, using the AST interpreter" << std::endl;
+        }
+        std::string serve_error;
+        if (!serve(socketPath, serveOptions, serve_error)) {
+            std::cerr << "Error: " << serve_error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (!extraPaths.empty() || !manifestPath.empty()) {
+        std::vector<std::string> paths;
+        if (!filepath.empty()) {
+            paths.push_back(filepath);
+        }
+        paths.insert(paths.end(), extraPaths.begin(), extraPaths.end());
+        std::string manifest_error;
+        if (!manifestPath.empty() && !readManifest(manifestPath, paths, manifest_error)) {
+            std::cerr << "Error: " << manifest_error << std::endl;
+            return 1;
+        }
+        // Same restrictions as --serve; stdin cannot be one of several programs
+        bool readsStdin = std::find(paths.begin(), paths.end(), "-") != paths.end();
+        if (emitTokens || emitAst || emitC || !emitRun || !outputPath.empty() || cacheEnabled || showStats ||
+            !tracePath.empty() || !batchPath.empty() || streamMode || readsStdin) {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+        RunOptions runOptions;
+        simlan::engineFromName(engine, runOptions.engine);
+        runOptions.optimizationLevel = optimizationLevel;
+        runOptions.numberFormat = numberFormat;
+        runOptions.maxNesting = maxNesting;
+        if (engine == "jit" && !JIT::isSupported()) {
+            std::cerr << "Warning: JIT is not available on this host, using the AST interpreter" << std::endl;
+        }
+        std::unique_ptr<ThreadPool> pool;
+        if (threads > 1) {
+            pool = std::make_unique<ThreadPool>(threads);
+        }
+        OutputSink output(1, numberFormat);
+        size_t failed = runFiles(paths, runOptions, output, std::cerr, pool.get());
+        if (output.failed()) {
+            std::cerr << "Error: Could not write program output" << std::endl;
+            return 1;
+        }
+        if (failed > 0) {
+            std::cerr << "Error: " << failed << " of " << paths.size() << " files failed" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // -o is where the C source goes, or the --batch table; not both
+    bool batchMode = !batchPath.empty();
+    if (filepath.empty() || (!outputPath.empty() && !emitC && !batchMode) || (emitC && batchMode)) {
+        std::cerr << usage << std::endl;
         return 1;
     }
+    if (streamMode) {
+        // Only runs, and only on the AST interpreter: no statement outlives
+        // its turn, so there is nothing to dump, cache, compile or time
+        if (emitTokens || emitAst || emitC || !emitRun || cacheEnabled || showStats || !tracePath.empty() || batchMode) {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+        if (engine != "ast" || optimizationLevel > 0 || threads > 1) {
+            std::cerr << "Warning: --stream runs each statement on the AST interpreter as it is parsed; "
+                         "--engine, -O and --threads are ignored" << std::endl;
+        }
+    }
+
+    // Instrumentation is off unless asked for: stats stays null
+    std::unique_ptr<Stats> stats_holder;
+    Stats* stats = nullptr;
+    if (showStats || !tracePath.empty()) {
+        stats_holder = std::make_unique<Stats>();
+        stats = stats_holder.get();
+        enableAllocationCounting();
+    }
 
-    std::string filepath = argv[1];
-    std::cout << "Compiling Simlan file: " << filepath << std::endl;
+    // With any debug dump the output is laid out in titled sections;
+    // a plain run prints nothing but the program's own output.
+    // --emit=c alone prints nothing but the C source.
+    bool sections = emitTokens || emitAst || (emitC && emitRun && outputPath.empty());
+    if (sections) {
+        std::cout << "Compiling Simlan file: " << filepath << '\n';
+    }
 
-    std::string source_code = readFile(filepath);
-    if (source_code.empty()) {
-        return 1; // Error message already printed by readFile
+    // Regular files are memory-mapped and lexed in place. Pipes and stdin
+    // ("-") are lexed from a refillable window instead.
+    SourceFile source_file;
+    std::unique_ptr<InputStream> input_stream;
+    std::string open_error;
+    PhaseTimer readTimer(stats, "read");
+    if (isStreamPath(filepath)) {
+        input_stream = openInputStream(filepath, open_error);
+        if (!input_stream) {
+            std::cerr << "Error: " << open_error << std::endl;
+            return 1;
+        }
+    } else {
+        if (!source_file.open(filepath, open_error)) {
+            std::cerr << "Error: " << open_error << std::endl;
+            return 1;
+        }
+        if (source_file.text().empty()) {
+            return 1; // Nothing to compile
+        }
     }
+    readTimer.stop();
 
-    // 1. Lexing
-    Lexer lexer(source_code);
-    std::cout << "\n--- Tokens ---" << std::endl;
+    // Program output: buffered, and written to stdout (fd 1) with write(2)
+    OutputSink output(1, numberFormat);
 
-    Token token = lexer.getNextToken();
-    while(token.type != TokenType::TOKEN_EOF && token.type != TokenType::TOKEN_ERROR){
-        std::cout << "Token: " << token.typeToString() << " ('" << token.lexeme << "') Value: " << token.value
-                  << " Line: " << token.line << " Col: " << token.column << std::endl;
-        token = lexer.getNextToken();
+    // A streamed program's output goes out whenever simlanc waits for more of it
+    std::unique_ptr<FlushingInputStream> flushing_stream;
+    if (streamMode && input_stream) {
+        flushing_stream = std::make_unique<FlushingInputStream>(*input_stream, output);
     }
-    if(token.type == TokenType::TOKEN_ERROR){
-         std::cerr << "Lexical Error: " << token.lexeme << " at line " << token.line << ", column " << token.column << std::endl;
-         return 1;
+
+    // Tokens-only and --stream runs lex the source here; everything else
+    // hands it to simlan::Program::compile()
+    auto makeLexer = [&]() {
+        return flushing_stream ? std::make_unique<Lexer>(*flushing_stream)
+            : input_stream ? std::make_unique<Lexer>(*input_stream)
+            : std::make_unique<Lexer>(source_file.text());
+    };
+
+    if (emitTokens) {
+        std::cout << "\n--- Tokens ---\n";
     }
-    std::cout << "Token: " << token.typeToString() << " ('" << token.lexeme << "')" << std::endl; // Print EOF
-    
-    // Re-initialize lexer for the parser (or manage token stream differently)
-    // For this simple setup, creating a new lexer is easiest.
-    // A more advanced compiler would have the lexer provide a stream that the parser consumes.
-    Lexer parser_lexer(source_code); // Create a new lexer instance for the parser
 
+    // Pending program output goes out before any error message
+    auto reportError = [&output](const std::string& message) {
+        output.flush();
+        std::cout.flush();
+        std::cerr << message << std::endl;
+        return 1;
+    };
 
-    // 2. Parsing
-    Parser parser(parser_lexer); // Pass the new lexer instance
-    std::unique_ptr<ProgramNode> ast_root;
+    std::unique_ptr<ThreadPool> pool;
+    if (threads > 1) {
+        pool = std::make_unique<ThreadPool>(threads);
+    }
+
+    int status = 0;
 
     try {
-        ast_root = parser.parseProgram();
-        std::cout << "\n--- Abstract Syntax Tree (AST) ---" << std::endl;
-        if (ast_root) {
-            ast_root->print(0);
+        if (!emitAst && !emitC && !emitRun) {
+            // Tokens only: no parser involved
+            PhaseTimer lexTimer(stats, "lex");
+            std::unique_ptr<Lexer> lexer = makeLexer();
+            Token token = lexer->getNextToken();
+            while (token.type != TokenType::TOKEN_EOF && token.type != TokenType::TOKEN_ERROR) {
+                printToken(std::cout, token, lexer->lexeme(token));
+                if (stats) stats->countToken(token);
+                token = lexer->getNextToken();
+            }
+            if (token.type == TokenType::TOKEN_ERROR) {
+                throw LexError(std::string(lexer->lexeme(token)), token.line, token.column);
+            }
+            printToken(std::cout, token, lexer->lexeme(token));
+            if (stats) stats->countToken(token);
+        } else if (streamMode) {
+            std::cout.flush(); // The sink writes to the same fd
+            StreamingInterpreter interpreter(output, maxNesting);
+            std::unique_ptr<Lexer> lexer = makeLexer();
+            if (!interpreter.run(*lexer)) {
+                status = reportError(simlan::INPUT_STATEMENTS_ERROR);
+            }
+            output.flush();
         } else {
-            // This case should ideally not be reached if parsing is successful
-            // or throws an error on failure.
-            std::cerr << "AST parsing resulted in a null root. Cannot execute." << std::endl;
-            return 1; 
-        }
+            // The vm and jit engines translate the tree; nothing else runs it
+            bool runsProgram = emitRun && !batchMode;
+            simlan::CompileOptions options;
+            if (runsProgram) {
+                simlan::engineFromName(engine, options.engine);
+            }
+            options.optimizationLevel = optimizationLevel;
+            options.maxNesting = maxNesting;
+            options.countOperators = stats != nullptr;
+            // A mapped file can be parsed in chunks on the pool, unless the
+            // tokens are listed, which needs them in order
+            options.pool = pool.get();
+            // With --cache, an unchanged source is loaded from its .simc file
+            // instead of being lexed, parsed and optimized again. The token
+            // and AST dumps describe a compilation, so they always compile.
+            options.cache = cacheEnabled && !emitTokens && !emitAst;
+            options.sourcePath = filepath;
+            options.cacheDir = cacheDir;
 
-        // Execute/Interpret the AST
-        std::cout << "\n--- Simlan Output ---" << std::endl; // New section for results
-        // No need to check ast_root again if we returned/threw above for null
-        ast_root->execute();
+            // The source is lexed exactly once: the token dump is taken and,
+            // with --stats, the tokens are counted as the parser pulls them.
+            // Lexing is timed as part of the parse phase.
+            if (emitTokens) {
+                options.onToken = [](const Token& token, std::string_view text) {
+                    printToken(std::cout, token, text);
+                };
+            }
+            std::unique_ptr<PhaseTimer> phaseTimer;
+            if (stats) {
+                options.tokenCounts = stats->tokens.data();
+                options.onPhase = [&phaseTimer, stats](const char* phase, bool started) {
+                    phaseTimer.reset();
+                    if (started) {
+                        phaseTimer = std::make_unique<PhaseTimer>(stats, phase);
+                    }
+                };
+                options.onParsed = [stats](const ProgramNode& tree, bool fromCache) {
+                    stats->parsedNodes = Stats::countNodes(tree);
+                    stats->fromCache = fromCache;
+                };
+            }
+            // The dump shows the optimized tree
+            if (stats || emitAst) {
+                options.onTree = [stats, emitAst, optimizationLevel](const ProgramNode& tree, const Optimizer* optimizer,
+                                                                     const CommonSubexpressions* cse) {
+                    if (stats && optimizer) {
+                        stats->optimizedNodes = Stats::countNodes(tree);
+                        stats->optimized = true;
+                    }
+                    if (stats && cse) {
+                        stats->sharing.totalNodes = cse->totalNodes();
+                        stats->sharing.uniqueNodes = cse->uniqueNodes();
+                        stats->sharing.temporaries = cse->temporaryCount();
+                        stats->sharing.savedBytes = cse->savedBytes();
+                        stats->shared = true;
+                    }
+                    if (emitAst) {
+                        PhaseTimer dumpTimer(stats, "ast dump");
+                        std::cout << "\n--- Abstract Syntax Tree (AST) ---\n";
+                        printAst(std::cout, tree, optimizationLevel, optimizer, cse);
+                    }
+                };
+            }
+            options.onWarning = [](const std::string& message) {
+                std::cerr << "Warning: " << message << std::endl;
+            };
+
+            simlan::Error error;
+            std::shared_ptr<const simlan::Program> program =
+                input_stream ? simlan::Program::compile(*input_stream, options, error)
+                             : simlan::Program::compile(source_file.text(), options, error);
+            phaseTimer.reset();
+            if (!program) {
+                status = reportError(error.message);
+            } else {
+                const ProgramNode& tree = program->tree();
+
+                // Translation to C, to stdout or to the -o file
+                if (emitC && tree.hasInputs()) {
+                    status = reportError("Error: Programs with INPUT statements cannot be translated to C");
+                } else if (emitC) {
+                    PhaseTimer emitTimer(stats, "emit c");
+                    CEmitter emitter(numberFormat, isStreamPath(filepath) ? "<stdin>" : filepath);
+                    if (outputPath.empty()) {
+                        if (sections) {
+                            std::cout << "\n--- C Source ---\n";
+                        }
+                        emitter.emit(tree, std::cout);
+                    } else {
+                        std::ofstream c_file(outputPath, std::ios::binary);
+                        if (c_file) {
+                            emitter.emit(tree, c_file);
+                            c_file.close();
+                        }
+                        if (!c_file) {
+                            status = reportError("Error: Could not write '" + outputPath + "'");
+                        }
+                    }
+                }
+
+                // Execution; with --batch, once per input row. Without rows
+                // the INPUT variables have no values. Nothing runs after a
+                // failed translation.
+                bool translated = status == 0;
+                if (translated && runsProgram && tree.hasInputs()) {
+                    status = reportError(simlan::INPUT_STATEMENTS_ERROR);
+                } else if (translated && emitRun && batchMode) {
+                    if (sections) {
+                        std::cout << "\n--- Simlan Output ---\n";
+                    }
+                    std::cout.flush();
+                    if (engine != "ast") {
+                        std::cerr << "Warning: --batch has its own evaluator, --engine=" << engine << " is ignored" << std::endl;
+                    }
+                    status = runBatch(tree, batchPath, outputPath, output, pool.get(), stats);
+                } else if (translated && runsProgram) {
+                    if (sections) {
+                        std::cout << "\n--- Simlan Output ---\n"; // New section for results
+                    }
+                    std::cout.flush(); // The sink writes to the same fd
+                    if (pool && engine == "vm") {
+                        std::cerr << "Warning: --threads is not supported by the vm engine, running on one thread" << std::endl;
+                    }
+                    if (options.engine == simlan::Engine::Jit && program->engine() != simlan::Engine::Jit) {
+                        std::cerr << (JIT::isSupported() ? "Warning: JIT could not compile the program"
+                                                         : "Warning: JIT is not available on this host")
+                                  << ", using the AST interpreter" << std::endl;
+                    }
+
+                    PhaseTimer executeTimer(stats, "execute");
+                    OperatorCounts* counts = stats ? &stats->evaluations : nullptr;
+                    error = pool ? program->run(output, *pool, counts) : program->run(output, counts);
+                    executeTimer.stop();
+                    if (error) {
+                        status = reportError(error.message);
+                    } else {
+                        PhaseTimer flushTimer(stats, "flush");
+                        output.flush();
+                    }
+                }
+            }
+        }
 
+    } catch (const LexError& e) {
+        status = reportError(e.what());
     } catch (const ParseError& e) {
-        std::cerr << "Parse Error: " << e.what() << std::endl;
         // Line/column info is already in e.what() from ParseError constructor
-        return 1;
+        status = reportError(std::string("Parse Error: ") + e.what());
     } catch (const std::runtime_error& e) { // Catch execution errors
-        std::cerr << "Runtime Execution Error: " << e.what() << std::endl;
-        return 1;
+        status = reportError(std::string("Runtime Execution Error: ") + e.what());
     } catch (const std::exception& e) {
-        std::cerr << "An unexpected error occurred: " << e.what() << std::endl;
-        return 1;
+        status = reportError(std::string("An unexpected error occurred: ") + e.what());
+    }
+
+    if (status == 0 && output.failed()) {
+        std::cerr << "Error: Could not write program output" << std::endl;
+        status = 1;
     }
 
-    std::cout << "\nSimlan processing finished." << std::endl;
+    if (status == 0 && sections) {
+        std::cout << "\nSimlan processing finished.\n";
+    }
+    std::cout.flush();
 
+    if (stats) {
+        stats->outputBytes = output.bytesWritten();
+        readAllocationCounts(stats->allocations, stats->allocatedBytes);
+        if (showStats) {
+            stats->printSummary(std::cerr);
+        }
+        if (!tracePath.empty()) {
+            std::string trace_error;
+            if (!stats->writeTrace(tracePath, trace_error)) {
+                std::cerr << "Error: " << trace_error << std::endl;
+                status = 1;
+            }
+        }
+    }
 
-    return 0;
+    return status;
 }
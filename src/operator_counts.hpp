@@ -0,0 +1,23 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+//------------------------------------------------------------------------------
+// OperatorCounts: binary operations, per operator
+//------------------------------------------------------------------------------
+// Indexed in the order + - * / (operatorIndex()). The engines fill one in
+// while running when they are given one (simlanc --stats); without it they
+// run exactly the code they always do.
+constexpr size_t OPERATOR_COUNT = 4;
+using OperatorCounts = std::array<uint64_t, OPERATOR_COUNT>;
+
+inline size_t operatorIndex(char op) {
+    switch (op) {
+        case '+': return 0;
+        case '-': return 1;
+        case '*': return 2;
+        default:  return 3;
+    }
+}
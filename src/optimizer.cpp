@@ -0,0 +1,152 @@
+#include "optimizer.hpp"
+#include <cmath> // For std::signbit
+#include <vector>
+
+namespace {
+
+bool isNumber(const ExprArena& arena, ExprId expr, double value) {
+    return ExprArena::isNumber(expr) && arena.number(expr).value == value;
+}
+
+// True only for -0.0 (== 0 also matches +0.0)
+bool isNegativeZero(const ExprArena& arena, ExprId expr) {
+    return isNumber(arena, expr, 0.0) && std::signbit(arena.number(expr).value);
+}
+
+bool isPositiveZero(const ExprArena& arena, ExprId expr) {
+    return isNumber(arena, expr, 0.0) && !std::signbit(arena.number(expr).value);
+}
+
+} // namespace
+
+std::unique_ptr<ProgramNode> Optimizer::optimize(const ProgramNode& program) {
+    auto optimized = std::make_unique<ProgramNode>();
+    source = &program;
+    target = optimized.get();
+    folded = 0;
+    simplified = 0;
+
+    optimized->symbols = program.symbols;
+    for (const StatementNode& stmt : program.statements) {
+        StatementNode rewritten = stmt;
+        rewritten.expression = optimizeExpression(stmt.expression);
+        optimized->addStatement(rewritten);
+    }
+
+    source = nullptr;
+    target = nullptr;
+    return optimized;
+}
+
+ExprId Optimizer::optimizeExpression(ExprId expr) {
+    const ExprArena& in = source->arena;
+    ExprArena& out = target->arena;
+
+    // Post-order without recursion; operands are rewritten before their parent
+    struct Frame {
+        ExprId id;
+        bool operandsDone;
+    };
+    std::vector<Frame> work{{expr, false}};
+    std::vector<ExprId> results;
+    while (!work.empty()) {
+        Frame frame = work.back();
+        work.pop_back();
+        if (ExprArena::isVariable(frame.id)) {
+            results.push_back(frame.id); // Same slot in the optimized program
+            continue;
+        }
+        if (!ExprArena::isBinary(frame.id)) {
+            results.push_back(out.addNumber(in.number(frame.id).value));
+            continue;
+        }
+        const BinaryOpNode& node = in.binary(frame.id);
+        if (!frame.operandsDone) {
+            work.push_back({frame.id, true});
+            work.push_back({node.right, false});
+            work.push_back({node.left, false}); // Rewritten first
+            continue;
+        }
+        ExprId right = results.back();
+        results.pop_back();
+        ExprId left = results.back();
+        results.pop_back();
+        results.push_back(optimizeBinary(node.op, left, right));
+    }
+    return results.back();
+}
+
+ExprId Optimizer::optimizeBinary(char op, ExprId left, ExprId right) {
+    ExprArena& out = target->arena;
+
+    // Constant folding
+    if (ExprArena::isNumber(left) && ExprArena::isNumber(right)) {
+        double leftVal = out.number(left).value;
+        double rightVal = out.number(right).value;
+        bool foldable = true;
+        double result = 0.0;
+        switch (op) {
+            case '+': result = leftVal + rightVal; break;
+            case '-': result = leftVal - rightVal; break;
+            case '*': result = leftVal * rightVal; break;
+            case '/':
+                // Leave the division in place so it fails at run time
+                foldable = rightVal != 0;
+                if (foldable) {
+                    result = leftVal / rightVal;
+                }
+                break;
+            default:
+                foldable = false;
+                break;
+        }
+        if (foldable) {
+            // The operands are normally the last two numbers added (a subtree
+            // that folds to a number leaves nothing else behind); reuse their
+            // slots instead of leaving them as garbage in the arena.
+            size_t count = out.numbers.size();
+            if (count >= 2 && ExprArena::indexOf(left) == count - 2 && ExprArena::indexOf(right) == count - 1) {
+                out.numbers.pop_back();
+                out.numbers.pop_back();
+            }
+            folded++;
+            return out.addNumber(result);
+        }
+    }
+
+    // Algebraic identities (exact for all doubles)
+    bool keepLeft = false;
+    bool keepRight = false;
+    switch (op) {
+        case '*':
+            keepLeft = isNumber(out, right, 1.0);
+            keepRight = !keepLeft && isNumber(out, left, 1.0);
+            break;
+        case '/':
+            keepLeft = isNumber(out, right, 1.0);
+            break;
+        case '-':
+            keepLeft = isPositiveZero(out, right);
+            break;
+        case '+':
+            keepLeft = isNegativeZero(out, right);
+            keepRight = !keepLeft && isNegativeZero(out, left);
+            break;
+        default:
+            break;
+    }
+    if (keepLeft) {
+        // The dropped right operand is the newest number; give its slot back
+        if (ExprArena::indexOf(right) + 1 == out.numbers.size()) {
+            out.numbers.pop_back();
+        }
+        simplified++;
+        return left;
+    }
+    if (keepRight) {
+        simplified++;
+        return right;
+    }
+
+    return out.addBinary(op, left, right);
+}
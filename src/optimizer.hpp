@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ast.hpp"
+#include <cstddef>
+#include <memory>
+
+//------------------------------------------------------------------------------
+// Optimizer: rewrites a ProgramNode into a smaller program with the same output
+//------------------------------------------------------------------------------
+// Runs between Parser::parseProgram() and execution (simlanc -O1).
+//
+// - Constant folding: a BinaryOpNode whose operands are both numbers (not
+//   variables, which are only known at run time) is
+//   replaced by its value, computed with the same double arithmetic as
+//   ProgramNode::evaluate(). A division by a constant zero is never folded, so
+//   it still raises "Division by zero" when its statement runs.
+// - Algebraic identities that hold for every IEEE double, including -0.0, NaN
+//   and infinities: x * 1, 1 * x, x / 1, x - 0.0, x + (-0.0) and (-0.0) + x
+//   all become x. (x + 0.0 is not rewritten: -0.0 + 0.0 is +0.0.)
+//
+// The result is built in a fresh arena, so it keeps the parser's invariant
+// that children are allocated before their parents.
+class Optimizer {
+public:
+    std::unique_ptr<ProgramNode> optimize(const ProgramNode& program);
+
+    size_t foldedCount() const { return folded; }
+    size_t simplifiedCount() const { return simplified; }
+
+private:
+    const ProgramNode* source = nullptr;
+    ProgramNode* target = nullptr;
+    size_t folded = 0;
+    size_t simplified = 0;
+
+    ExprId optimizeExpression(ExprId expr);
+    // Folds or simplifies op applied to already optimized operands
+    ExprId optimizeBinary(char op, ExprId left, ExprId right);
+};
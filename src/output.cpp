@@ -0,0 +1,98 @@
+#include "output.hpp"
+#include <algorithm> // For std::min, std::max
+#include <cerrno>
+#include <charconv> // For std::to_chars
+#include <cstring>  // For std::memcpy
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SIMLAN_HAVE_WRITE 1
+#include <unistd.h>
+#else
+#define SIMLAN_HAVE_WRITE 0
+#endif
+
+OutputSink::OutputSink(std::ostream& out, NumberFormat format, size_t capacity)
+    : stream(&out), format(format), capacity(std::max(capacity, MIN_CAPACITY)) {
+    buffer.reset(new char[this->capacity]);
+}
+
+OutputSink::OutputSink(int fd, NumberFormat format, size_t capacity)
+    : fd(fd), format(format), capacity(std::max(capacity, MIN_CAPACITY)) {
+    buffer.reset(new char[this->capacity]);
+#if !SIMLAN_HAVE_WRITE
+    stream = fd == 1 ? &std::cout : &std::cerr;
+#endif
+}
+
+OutputSink::~OutputSink() {
+    flush();
+}
+
+size_t OutputSink::formatNumber(char* out, double value, NumberFormat format) {
+    // Neither form allocates or consults the locale. to_chars with an explicit
+    // precision in general format is specified to match printf("%.*g").
+    std::to_chars_result result = format == NumberFormat::Legacy
+        ? std::to_chars(out, out + MAX_NUMBER_LENGTH, value, std::chars_format::general, 6)
+        : std::to_chars(out, out + MAX_NUMBER_LENGTH, value);
+    return static_cast<size_t>(result.ptr - out);
+}
+
+void OutputSink::printNumber(double value) {
+    if (capacity - used < MAX_NUMBER_LENGTH + 1) {
+        flush();
+    }
+    used += formatNumber(buffer.get() + used, value, format);
+    buffer[used++] = '\n';
+    printed++;
+}
+
+void OutputSink::writeNumbers(std::string_view text, size_t count) {
+    write(text);
+    printed += count;
+}
+
+void OutputSink::write(std::string_view text) {
+    while (!text.empty()) {
+        if (used == capacity) {
+            flush();
+        }
+        size_t n = std::min(text.size(), capacity - used);
+        std::memcpy(buffer.get() + used, text.data(), n);
+        used += n;
+        text.remove_prefix(n);
+    }
+}
+
+void OutputSink::flush() {
+    if (used == 0) {
+        return;
+    }
+    flushed += used;
+    if (writeFailed) {
+        used = 0;
+        return;
+    }
+    if (stream) {
+        stream->write(buffer.get(), static_cast<std::streamsize>(used));
+        stream->flush();
+        writeFailed = !*stream;
+        used = 0;
+        return;
+    }
+#if SIMLAN_HAVE_WRITE
+    const char* p = buffer.get();
+    size_t left = used;
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            writeFailed = true;
+            break;
+        }
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+#endif
+    used = 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <memory>
+#include <string_view>
+
+//------------------------------------------------------------------------------
+// Number formats for PRINT
+//------------------------------------------------------------------------------
+enum class NumberFormat {
+    Shortest,   // Shortest text that reads back as the same double (std::to_chars)
+    Legacy      // iostream default: %g with 6 significant digits
+};
+
+//------------------------------------------------------------------------------
+// OutputSink: buffered destination for program output
+//------------------------------------------------------------------------------
+// Every engine prints through a sink instead of std::cout. Output collects in
+// a fixed buffer that is written out only when it is full, on flush() and on
+// destruction, so printing a value neither allocates nor issues a system call.
+// Callers must flush() before writing anything else (e.g. an error message)
+// to the same destination.
+class OutputSink {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+    static constexpr size_t MAX_NUMBER_LENGTH = 32; // Enough for any double in either format
+    // Smaller capacities are raised to this, so one printed value always fits
+    static constexpr size_t MIN_CAPACITY = MAX_NUMBER_LENGTH + 1;
+
+    // Writes to a stream
+    explicit OutputSink(std::ostream& out, NumberFormat format = NumberFormat::Shortest,
+                        size_t capacity = DEFAULT_CAPACITY);
+
+    // Writes straight to a file descriptor with write(2), bypassing stdio.
+    // On hosts without write(2), fd 1 maps to std::cout and others to std::cerr.
+    explicit OutputSink(int fd, NumberFormat format = NumberFormat::Shortest,
+                        size_t capacity = DEFAULT_CAPACITY);
+
+    ~OutputSink();
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    // Prints value followed by a newline, as PRINT does
+    void printNumber(double value);
+
+    void write(std::string_view text);
+
+    // Appends count values that were already formatted with formatNumber(),
+    // each followed by a newline (e.g. by worker threads)
+    void writeNumbers(std::string_view text, size_t count);
+
+    // Hands the buffered bytes to the destination
+    void flush();
+
+    // True once a write to the destination has failed; later output is dropped
+    bool failed() const { return writeFailed; }
+
+    NumberFormat numberFormat() const { return format; }
+
+    size_t numbersPrinted() const { return printed; }
+    size_t bytesWritten() const { return flushed + used; } // Including what is still buffered
+
+    // Formats value into buffer (at least MAX_NUMBER_LENGTH bytes, no
+    // terminator) and returns the length
+    static size_t formatNumber(char* buffer, double value, NumberFormat format);
+
+private:
+    std::ostream* stream = nullptr; // Null when writing to fd
+    int fd = -1;
+    NumberFormat format;
+
+    std::unique_ptr<char[]> buffer;
+    size_t capacity;
+    size_t used = 0;
+    bool writeFailed = false;
+    size_t printed = 0;  // Values printed
+    size_t flushed = 0;  // Bytes handed to the destination
+};
@@ -0,0 +1,117 @@
+#include "parallel.hpp"
+#include "output.hpp"
+#include "thread_pool.hpp"
+#include <algorithm> // For std::min
+#include <atomic>
+#include <exception> // For std::exception_ptr
+#include <string>
+#include <vector>
+
+namespace {
+
+// Statements are handed out in blocks, and a wave of blocks is evaluated
+// before its output is written, so memory for pending output stays bounded.
+constexpr size_t STATEMENTS_PER_BLOCK = 256;
+constexpr size_t BLOCKS_PER_WORKER = 8; // Per wave; leaves room for stealing
+
+// The result slot of a block: its formatted output, up to the first failing
+// statement, that statement's exception, and the operators it evaluated
+struct Block {
+    std::string text;
+    size_t values;
+    std::exception_ptr error;
+    OperatorCounts counts;
+};
+
+} // namespace
+
+void runStatementsParallel(size_t count, const StatementEvaluator& evaluate, OutputSink& out, ThreadPool& pool,
+                           OperatorCounts* counts) {
+    const size_t blockCount = (count + STATEMENTS_PER_BLOCK - 1) / STATEMENTS_PER_BLOCK;
+    const size_t waveSize = pool.size() * BLOCKS_PER_WORKER;
+    const NumberFormat format = out.numberFormat();
+    std::vector<Block> blocks(std::min(blockCount, waveSize));
+
+    for (size_t waveStart = 0; waveStart < blockCount; waveStart += waveSize) {
+        const size_t waveBlocks = std::min(waveSize, blockCount - waveStart);
+        std::atomic<size_t> firstFailed(waveBlocks); // Earliest failed block of the wave
+
+        pool.parallelFor(waveBlocks, [&](size_t b) {
+            // Output stops at the earlier failure anyway
+            if (b > firstFailed.load(std::memory_order_relaxed)) {
+                return;
+            }
+
+            Block& block = blocks[b];
+            block.text.clear();
+            block.values = 0;
+            block.error = nullptr;
+            block.counts = OperatorCounts{};
+            OperatorCounts* blockCounts = counts ? &block.counts : nullptr;
+
+            size_t begin = (waveStart + b) * STATEMENTS_PER_BLOCK;
+            size_t end = std::min(begin + STATEMENTS_PER_BLOCK, count);
+            char number[OutputSink::MAX_NUMBER_LENGTH + 1];
+            for (size_t i = begin; i < end; ++i) {
+                double result;
+                try {
+                    evaluate(i, result, blockCounts);
+                } catch (...) {
+                    block.error = std::current_exception();
+                    size_t failed = firstFailed.load(std::memory_order_relaxed);
+                    while (b < failed && !firstFailed.compare_exchange_weak(failed, b, std::memory_order_relaxed)) {
+                    }
+                    return;
+                }
+                size_t length = OutputSink::formatNumber(number, result, format);
+                number[length] = '\n';
+                block.text.append(number, length + 1);
+                block.values++;
+            }
+        });
+
+        // Blocks up to the first failure all ran to completion or to their error
+        for (size_t b = 0; b < waveBlocks; ++b) {
+            out.writeNumbers(blocks[b].text, blocks[b].values);
+            if (counts) {
+                for (size_t op = 0; op < OPERATOR_COUNT; ++op) {
+                    (*counts)[op] += blocks[b].counts[op];
+                }
+            }
+            if (blocks[b].error) {
+                std::rethrow_exception(blocks[b].error);
+            }
+        }
+    }
+}
+
+void runStatementsParallel(size_t count, const StatementPredicate& isBarrier, const StatementAction& runBarrier,
+                           const StatementEvaluator& evaluate, OutputSink& out, ThreadPool& pool,
+                           OperatorCounts* counts) {
+    size_t i = 0;
+    while (i < count) {
+        if (isBarrier(i)) {
+            runBarrier(i++);
+            continue;
+        }
+        size_t end = i + 1;
+        while (end < count && !isBarrier(end)) {
+            end++;
+        }
+
+        if (end - i < STATEMENTS_PER_BLOCK) {
+            // Too few to be worth a trip through the pool
+            for (; i < end; ++i) {
+                double result;
+                evaluate(i, result, counts);
+                out.printNumber(result);
+            }
+            continue;
+        }
+        const size_t offset = i;
+        runStatementsParallel(end - i, [&evaluate, offset](size_t statement, double& result, OperatorCounts* blockCounts) {
+            evaluate(offset + statement, result, blockCounts);
+        }, out, pool, counts);
+        i = end;
+    }
+}
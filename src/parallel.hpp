@@ -0,0 +1,36 @@
+#pragma once
+
+#include "operator_counts.hpp"
+#include <cstddef>
+#include <functional>
+
+class OutputSink;
+class ThreadPool;
+
+// Computes the value of one statement. Runtime errors are thrown, as
+// ProgramNode::evaluate() does. Called concurrently for different statements.
+// counts is null unless the run counts operators; each concurrent call is
+// given counts of its own, so they are updated without synchronization.
+using StatementEvaluator = std::function<void(size_t statement, double& result, OperatorCounts* counts)>;
+
+// Tells whether a statement must run on its own (a LET, which later
+// statements read), and runs such a statement. Called on the calling thread.
+using StatementPredicate = std::function<bool(size_t statement)>;
+using StatementAction = std::function<void(size_t statement)>;
+
+// Evaluates statements [0, count) on the pool and prints their values in
+// source order, so the output is byte-identical to a serial run. If a
+// statement fails, everything before it is printed and its exception is
+// rethrown; nothing after it is printed. With counts, the operators of the
+// statements up to the failing one are added to it, and only those, so the
+// counts do not depend on the number of threads either.
+void runStatementsParallel(size_t count, const StatementEvaluator& evaluate, OutputSink& out, ThreadPool& pool,
+                           OperatorCounts* counts = nullptr);
+
+// Same, for programs where some statements depend on earlier ones. Each
+// barrier runs serially once everything before it has been printed; the
+// statements between two barriers are evaluated in parallel as above.
+// runBarrier does its own counting.
+void runStatementsParallel(size_t count, const StatementPredicate& isBarrier, const StatementAction& runBarrier,
+                           const StatementEvaluator& evaluate, OutputSink& out, ThreadPool& pool,
+                           OperatorCounts* counts = nullptr);
@@ -0,0 +1,249 @@
+#include "parallel_parser.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "scan.hpp"
+#include "thread_pool.hpp"
+#include <algorithm> // For std::max, std::min
+#include <array>
+#include <atomic>
+#include <cstring>   // For std::memcpy
+#include <exception> // For std::exception_ptr
+#include <stdexcept> // For std::length_error
+#include <vector>
+
+namespace {
+
+// Chunks smaller than this are not worth a thread of their own
+constexpr size_t MIN_CHUNK_BYTES = 256 * 1024;
+constexpr size_t CHUNKS_PER_WORKER = 4; // Leaves room for stealing
+
+struct SourceChunk {
+    size_t begin = 0;
+    size_t end = 0;
+
+    // Filled in by the line count
+    size_t newlines = 0;
+    size_t lastLineStart = 0;   // Just past the chunk's last '\n', if newlines > 0
+    int line = 1;               // Line number at begin
+    size_t lineStart = 0;       // Offset at which that line starts
+
+    // Filled in by the parse. Variables are the chunk's own: it cannot know
+    // what the chunks before it define, so its uses are checked when the
+    // chunks are stitched. After an error, program and uses hold what was
+    // parsed before it.
+    std::unique_ptr<ProgramNode> program;
+    std::vector<VariableUse> uses;
+    std::array<uint64_t, TOKEN_TYPE_COUNT> tokens{}; // Only counted if asked for
+    std::exception_ptr error;
+    std::vector<uint32_t> slots; // Chunk slot -> slot in the whole program
+};
+
+// A ';' is inside a comment exactly when its line has a "//" before it:
+// the lexer starts a comment at any "//" it meets, and the language has no
+// string literals that could hide one.
+bool inComment(std::string_view source, size_t pos) {
+    size_t lineStart = source.rfind('\n', pos);
+    lineStart = lineStart == std::string_view::npos ? 0 : lineStart + 1;
+    return source.substr(lineStart, pos - lineStart).find("//") != std::string_view::npos;
+}
+
+// The first chunk boundary at or after from: just past a ';' outside a
+// comment, or the end of the source. In a source without errors up to that
+// point, such a ';' always ends a statement, so the next chunk starts at a
+// statement just like the serial parser would.
+size_t nextBoundary(std::string_view source, size_t from) {
+    while (from < source.size()) {
+        size_t semicolon = source.find(';', from);
+        if (semicolon == std::string_view::npos) {
+            break;
+        }
+        if (!inComment(source, semicolon)) {
+            return semicolon + 1;
+        }
+        // Fix-up: this ';' is commented out, so a chunk starting here would
+        // begin in the middle of a comment. Carry on after that line.
+        size_t lineEnd = source.find('\n', semicolon);
+        if (lineEnd == std::string_view::npos) {
+            break;
+        }
+        from = lineEnd + 1;
+    }
+    return source.size();
+}
+
+ExprId rebase(ExprId id, uint32_t numberBase, uint32_t binaryBase, const std::vector<uint32_t>& slots) {
+    if (ExprArena::isVariable(id)) {
+        return ExprArena::variable(slots[ExprArena::indexOf(id)]);
+    }
+    return id + (ExprArena::isBinary(id) ? binaryBase : numberBase);
+}
+
+// Gives the variables of chunk their slots in the whole program, in order of
+// definition as the serial parser does, and checks that every use comes
+// after a definition. Throws the first error in the chunk: an undefined
+// variable, or else the error its parse stopped at.
+void resolveVariables(SourceChunk& chunk, SymbolTable& symbols) {
+    const ProgramNode& part = *chunk.program;
+    chunk.slots.assign(part.symbols.size(), SymbolTable::NO_SLOT);
+    if (part.symbols.size() > 0) {
+        size_t use = 0;
+        // One more than the statements: the one that failed to parse
+        for (size_t s = 0; s <= part.statements.size(); ++s) {
+            for (; use < chunk.uses.size() && chunk.uses[use].statement == s; ++use) {
+                const VariableUse& ref = chunk.uses[use];
+                const std::string& name = part.symbols.name(ref.slot);
+                uint32_t slot = symbols.find(name);
+                if (slot == SymbolTable::NO_SLOT) {
+                    throw Parser::undefinedVariable(name, ref.line, ref.column);
+                }
+                chunk.slots[ref.slot] = slot;
+            }
+            if (s < part.statements.size() && part.statements[s].assigns()) {
+                uint32_t local = part.statements[s].slot;
+                chunk.slots[local] = symbols.intern(part.symbols.name(local));
+            }
+        }
+    }
+    if (chunk.error) {
+        std::rethrow_exception(chunk.error);
+    }
+}
+
+} // namespace
+
+std::unique_ptr<ProgramNode> parseProgramParallel(std::string_view source, ThreadPool& pool, size_t maxNesting,
+                                                  uint64_t* tokenCounts) {
+    // 1. Chunk boundaries. Only a few bytes around each target are looked at.
+    size_t target = std::max(MIN_CHUNK_BYTES, source.size() / (pool.size() * CHUNKS_PER_WORKER) + 1);
+    std::vector<SourceChunk> chunks;
+    size_t begin = 0;
+    while (begin < source.size()) {
+        size_t end = begin + target < source.size() ? nextBoundary(source, begin + target) : source.size();
+        chunks.emplace_back();
+        chunks.back().begin = begin;
+        chunks.back().end = end;
+        begin = end;
+    }
+    if (chunks.size() <= 1) {
+        Lexer lexer(source);
+        Parser::TokenObserver observer;
+        if (tokenCounts) {
+            observer = [tokenCounts](const Token& token) { tokenCounts[static_cast<size_t>(token.type)]++; };
+        }
+        Parser parser(lexer, observer);
+        parser.setMaxNesting(maxNesting);
+        return parser.parseProgram();
+    }
+
+    // 2. Line number and line start at the beginning of each chunk
+    pool.parallelFor(chunks.size(), [&](size_t c) {
+        SourceChunk& chunk = chunks[c];
+        chunk.newlines = scan::countNewlines(source.data() + chunk.begin, source.data() + chunk.end);
+        if (chunk.newlines > 0) {
+            chunk.lastLineStart = source.rfind('\n', chunk.end - 1) + 1;
+        }
+    });
+    int line = 1;
+    size_t lineStart = 0;
+    for (SourceChunk& chunk : chunks) {
+        chunk.line = line;
+        chunk.lineStart = lineStart;
+        line += static_cast<int>(chunk.newlines);
+        if (chunk.newlines > 0) {
+            lineStart = chunk.lastLineStart;
+        }
+    }
+
+    // 3. Lex and parse every chunk into its own ProgramNode
+    std::atomic<size_t> firstFailed(chunks.size());
+    pool.parallelFor(chunks.size(), [&](size_t c) {
+        if (c > firstFailed.load(std::memory_order_relaxed)) {
+            return; // Only the first error in the source is reported
+        }
+        SourceChunk& chunk = chunks[c];
+        chunk.program = std::make_unique<ProgramNode>();
+        try {
+            Lexer lexer(source, chunk.begin, chunk.end, chunk.line, chunk.lineStart);
+            Parser::TokenObserver observer;
+            if (tokenCounts) {
+                observer = [&chunk](const Token& token) { chunk.tokens[static_cast<size_t>(token.type)]++; };
+            }
+            Parser parser(lexer, observer);
+            parser.setMaxNesting(maxNesting);
+            parser.deferVariableChecks(chunk.uses);
+            parser.parseProgramInto(*chunk.program);
+        } catch (...) {
+            chunk.error = std::current_exception();
+            size_t failed = firstFailed.load(std::memory_order_relaxed);
+            while (c < failed && !firstFailed.compare_exchange_weak(failed, c, std::memory_order_relaxed)) {
+            }
+        }
+    });
+    // Every chunk ends in an EOF token, the whole source in one. Chunks after
+    // the first failed one were not read by a serial parse.
+    if (tokenCounts) {
+        size_t last = std::min(firstFailed.load(), chunks.size() - 1);
+        for (size_t c = 0; c <= last; ++c) {
+            for (size_t type = 0; type < TOKEN_TYPE_COUNT; ++type) {
+                tokenCounts[type] += chunks[c].tokens[type];
+            }
+            if (c < last) {
+                tokenCounts[static_cast<size_t>(TokenType::TOKEN_EOF)]--;
+            }
+        }
+    }
+
+    // Chunks after the first failed one may not have been parsed, but that
+    // one throws before they are reached
+    auto program = std::make_unique<ProgramNode>();
+    for (SourceChunk& chunk : chunks) {
+        resolveVariables(chunk, program->symbols);
+    }
+
+    // 4. Stitch: concatenate the arenas, shifting every id by the number of
+    // nodes of its kind in the chunks before it, and variables to their slots
+    std::vector<size_t> numberBase(chunks.size()), binaryBase(chunks.size()), statementBase(chunks.size());
+    size_t numbers = 0, binaries = 0, statements = 0;
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        const ProgramNode& part = *chunks[c].program;
+        numberBase[c] = numbers;
+        binaryBase[c] = binaries;
+        statementBase[c] = statements;
+        numbers += part.arena.numbers.size();
+        binaries += part.arena.binaries.size();
+        statements += part.statements.size();
+    }
+    if (numbers > static_cast<size_t>(EXPR_INDEX_MASK) + 1) {
+        throw std::length_error("AST arena is full: too many number nodes");
+    }
+    if (binaries > static_cast<size_t>(EXPR_INDEX_MASK) + 1) {
+        throw std::length_error("AST arena is full: too many binary operation nodes");
+    }
+
+    program->arena.numbers.resize(numbers);
+    program->arena.binaries.resize(binaries);
+    program->statements.resize(statements);
+    pool.parallelFor(chunks.size(), [&](size_t c) {
+        std::unique_ptr<ProgramNode> part = std::move(chunks[c].program);
+        uint32_t numberShift = static_cast<uint32_t>(numberBase[c]);
+        uint32_t binaryShift = static_cast<uint32_t>(binaryBase[c]);
+        const std::vector<uint32_t>& slots = chunks[c].slots;
+
+        if (!part->arena.numbers.empty()) {
+            std::memcpy(&program->arena.numbers[numberBase[c]], part->arena.numbers.data(),
+                        part->arena.numbers.size() * sizeof(NumberNode));
+        }
+        BinaryOpNode* binaryOut = program->arena.binaries.data() + binaryBase[c];
+        for (const BinaryOpNode& node : part->arena.binaries) {
+            *binaryOut++ = BinaryOpNode{node.op, rebase(node.left, numberShift, binaryShift, slots),
+                                        rebase(node.right, numberShift, binaryShift, slots)};
+        }
+        StatementNode* statementOut = program->statements.data() + statementBase[c];
+        for (const StatementNode& stmt : part->statements) {
+            uint32_t slot = stmt.assigns() ? slots[stmt.slot] : 0;
+            *statementOut++ = StatementNode{stmt.kind, slot, rebase(stmt.expression, numberShift, binaryShift, slots)};
+        }
+        // part (and its arena) is released here, as soon as it is copied
+    });
+    return program;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "ast.hpp"
+#include "parser.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+class ThreadPool;
+
+// Parses a complete in-memory source on the pool. The source is cut into
+// chunks just after ';' characters outside comments, each chunk is lexed and
+// parsed on its own, and the partial programs are stitched together in order.
+// The result is the same as from Parser::parseProgram(), and so is the error
+// thrown for an invalid source: the first one in the source, with the same
+// message, line and column. maxNesting is passed to Parser::setMaxNesting().
+// With tokenCounts (TOKEN_TYPE_COUNT counters indexed by TokenType), the
+// tokens the parse reads are added to it, as a serial parse would read them.
+std::unique_ptr<ProgramNode> parseProgramParallel(std::string_view source, ThreadPool& pool,
+                                                  size_t maxNesting = Parser::DEFAULT_MAX_NESTING,
+                                                  uint64_t* tokenCounts = nullptr);
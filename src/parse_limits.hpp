@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+
+//------------------------------------------------------------------------------
+// Parser limits
+//------------------------------------------------------------------------------
+// How deep parentheses may be nested unless the caller sets another limit
+// (Parser::setMaxNesting(), simlanc --max-nesting). One level more is a
+// ParseError.
+constexpr size_t DEFAULT_MAX_NESTING = 100000;
@@ -1,31 +1,28 @@
 #include "parser.hpp"
 #include <iostream> // For error messages
 
-Parser::Parser(Lexer& lex) :
-    lexer(lex),
-    // Initialize currentToken. Its value will be almost immediately overwritten by
-    // the first call to advanceToken(), but it needs a valid state for the
-    // first assignment to previousToken within advanceToken().
-    currentToken(TokenType::TOKEN_ERROR, "InitialCurrent", 0.0, 0, 1), // Meaningless initial values
-    // Explicitly initialize previousToken as well.
-    previousToken(TokenType::TOKEN_ERROR, "InitialPrevious", 0.0, 0, 1) // Meaningless initial values
-{
-    // Now, get the first actual token.
-    // previousToken will hold the "InitialCurrent" state.
-    // currentToken will hold the first real token from the lexer.
+Parser::Parser(Lexer& lex, TokenObserver observer) : lexer(lex), tokenObserver(std::move(observer)) {
+    // currentToken and previousToken start out as empty EOF tokens.
+    // Get the first actual token; previousToken keeps the empty one.
     advanceToken();
 }
 
-// Parser::Parser(Lexer& lex) : lexer(lex), currentToken(TokenType::TOKEN_ERROR, "", 0.0, 0, 0) {
-//     // Initialize currentToken with the first token from the lexer
-//     advanceToken();
-// }
+void Parser::reset() {
+    currentToken = Token();
+    previousToken = Token();
+    statementEndPending = false;
+    advanceToken();
+}
 
 void Parser::advanceToken() {
     previousToken = currentToken;
     currentToken = lexer.getNextToken();
-    // Skip error tokens from lexer if needed, or handle them
-    // For now, we assume the lexer might return TOKEN_ERROR, which the parser should check
+    if (currentToken.type == TokenType::TOKEN_ERROR) {
+        throw LexError(std::string(lexer.lexeme(currentToken)), currentToken.line, currentToken.column);
+    }
+    if (tokenObserver) {
+        tokenObserver(currentToken);
+    }
 }
 
 void Parser::consume(TokenType expectedType, const std::string& errorMessage) {
@@ -36,6 +33,24 @@ void Parser::consume(TokenType expectedType, const std::string& errorMessage) {
     }
 }
 
+void Parser::consumeStatementEnd(const std::string& errorMessage) {
+    if (!lazyStatementEnd) {
+        consume(TokenType::TOKEN_SEMICOLON, errorMessage);
+    } else if (currentToken.type == TokenType::TOKEN_SEMICOLON) {
+        statementEndPending = true;
+    } else {
+        errorAt(currentToken, errorMessage);
+    }
+}
+
+bool Parser::nextStatement() {
+    if (statementEndPending) {
+        statementEndPending = false;
+        advanceToken();
+    }
+    return !atEnd();
+}
+
 bool Parser::match(TokenType type) {
     if (currentToken.type == type) {
         // advanceToken(); // Typically, match does not consume. Consume does.
@@ -54,7 +69,7 @@ bool Parser::match(TokenType type) {
     if (token.type == TokenType::TOKEN_EOF) {
         full_message += " at end of file.";
     } else {
-        full_message += " near '" + token.lexeme + "'";
+        full_message += " near '" + std::string(lexer.lexeme(token)) + "'";
     }
     throw ParseError(full_message, token.line, token.column);
 }
@@ -66,80 +81,185 @@ bool Parser::match(TokenType type) {
 
 std::unique_ptr<ProgramNode> Parser::parseProgram() {
     auto programNode = std::make_unique<ProgramNode>();
-    while (currentToken.type != TokenType::TOKEN_EOF) {
-        if (currentToken.type == TokenType::TOKEN_ERROR) {
-             errorAt(currentToken, "Lexical error: " + currentToken.lexeme);
+    parseProgramInto(*programNode);
+    return programNode;
+}
+
+void Parser::parseProgramInto(ProgramNode& target) {
+    target.statements.clear();
+    target.arena.numbers.clear();
+    target.arena.binaries.clear();
+    target.symbols.clear();
+    program = &target;
+    try {
+        while (nextStatement()) {
+            target.addStatement(parseStatement());
         }
-        programNode->addStatement(parseStatement());
+    } catch (...) {
+        program = nullptr;
+        throw;
     }
-    return programNode;
+    program = nullptr;
+}
+
+StatementNode Parser::parseStatementInto(ProgramNode& target) {
+    program = &target;
+    try {
+        StatementNode stmt = parseStatement();
+        program = nullptr;
+        return stmt;
+    } catch (...) {
+        program = nullptr;
+        throw;
+    }
+}
+
+ParseError Parser::undefinedVariable(std::string_view name, int line, int column) {
+    return ParseError("Parse Error: Undefined variable '" + std::string(name) + "'", line, column);
 }
 
-std::unique_ptr<StatementNode> Parser::parseStatement() {
+StatementNode Parser::parseStatement() {
+    nextStatement();
     if (match(TokenType::TOKEN_PRINT)) {
         return parsePrintStatement();
     }
-    // Add other statement types here (e.g., assignment, if, while)
-    errorAt(currentToken, "Expected a statement (e.g., PRINT).");
+    if (match(TokenType::TOKEN_LET)) {
+        return parseLetStatement();
+    }
+    if (match(TokenType::TOKEN_INPUT)) {
+        return parseInputStatement();
+    }
+    // Add other statement types here (e.g., if, while)
+    errorAt(currentToken, "Expected a statement (e.g., PRINT or LET).");
 }
 
-std::unique_ptr<PrintNode> Parser::parsePrintStatement() {
+StatementNode Parser::parsePrintStatement() {
     consume(TokenType::TOKEN_PRINT, "Expected 'PRINT' keyword.");
-    std::unique_ptr<ExprNode> expr = parseExpression();
-    consume(TokenType::TOKEN_SEMICOLON, "Expected ';' after PRINT statement's expression.");
-    return std::make_unique<PrintNode>(std::move(expr));
+    ExprId expr = parseExpression();
+    consumeStatementEnd("Expected ';' after PRINT statement's expression.");
+    return StatementNode{StatementKind::Print, 0, expr};
+}
+
+StatementNode Parser::parseLetStatement() {
+    consume(TokenType::TOKEN_LET, "Expected 'LET' keyword.");
+    if (!match(TokenType::TOKEN_IDENTIFIER)) {
+        errorAt(currentToken, "Expected a variable name after 'LET'.");
+    }
+    // A stream lexer only keeps the text of the latest token
+    std::string name(lexer.lexeme(currentToken));
+    advanceToken();
+    consume(TokenType::TOKEN_EQUAL, "Expected '=' after the variable name in LET statement.");
+    ExprId expr = parseExpression();
+    consumeStatementEnd("Expected ';' after LET statement's expression.");
+
+    // Defined only now, so that the expression cannot refer to the new variable
+    uint32_t slot = program->symbols.intern(name);
+    return StatementNode{StatementKind::Let, slot, expr};
+}
+
+StatementNode Parser::parseInputStatement() {
+    consume(TokenType::TOKEN_INPUT, "Expected 'INPUT' keyword.");
+    if (!match(TokenType::TOKEN_IDENTIFIER)) {
+        errorAt(currentToken, "Expected a variable name after 'INPUT'.");
+    }
+    std::string name(lexer.lexeme(currentToken));
+    advanceToken();
+    consumeStatementEnd("Expected ';' after INPUT statement's variable name.");
+
+    uint32_t slot = program->symbols.intern(name);
+    return StatementNode{StatementKind::Input, slot, ExprArena::variable(slot)};
 }
 
 // Expression parsing with precedence:
 // expression -> term ( (PLUS | MINUS) term )*
 // term       -> factor ( (STAR | SLASH) factor )*
-// factor     -> NUMBER | LPAREN expression RPAREN
-
-std::unique_ptr<ExprNode> Parser::parseExpression() {
-    std::unique_ptr<ExprNode> left = parseTerm(); // Parse the left-hand side (a term)
-
-    while (match(TokenType::TOKEN_PLUS) || match(TokenType::TOKEN_MINUS)) {
-        Token operatorToken = currentToken; // Save the operator token
-        advanceToken(); // Consume the operator
-        std::unique_ptr<ExprNode> right = parseTerm(); // Parse the right-hand side (another term)
-        left = std::make_unique<BinaryOpNode>(operatorToken.lexeme[0], std::move(left), std::move(right));
-    }
-    return left;
-}
-
-std::unique_ptr<ExprNode> Parser::parseTerm() {
-    std::unique_ptr<ExprNode> left = parseFactor(); // Parse the left-hand side (a factor)
-
-    while (match(TokenType::TOKEN_STAR) || match(TokenType::TOKEN_SLASH)) {
-        Token operatorToken = currentToken; // Save the operator token
-        advanceToken(); // Consume the operator
-        std::unique_ptr<ExprNode> right = parseFactor(); // Parse the right-hand side (another factor)
-        left = std::make_unique<BinaryOpNode>(operatorToken.lexeme[0], std::move(left), std::move(right));
-    }
-    return left;
-}
-
-std::unique_ptr<ExprNode> Parser::parseFactor() {
-    if (match(TokenType::TOKEN_NUMBER)) {
-        // The number token's value is stored in currentToken.value
-        // We need to consume it.
-        Token numToken = currentToken;
-        advanceToken(); // Consume the number token
-        return std::make_unique<NumberNode>(numToken.value);
-    } else if (match(TokenType::TOKEN_LPAREN)) {
-        advanceToken(); // Consume '('
-        std::unique_ptr<ExprNode> expr = parseExpression(); // Parse the inner expression
-        consume(TokenType::TOKEN_RPAREN, "Expected ')' after expression in parentheses.");
-        return expr;
-    }
-    // Add unary minus/plus here if needed in the future
-    // else if (match(TokenType::TOKEN_MINUS)) {
-    //    Token opToken = currentToken;
-    //    advanceToken();
-    //    std::unique_ptr<ExprNode> operand = parseFactor();
-    //    return std::make_unique<UnaryOpNode>(opToken.lexeme[0], std::move(operand));
-    // }
-    else {
-        errorAt(currentToken, "Expected a number or a parenthesized expression.");
+// factor     -> NUMBER | IDENTIFIER | LPAREN expression RPAREN
+//
+// The rules are not implemented as mutually recursive functions: every '('
+// would then cost a few machine stack frames, and a deeply nested expression
+// overflows the stack. Instead each open parenthesis pushes a Level that holds
+// what the recursive version would have kept in its locals. Nodes are created,
+// tokens consumed and errors reported in the same order as before.
+
+ExprId Parser::parseExpression() {
+    levels.clear();
+    levels.push_back(Level{});
+
+    for (;;) {
+        // factor: open any parentheses, then read the number or variable
+        while (match(TokenType::TOKEN_LPAREN)) {
+            if (levels.size() > maxNesting) {
+                errorAt(currentToken, "Expression nested more than " + std::to_string(maxNesting) + " levels deep.");
+            }
+            advanceToken(); // Consume '('
+            levels.push_back(Level{});
+        }
+        ExprId value;
+        if (match(TokenType::TOKEN_NUMBER)) {
+            // The number token's value is stored in currentToken.value
+            value = program->arena.addNumber(currentToken.value);
+            advanceToken(); // Consume the number token
+        } else if (match(TokenType::TOKEN_IDENTIFIER)) {
+            value = parseVariable();
+        } else {
+            // Add unary minus/plus here if needed in the future
+            errorAt(currentToken, "Expected a number, a variable or a parenthesized expression.");
+        }
+
+        // value is a complete factor; fold it into the innermost open level,
+        // closing parentheses until an operator asks for another factor
+        for (;;) {
+            Level& level = levels.back();
+            if (level.termOp) {
+                value = program->arena.addBinary(level.termOp, level.term, value);
+                level.termOp = 0;
+            }
+            if (match(TokenType::TOKEN_STAR) || match(TokenType::TOKEN_SLASH)) {
+                level.term = value;
+                level.termOp = lexer.lexeme(currentToken)[0]; // Save the operator
+                advanceToken(); // Consume the operator
+                break;
+            }
+
+            // The term is complete
+            if (level.sumOp) {
+                value = program->arena.addBinary(level.sumOp, level.sum, value);
+                level.sumOp = 0;
+            }
+            if (match(TokenType::TOKEN_PLUS) || match(TokenType::TOKEN_MINUS)) {
+                level.sum = value;
+                level.sumOp = lexer.lexeme(currentToken)[0];
+                advanceToken();
+                break;
+            }
+
+            // The expression is complete
+            if (levels.size() == 1) {
+                return value;
+            }
+            // Not consume(): its message would be built for every ')'
+            if (!match(TokenType::TOKEN_RPAREN)) {
+                errorAt(currentToken, "Expected ')' after expression in parentheses.");
+            }
+            advanceToken();
+            levels.pop_back(); // value is now a factor of the enclosing level
+        }
+    }
+}
+
+ExprId Parser::parseVariable() {
+    std::string_view name = lexer.lexeme(currentToken);
+    uint32_t slot;
+    if (deferredUses) {
+        slot = program->symbols.intern(name);
+        deferredUses->push_back(VariableUse{slot, static_cast<uint32_t>(program->statements.size()),
+                                            currentToken.line, currentToken.column});
+    } else {
+        slot = program->symbols.find(name);
+        if (slot == SymbolTable::NO_SLOT) {
+            throw undefinedVariable(name, currentToken.line, currentToken.column);
+        }
     }
+    advanceToken(); // Consume the name
+    return ExprArena::variable(slot);
 }
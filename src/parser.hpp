@@ -2,43 +2,140 @@
 
 #include "lexer.hpp"
 #include "ast.hpp"
+#include "parse_limits.hpp"
+#include <functional>
 #include <vector>
 #include <memory>
 #include <stdexcept> // For runtime_error
 
+// Custom exception for parsing errors
+class ParseError : public std::runtime_error {
+public:
+    ParseError(const std::string& message, int line, int column)
+        : std::runtime_error(message + " at line " + std::to_string(line) + ", column " + std::to_string(column)),
+          error_line(line), error_column(column) {}
+    
+    int getLine() const { return error_line; }
+    int getColumn() const { return error_column; }
+
+private:
+    int error_line;
+    int error_column;
+};
+
+
+//------------------------------------------------------------------------------
+// VariableUse: a variable reference, for checking it after the parse
+//------------------------------------------------------------------------------
+struct VariableUse {
+    uint32_t slot;      // In the target's symbol table
+    uint32_t statement; // Index the statement it is in has (or would have) in the target
+    int line;
+    int column;
+};
+
 //------------------------------------------------------------------------------
 // Parser Class
 //------------------------------------------------------------------------------
 class Parser {
 public:
-    // Constructor: takes a Lexer instance
-    Parser(Lexer& lexer);
+    // Called with every token the parser pulls from the lexer (except error
+    // tokens), e.g. to list the tokens without lexing the source twice.
+    using TokenObserver = std::function<void(const Token&)>;
+
+    // Constructor: takes a Lexer instance. Reads the first token, so it can
+    // already throw a LexError.
+    Parser(Lexer& lexer, TokenObserver observer = nullptr);
+
+    // Starts over on what the lexer holds now (after Lexer::reset()): reads
+    // the first token as the constructor does. The settings are kept.
+    void reset();
+
+    // Replaces the observer; set it before reset() to see the first token
+    void setTokenObserver(TokenObserver observer) { tokenObserver = std::move(observer); }
 
     // Main parsing method: returns the root of the AST (ProgramNode)
     std::unique_ptr<ProgramNode> parseProgram();
 
+    // Same, into target: its statements and nodes are replaced, but its
+    // vectors keep their capacity (for callers that parse many programs)
+    void parseProgramInto(ProgramNode& target);
+
+    // Parses a single statement, allocating its nodes in target's arena
+    // (IncrementalParser keeps one ProgramNode across edits)
+    StatementNode parseStatementInto(ProgramNode& target);
+
+    bool atEnd() const { return currentToken.type == TokenType::TOKEN_EOF; }
+
+    // Normally the ';' that ends a statement is consumed by reading the token
+    // after it. A caller that runs each statement as soon as it is parsed
+    // (StreamingInterpreter) cannot wait for that token: on a pipe it may not
+    // have been written yet. With a lazy statement end the ';' is only
+    // remembered, and the token after it is read by nextStatement() or by the
+    // next parse.
+    void setLazyStatementEnd(bool lazy) { lazyStatementEnd = lazy; }
+
+    // Reads what a lazy statement end left unread. Returns false at the end of
+    // the input.
+    bool nextStatement();
+
+    // Normally a variable must be defined by a LET before it is used, and
+    // using it earlier is a ParseError. When parsing a part of a source whose
+    // earlier parts are not known yet (parseProgramParallel,
+    // IncrementalParser), every name is interned when it is first seen
+    // instead, and every use is appended to uses for the caller to check.
+    // uses must outlive the parse; it keeps the uses of a statement that
+    // failed to parse too.
+    void deferVariableChecks(std::vector<VariableUse>& uses) { deferredUses = &uses; }
+
+    // Parentheses may be nested this deep; one more is a ParseError. Parsing
+    // and the engines use memory, not the machine stack, for nesting, so this
+    // only bounds what a single expression may cost.
+    static constexpr size_t DEFAULT_MAX_NESTING = ::DEFAULT_MAX_NESTING;
+    void setMaxNesting(size_t depth) { maxNesting = depth; }
+
+    // The error Parser reports for a use of name before it is defined
+    static ParseError undefinedVariable(std::string_view name, int line, int column);
+
 private:
     Lexer& lexer;
+    TokenObserver tokenObserver;
+    ProgramNode* program = nullptr; // Program being built; owns the node arena
+    std::vector<VariableUse>* deferredUses = nullptr;
     Token currentToken;
     Token previousToken; // Useful for error reporting on currentToken
+    bool lazyStatementEnd = false;
+    bool statementEndPending = false; // currentToken is a ';' that has been consumed
 
     // Helper methods for token handling
-    void advanceToken(); // Consumes currentToken and gets the next one
+    void advanceToken(); // Consumes currentToken and gets the next one; throws LexError on TOKEN_ERROR
     // Checks current token type and consumes it if it matches, otherwise throws error
     void consume(TokenType expectedType, const std::string& errorMessage);
     bool match(TokenType type); // Checks current token type without consuming
+    // consume() for the ';' that ends a statement (see setLazyStatementEnd())
+    void consumeStatementEnd(const std::string& errorMessage);
 
     // Parsing methods for different grammar rules
-    std::unique_ptr<StatementNode> parseStatement();
-    std::unique_ptr<PrintNode> parsePrintStatement();
+    StatementNode parseStatement();
+    StatementNode parsePrintStatement();
+    StatementNode parseLetStatement();
+    StatementNode parseInputStatement();
     
-    // Expression parsing (following precedence rules)
-    // Lowest precedence: addition and subtraction
-    std::unique_ptr<ExprNode> parseExpression(); 
-    // Next precedence: multiplication and division
-    std::unique_ptr<ExprNode> parseTerm();       
-    // Highest precedence: numbers, parenthesized expressions, unary operators (not in v0.1)
-    std::unique_ptr<ExprNode> parseFactor();     
+    // An open parenthesis in parseExpression(), or the whole expression: the
+    // left operand of a pending '+'/'-' and of a pending '*'/'/' (op 0: none)
+    struct Level {
+        ExprId sum = 0;
+        ExprId term = 0;
+        char sumOp = 0;
+        char termOp = 0;
+    };
+    std::vector<Level> levels; // Reused by every expression
+    size_t maxNesting = DEFAULT_MAX_NESTING;
+
+    // Expression parsing (following precedence rules), without recursion.
+    // Allocates the nodes in program->arena and returns the root id.
+    ExprId parseExpression();
+    ExprId parseVariable();
 
     // Error handling
     [[noreturn]] void error(const std::string& message) const;
@@ -46,17 +143,10 @@ private:
     [[noreturn]] void errorAt(const Token& token, const std::string& message) const;
 };
 
-// Custom exception for parsing errors
-class ParseError : public std::runtime_error {
+// Thrown when the lexer reports an error token. The message has the same
+// "Lexical Error: ..." form the driver has always printed for lexing errors.
+class LexError : public ParseError {
 public:
-    ParseError(const std::string& message, int line, int column)
-        : std::runtime_error(message + " at line " + std::to_string(line) + ", column " + std::to_string(column)),
-          error_line(line), error_column(column) {}
-    
-    int getLine() const { return error_line; }
-    int getColumn() const { return error_column; }
-
-private:
-    int error_line;
-    int error_column;
+    LexError(const std::string& message, int line, int column)
+        : ParseError("Lexical Error: " + message, line, column) {}
 };
@@ -0,0 +1,307 @@
+#include "program_cache.hpp"
+#include "source.hpp"
+#include <cstdio>     // For std::rename, std::remove, std::snprintf
+#include <cstring>    // For std::memcpy, std::memcmp, std::strncpy
+#include <filesystem> // For create_directories, equivalent
+#include <fstream>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h> // For getpid
+#define SIMLAN_HAVE_GETPID 1
+#else
+#define SIMLAN_HAVE_GETPID 0
+#endif
+
+#ifndef SIMLAN_VERSION
+#define SIMLAN_VERSION "unknown"
+#endif
+
+namespace {
+
+// Bump whenever the layout of the file or of the nodes changes
+constexpr uint32_t FORMAT_VERSION = 4;
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr char MAGIC[4] = {'S', 'I', 'M', 'C'};
+constexpr size_t VERSION_LENGTH = 16;
+
+struct Header {
+    char magic[4];
+    uint32_t formatVersion;
+    uint32_t byteOrder;      // BYTE_ORDER_MARK as the writer stored it
+    uint32_t optimizationLevel;
+    char compilerVersion[VERSION_LENGTH]; // SIMLAN_VERSION, zero padded
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint64_t maxNesting;
+    uint64_t numberCount;
+    uint64_t binaryCount;
+    uint64_t statementCount;
+    uint64_t variableCount;
+    uint64_t namesSize;      // Bytes of the variable names section
+};
+
+static_assert(sizeof(Header) == 96, "Header must have no padding");
+static_assert(std::is_trivially_copyable<NumberNode>::value &&
+              std::is_trivially_copyable<BinaryOpNode>::value &&
+              std::is_trivially_copyable<StatementNode>::value,
+              "Nodes are written and read as raw bytes");
+
+Header makeHeader(const CacheKey& key) {
+    Header header;
+    std::memset(&header, 0, sizeof header);
+    std::memcpy(header.magic, MAGIC, sizeof MAGIC);
+    header.formatVersion = FORMAT_VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.optimizationLevel = static_cast<uint32_t>(key.optimizationLevel);
+    std::strncpy(header.compilerVersion, SIMLAN_VERSION, VERSION_LENGTH - 1);
+    header.sourceHash = key.sourceHash;
+    header.sourceSize = key.sourceSize;
+    header.maxNesting = key.maxNesting;
+    return header;
+}
+
+// Writes records one by one with their padding zeroed, so that equal
+// programs give byte-identical files
+template <typename Node, typename Copy>
+void writeRecords(std::ostream& out, const std::vector<Node>& nodes, Copy copyFields) {
+    constexpr size_t BATCH = 4096;
+    std::vector<Node> batch(BATCH);
+    for (size_t first = 0; first < nodes.size(); first += BATCH) {
+        size_t count = nodes.size() - first < BATCH ? nodes.size() - first : BATCH;
+        std::memset(static_cast<void*>(batch.data()), 0, count * sizeof(Node));
+        for (size_t i = 0; i < count; ++i) {
+            copyFields(batch[i], nodes[first + i]);
+        }
+        out.write(reinterpret_cast<const char*>(batch.data()), static_cast<std::streamsize>(count * sizeof(Node)));
+    }
+}
+
+template <typename Node>
+void readRecords(const char* data, size_t count, std::vector<Node>& nodes) {
+    nodes.resize(count);
+    if (count > 0) {
+        std::memcpy(static_cast<void*>(nodes.data()), data, count * sizeof(Node));
+    }
+}
+
+} // namespace
+
+uint64_t hashSource(std::string_view source) {
+    constexpr uint64_t OFFSET_BASIS = 0xcbf29ce484222325ull;
+    constexpr uint64_t PRIME = 0x100000001b3ull;
+
+    uint64_t hash = OFFSET_BASIS;
+    const char* p = source.data();
+    size_t n = source.size();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, p + i, sizeof word);
+        hash = (hash ^ word) * PRIME;
+        hash ^= hash >> 32;
+    }
+    for (; i < n; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(p[i])) * PRIME;
+    }
+    return hash;
+}
+
+CacheKey CacheKey::of(std::string_view source, int optimizationLevel, size_t maxNesting) {
+    CacheKey key;
+    key.source = source;
+    key.sourceHash = hashSource(source);
+    key.sourceSize = source.size();
+    key.optimizationLevel = optimizationLevel;
+    key.maxNesting = maxNesting;
+    return key;
+}
+
+std::string cachePathFor(const std::string& sourcePath, const std::string& cacheDir, const CacheKey& key) {
+    if (!cacheDir.empty()) {
+        char name[96];
+        std::snprintf(name, sizeof name, "%016llx-%llx-O%d-n%llu.simc",
+                      static_cast<unsigned long long>(key.sourceHash),
+                      static_cast<unsigned long long>(key.sourceSize), key.optimizationLevel,
+                      static_cast<unsigned long long>(key.maxNesting));
+        std::string path = cacheDir;
+        if (path.back() != '/') {
+            path += '/';
+        }
+        return path + name;
+    }
+
+    // Appended rather than replacing the extension, so that no source name
+    // (prog.simc included) maps to itself
+    return sourcePath + ".simc";
+}
+
+bool isSameFile(const std::string& path, const std::string& sourcePath) {
+    std::error_code ec;
+    return std::filesystem::equivalent(path, sourcePath, ec);
+}
+
+std::unique_ptr<ProgramNode> loadProgramCache(const std::string& path, const CacheKey& key) {
+    SourceFile file;
+    std::string error;
+    if (!file.open(path, error)) {
+        return nullptr;
+    }
+    std::string_view data = file.text();
+    if (data.size() < sizeof(Header)) {
+        return nullptr;
+    }
+
+    Header header;
+    std::memcpy(&header, data.data(), sizeof header);
+    Header expected = makeHeader(key);
+    if (std::memcmp(header.magic, expected.magic, sizeof MAGIC) != 0 ||
+        header.formatVersion != expected.formatVersion ||
+        header.byteOrder != expected.byteOrder ||
+        header.optimizationLevel != expected.optimizationLevel ||
+        std::memcmp(header.compilerVersion, expected.compilerVersion, VERSION_LENGTH) != 0 ||
+        header.sourceHash != expected.sourceHash ||
+        header.sourceSize != expected.sourceSize ||
+        header.maxNesting != expected.maxNesting) {
+        return nullptr; // Stale, or not a cache file at all
+    }
+
+    // The node arrays must fill the rest of the file exactly
+    uint64_t limit = static_cast<uint64_t>(EXPR_INDEX_MASK) + 1;
+    if (header.numberCount > limit || header.binaryCount > limit || header.statementCount > data.size()) {
+        return nullptr;
+    }
+    if (header.variableCount > limit || header.namesSize > data.size()) {
+        return nullptr;
+    }
+    uint64_t expectedSize = sizeof(Header) + header.numberCount * sizeof(NumberNode) +
+                            header.binaryCount * sizeof(BinaryOpNode) +
+                            header.statementCount * sizeof(StatementNode) + header.namesSize +
+                            header.sourceSize;
+    if (expectedSize != data.size()) {
+        return nullptr;
+    }
+
+    // The hash can collide; only the source itself proves it is the same
+    std::string_view storedSource = data.substr(data.size() - key.source.size());
+    if (storedSource != key.source) {
+        return nullptr;
+    }
+
+    auto program = std::make_unique<ProgramNode>();
+    ExprArena& arena = program->arena;
+    const char* p = data.data() + sizeof(Header);
+    readRecords(p, static_cast<size_t>(header.numberCount), arena.numbers);
+    p += header.numberCount * sizeof(NumberNode);
+    readRecords(p, static_cast<size_t>(header.binaryCount), arena.binaries);
+    p += header.binaryCount * sizeof(BinaryOpNode);
+    readRecords(p, static_cast<size_t>(header.statementCount), program->statements);
+    p += header.statementCount * sizeof(StatementNode);
+
+    // Names in slot order, each ended by '\0'; interning them again must give
+    // back the same slots
+    std::string_view names(p, static_cast<size_t>(header.namesSize));
+    while (!names.empty()) {
+        size_t end = names.find('\0');
+        if (end == 0 || end == std::string_view::npos ||
+            program->symbols.intern(names.substr(0, end)) != program->symbols.size() - 1) {
+            return nullptr;
+        }
+        names.remove_prefix(end + 1);
+    }
+    if (program->symbols.size() != header.variableCount) {
+        return nullptr;
+    }
+
+    // Every id must name an existing node or variable, and a binary node may
+    // only refer to binary nodes before it (as the parser builds them), so
+    // there are no cycles for evaluation to follow
+    size_t numbers = arena.numbers.size();
+    size_t variables = program->symbols.size();
+    auto isValid = [numbers, variables](ExprId id, size_t binaryLimit) {
+        if (ExprArena::isVariable(id)) {
+            return !ExprArena::isBinary(id) && ExprArena::indexOf(id) < variables;
+        }
+        return ExprArena::isBinary(id) ? ExprArena::indexOf(id) < binaryLimit : id < numbers;
+    };
+    for (size_t i = 0; i < arena.binaries.size(); ++i) {
+        const BinaryOpNode& node = arena.binaries[i];
+        bool knownOp = node.op == '+' || node.op == '-' || node.op == '*' || node.op == '/';
+        if (!knownOp || !isValid(node.left, i) || !isValid(node.right, i)) {
+            return nullptr;
+        }
+    }
+    for (const StatementNode& stmt : program->statements) {
+        bool knownKind = (stmt.kind == StatementKind::Print && stmt.slot == 0) ||
+                         (stmt.kind == StatementKind::Let && stmt.slot < variables) ||
+                         (stmt.kind == StatementKind::Input && stmt.expression == ExprArena::variable(stmt.slot) &&
+                          stmt.slot < variables);
+        if (!knownKind || !isValid(stmt.expression, arena.binaries.size())) {
+            return nullptr;
+        }
+    }
+    return program;
+}
+
+bool saveProgramCache(const std::string& path, const CacheKey& key, const ProgramNode& program, std::string& error) {
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    Header header = makeHeader(key);
+    header.numberCount = program.arena.numbers.size();
+    header.binaryCount = program.arena.binaries.size();
+    header.statementCount = program.statements.size();
+    std::string names;
+    for (size_t slot = 0; slot < program.symbols.size(); ++slot) {
+        names += program.symbols.name(static_cast<uint32_t>(slot));
+        names += '\0';
+    }
+    header.variableCount = program.symbols.size();
+    header.namesSize = names.size();
+
+    std::string tempPath = path + ".tmp";
+#if SIMLAN_HAVE_GETPID
+    tempPath += std::to_string(static_cast<long>(getpid()));
+#endif
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (out) {
+        out.write(reinterpret_cast<const char*>(&header), sizeof header);
+        writeRecords(out, program.arena.numbers, [](NumberNode& to, const NumberNode& from) {
+            to.value = from.value;
+        });
+        writeRecords(out, program.arena.binaries, [](BinaryOpNode& to, const BinaryOpNode& from) {
+            to.op = from.op;
+            to.left = from.left;
+            to.right = from.right;
+        });
+        writeRecords(out, program.statements, [](StatementNode& to, const StatementNode& from) {
+            to.kind = from.kind;
+            to.slot = from.slot;
+            to.expression = from.expression;
+        });
+        out.write(names.data(), static_cast<std::streamsize>(names.size()));
+        out.write(key.source.data(), static_cast<std::streamsize>(key.source.size()));
+        out.close();
+    }
+    if (!out) {
+        std::remove(tempPath.c_str());
+        error = "Could not write cache file: " + tempPath;
+        return false;
+    }
+
+    // rename() replaces the old file atomically on POSIX; elsewhere it may
+    // refuse to overwrite, so retry once without it
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(path.c_str());
+        if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            error = "Could not write cache file: " + path;
+            return false;
+        }
+    }
+    return true;
+}
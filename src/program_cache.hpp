@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ast.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+//------------------------------------------------------------------------------
+// Program cache (.simc files)
+//------------------------------------------------------------------------------
+// A .simc file holds a parsed (and, with -O1, optimized) program, so that a
+// later run of the same source can skip the Lexer and the Parser. It is the
+// node arena written out as is:
+//
+//   header   magic "SIMC", format version, byte order, simlanc version,
+//            optimization level, source size and hash, nesting limit,
+//            node counts
+//   numbers  NumberNode[numberCount]
+//   binaries BinaryOpNode[binaryCount] (padding zeroed)
+//   program  StatementNode[statementCount]
+//   names    the variable names in slot order, each followed by a '\0'
+//   source   the source bytes the program was built from
+//
+// A cache file is only used if it was written from the same source bytes, by
+// the same simlanc version with the same optimization level and nesting
+// limit (--max-nesting), on a host with the same byte order; anything else,
+// including a truncated file, is a miss. The hash only names and pre-checks
+// the file: two sources with the same hash are told apart by comparing the
+// stored source with the one being run, byte for byte. Loading checks every
+// node id, so a damaged file cannot make evaluation read outside the arena
+// or loop.
+
+// What a cache file must have been built from
+struct CacheKey {
+    std::string_view source; // Not owned; stored in the file and compared on load
+    uint64_t sourceHash = 0;
+    uint64_t sourceSize = 0;
+    int optimizationLevel = 0;
+    uint64_t maxNesting = 0; // A program parsed under one limit may break another
+
+    static CacheKey of(std::string_view source, int optimizationLevel, size_t maxNesting);
+};
+
+// 64-bit FNV-1a style hash, taken over 8-byte words rather than single bytes
+// so that hashing runs well ahead of lexing. Each step also folds the high
+// half back down, since a multiply only carries bits upwards. It is not
+// collision resistant (sources can be built to collide), so a matching hash
+// never stands in for the source itself.
+uint64_t hashSource(std::string_view source);
+
+// Where the cache of sourcePath lives: next to it, with ".simc" appended to
+// the file name (demo.simlan -> demo.simlan.simc), or, if cacheDir is not
+// empty, in cacheDir under a name made from the key (content-addressed).
+std::string cachePathFor(const std::string& sourcePath, const std::string& cacheDir, const CacheKey& key);
+
+// True if path is the file sourcePath, under any name (e.g. a link to it).
+// A cache at such a path would overwrite the source, so it is not used.
+bool isSameFile(const std::string& path, const std::string& sourcePath);
+
+// Maps and checks the cache file at path. Returns null if there is none or
+// it does not match key or is damaged. The records are copied out of the
+// mapping into the ProgramNode's arena, which every engine and pass works
+// on; the copy is what was checked, so the file changing afterwards cannot
+// reach the run. It costs next to nothing beside the checks themselves.
+std::unique_ptr<ProgramNode> loadProgramCache(const std::string& path, const CacheKey& key);
+
+// Writes program as the cache for key. The file is written under a
+// temporary name and renamed into place, so a concurrent run never sees half
+// of it. Returns false and sets error on failure.
+bool saveProgramCache(const std::string& path, const CacheKey& key, const ProgramNode& program, std::string& error);
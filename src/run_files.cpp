@@ -0,0 +1,149 @@
+#include "run_files.hpp"
+#include "source.hpp"
+#include "thread_pool.hpp"
+#include <algorithm> // For std::min
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+
+namespace {
+
+constexpr size_t FILES_PER_TASK = 16;
+constexpr size_t TASKS_PER_WORKER = 4;
+
+// Appends everything written to it to text
+class StringBuffer : public std::streambuf {
+public:
+    std::string text;
+
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize count) override {
+        text.append(data, static_cast<size_t>(count));
+        return count;
+    }
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            text += traits_type::to_char_type(c);
+        }
+        return traits_type::not_eof(c);
+    }
+};
+
+struct FileResult {
+    std::string output;
+    std::string error;
+    int status = 0;
+};
+
+// One task's state, kept from round to round
+struct Worker {
+    explicit Worker(const RunOptions& options)
+        : runner(options), stream(&buffer), sink(stream, options.numberFormat) {}
+
+    ScriptRunner runner;
+    SourceFile source;
+    StringBuffer buffer;
+    std::ostream stream;
+    OutputSink sink;
+    std::vector<FileResult> results;
+
+    void run(const std::string& path, FileResult& result) {
+        try {
+            std::string openError;
+            if (!source.open(path, openError)) {
+                result.error = "Error: " + openError + "\n";
+                result.status = 1;
+            } else {
+                result.status = runner.run(source.text(), sink, result.error);
+            }
+        } catch (const std::exception& e) {
+            result.error = std::string("An unexpected error occurred: ") + e.what() + "\n";
+            result.status = 1;
+        }
+        // The buffers trade places, so both keep their capacity
+        result.output.swap(buffer.text);
+        buffer.text.clear();
+    }
+};
+
+} // namespace
+
+size_t runFiles(const std::vector<std::string>& paths, const RunOptions& options, OutputSink& out,
+                std::ostream& err, ThreadPool* pool) {
+    size_t taskCount = pool ? pool->size() * TASKS_PER_WORKER : 1;
+    std::vector<std::unique_ptr<Worker>> workers;
+    size_t failed = 0;
+    for (size_t first = 0; first < paths.size(); first += taskCount * FILES_PER_TASK) {
+        size_t end = std::min(paths.size(), first + taskCount * FILES_PER_TASK);
+        size_t tasks = (end - first + FILES_PER_TASK - 1) / FILES_PER_TASK;
+        while (workers.size() < tasks) {
+            workers.push_back(std::make_unique<Worker>(options));
+        }
+
+        auto runTask = [&](size_t task) {
+            Worker& worker = *workers[task];
+            size_t begin = first + task * FILES_PER_TASK;
+            size_t count = std::min(FILES_PER_TASK, end - begin);
+            worker.results.resize(count);
+            for (size_t i = 0; i < count; ++i) {
+                worker.run(paths[begin + i], worker.results[i]);
+            }
+        };
+        if (pool && tasks > 1) {
+            pool->parallelFor(tasks, runTask);
+        } else {
+            for (size_t task = 0; task < tasks; ++task) {
+                runTask(task);
+            }
+        }
+
+        for (size_t task = 0; task < tasks; ++task) {
+            const std::vector<FileResult>& results = workers[task]->results;
+            for (size_t i = 0; i < results.size(); ++i) {
+                const std::string& path = paths[first + task * FILES_PER_TASK + i];
+                out.write("==> ");
+                out.write(path);
+                out.write(" <==\n");
+                out.write(results[i].output);
+                if (!results[i].error.empty()) {
+                    out.flush(); // The error follows the output, as on a terminal
+                    err << path << ": " << results[i].error << std::flush;
+                }
+                if (results[i].status != 0) {
+                    failed++;
+                }
+            }
+        }
+    }
+    out.flush();
+    return failed;
+}
+
+bool readManifest(const std::string& path, std::vector<std::string>& paths, std::string& error) {
+    std::ifstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file.is_open()) {
+            error = "Could not open manifest: " + path;
+            return false;
+        }
+    }
+    std::istream& in = path == "-" ? std::cin : file;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        paths.push_back(line);
+    }
+    if (in.bad()) {
+        error = "Could not read manifest: " + path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "script_runner.hpp"
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+//------------------------------------------------------------------------------
+// Many programs in one process (simlanc a.simlan b.simlan ..., --manifest)
+//------------------------------------------------------------------------------
+// Runs every file of paths as simlanc would run it on its own. For each path,
+// in the order given, out gets a "==> path <==" line followed by the
+// program's output, and err gets the error message simlanc would print,
+// prefixed with "path: ", after everything out got before it.
+//
+// With a pool, files are run in rounds: each of pool->size() * 4 tasks runs
+// 16 consecutive files into its own buffers, and the round's results are
+// written in file order before the next round starts, so the output does not
+// depend on the number of threads. Every task keeps its ScriptRunner and
+// buffers from round to round.
+//
+// Returns the number of files that failed (could not be read, or whose
+// program failed).
+size_t runFiles(const std::vector<std::string>& paths, const RunOptions& options, OutputSink& out,
+                std::ostream& err, ThreadPool* pool = nullptr);
+
+// Appends the paths listed in the manifest file at path ("-" for stdin), one
+// per line; blank lines and lines starting with '#' are skipped. Returns
+// false and sets error if the file cannot be read.
+bool readManifest(const std::string& path, std::vector<std::string>& paths, std::string& error);
@@ -0,0 +1,285 @@
+#include "scan.hpp"
+#include <cstring> // For std::memchr
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SIMLAN_SCAN_X86 1
+#include <immintrin.h>
+#else
+#define SIMLAN_SCAN_X86 0
+#endif
+
+namespace scan {
+
+namespace {
+
+inline bool isWhitespace(unsigned char c) {
+    return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+}
+
+inline bool isDigit(unsigned char c) {
+    return static_cast<unsigned char>(c - '0') <= 9;
+}
+
+//------------------------------------------------------------------------------
+// Scalar kernels (also used for the tails of the vector kernels)
+//------------------------------------------------------------------------------
+WhitespaceRun whitespaceScalar(const char* p, const char* end, WhitespaceRun run = {0, 0, 0}) {
+    const char* start = p - run.length;
+    while (p < end && isWhitespace(static_cast<unsigned char>(*p))) {
+        if (*p == '\n') {
+            run.newlines++;
+            run.afterNewline = static_cast<size_t>(p - start) + 1;
+        }
+        p++;
+    }
+    run.length = static_cast<size_t>(p - start);
+    return run;
+}
+
+size_t digitsScalar(const char* p, const char* end, size_t count = 0) {
+    while (p + count < end && isDigit(static_cast<unsigned char>(p[count]))) {
+        count++;
+    }
+    return count;
+}
+
+#if SIMLAN_SCAN_X86
+
+//------------------------------------------------------------------------------
+// SSE2 kernels
+//------------------------------------------------------------------------------
+// Whitespace is ' ' or a byte in '\t'..'\r'; digits are '0'..'9'. Both range
+// tests use the unsigned-min trick: x <= k  <=>  min(x, k) == x.
+__attribute__((target("sse2")))
+WhitespaceRun whitespaceSSE2(const char* p, const char* end) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i span = _mm_set1_epi8('\r' - '\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    WhitespaceRun run = {0, 0, 0};
+    while (end - (p + run.length) >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + run.length));
+        __m128i shifted = _mm_sub_epi8(v, tab);
+        __m128i inRange = _mm_cmpeq_epi8(_mm_min_epu8(shifted, span), shifted);
+        __m128i ws = _mm_or_si128(inRange, _mm_cmpeq_epi8(v, space));
+        unsigned wsMask = static_cast<unsigned>(_mm_movemask_epi8(ws));
+        unsigned nlMask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)));
+
+        unsigned stop = ~wsMask & 0xFFFFu;
+        unsigned width = stop ? static_cast<unsigned>(__builtin_ctz(stop)) : 16u;
+        if (width < 16) {
+            nlMask &= (1u << width) - 1;
+        }
+        if (nlMask) {
+            run.newlines += static_cast<size_t>(__builtin_popcount(nlMask));
+            run.afterNewline = run.length + (31 - static_cast<unsigned>(__builtin_clz(nlMask))) + 1;
+        }
+        run.length += width;
+        if (width < 16) {
+            return run;
+        }
+    }
+    return whitespaceScalar(p + run.length, end, run);
+}
+
+__attribute__((target("sse2")))
+size_t digitsSSE2(const char* p, const char* end) {
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+
+    size_t count = 0;
+    while (end - (p + count) >= 16) {
+        __m128i v = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + count)), zero);
+        __m128i isDigitMask = _mm_cmpeq_epi8(_mm_min_epu8(v, nine), v);
+        unsigned stop = ~static_cast<unsigned>(_mm_movemask_epi8(isDigitMask)) & 0xFFFFu;
+        if (stop) {
+            return count + static_cast<size_t>(__builtin_ctz(stop));
+        }
+        count += 16;
+    }
+    return digitsScalar(p, end, count);
+}
+
+//------------------------------------------------------------------------------
+// AVX2 kernels (same logic, 32 bytes per step)
+//------------------------------------------------------------------------------
+__attribute__((target("avx2")))
+WhitespaceRun whitespaceAVX2(const char* p, const char* end) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i span = _mm256_set1_epi8('\r' - '\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+
+    WhitespaceRun run = {0, 0, 0};
+    while (end - (p + run.length) >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + run.length));
+        __m256i shifted = _mm256_sub_epi8(v, tab);
+        __m256i inRange = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, span), shifted);
+        __m256i ws = _mm256_or_si256(inRange, _mm256_cmpeq_epi8(v, space));
+        unsigned wsMask = static_cast<unsigned>(_mm256_movemask_epi8(ws));
+        unsigned nlMask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)));
+
+        unsigned stop = ~wsMask;
+        unsigned width = stop ? static_cast<unsigned>(__builtin_ctz(stop)) : 32u;
+        if (width < 32) {
+            nlMask &= (1u << width) - 1;
+        }
+        if (nlMask) {
+            run.newlines += static_cast<size_t>(__builtin_popcount(nlMask));
+            run.afterNewline = run.length + (31 - static_cast<unsigned>(__builtin_clz(nlMask))) + 1;
+        }
+        run.length += width;
+        if (width < 32) {
+            return run;
+        }
+    }
+    return whitespaceScalar(p + run.length, end, run);
+}
+
+__attribute__((target("avx2")))
+size_t digitsAVX2(const char* p, const char* end) {
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i nine = _mm256_set1_epi8(9);
+
+    size_t count = 0;
+    while (end - (p + count) >= 32) {
+        __m256i v = _mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + count)), zero);
+        __m256i isDigitMask = _mm256_cmpeq_epi8(_mm256_min_epu8(v, nine), v);
+        unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(isDigitMask));
+        if (stop) {
+            return count + static_cast<size_t>(__builtin_ctz(stop));
+        }
+        count += 32;
+    }
+    return digitsScalar(p, end, count);
+}
+
+__attribute__((target("sse2")))
+size_t countNewlinesSSE2(const char* p, const char* end) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t count = 0;
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        count += static_cast<size_t>(__builtin_popcount(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)))));
+    }
+    for (; p < end; ++p) {
+        count += *p == '\n';
+    }
+    return count;
+}
+
+__attribute__((target("avx2")))
+size_t countNewlinesAVX2(const char* p, const char* end) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        count += static_cast<size_t>(__builtin_popcount(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)))));
+    }
+    for (; p < end; ++p) {
+        count += *p == '\n';
+    }
+    return count;
+}
+
+#endif // SIMLAN_SCAN_X86
+
+//------------------------------------------------------------------------------
+// Dispatch
+//------------------------------------------------------------------------------
+Isa bestIsa() {
+#if SIMLAN_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Isa::AVX2;
+    if (__builtin_cpu_supports("sse2")) return Isa::SSE2;
+#endif
+    return Isa::Scalar;
+}
+
+// Chosen once; setIsa() may override it before lexing starts
+Isa& currentIsa() {
+    static Isa isa = bestIsa();
+    return isa;
+}
+
+} // namespace
+
+WhitespaceRun whitespace(const char* p, const char* end) {
+    // Most runs between tokens are a single space; settle those without
+    // setting up a vector loop.
+    if (p == end || !isWhitespace(static_cast<unsigned char>(*p))) {
+        return WhitespaceRun{0, 0, 0};
+    }
+    if (p + 1 == end || !isWhitespace(static_cast<unsigned char>(p[1]))) {
+        return WhitespaceRun{1, *p == '\n' ? 1u : 0u, *p == '\n' ? 1u : 0u};
+    }
+#if SIMLAN_SCAN_X86
+    switch (currentIsa()) {
+        case Isa::AVX2: return whitespaceAVX2(p, end);
+        case Isa::SSE2: return whitespaceSSE2(p, end);
+        case Isa::Scalar: break;
+    }
+#endif
+    return whitespaceScalar(p, end);
+}
+
+size_t digits(const char* p, const char* end) {
+#if SIMLAN_SCAN_X86
+    switch (currentIsa()) {
+        case Isa::AVX2: return digitsAVX2(p, end);
+        case Isa::SSE2: return digitsSSE2(p, end);
+        case Isa::Scalar: break;
+    }
+#endif
+    return digitsScalar(p, end);
+}
+
+size_t findNewline(const char* p, const char* end) {
+    // memchr is already vectorized (and CPU-dispatched) by the C library
+    const void* hit = std::memchr(p, '\n', static_cast<size_t>(end - p));
+    return hit ? static_cast<size_t>(static_cast<const char*>(hit) - p) : static_cast<size_t>(end - p);
+}
+
+size_t countNewlines(const char* p, const char* end) {
+#if SIMLAN_SCAN_X86
+    switch (currentIsa()) {
+        case Isa::AVX2: return countNewlinesAVX2(p, end);
+        case Isa::SSE2: return countNewlinesSSE2(p, end);
+        case Isa::Scalar: break;
+    }
+#endif
+    size_t count = 0;
+    for (; p < end; ++p) {
+        count += *p == '\n';
+    }
+    return count;
+}
+
+bool isSupported(Isa isa) {
+    switch (isa) {
+        case Isa::Scalar: return true;
+        case Isa::SSE2: return bestIsa() != Isa::Scalar;
+        case Isa::AVX2: return bestIsa() == Isa::AVX2;
+    }
+    return false;
+}
+
+Isa activeIsa() {
+    return currentIsa();
+}
+
+void setIsa(Isa isa) {
+    currentIsa() = isSupported(isa) ? isa : bestIsa();
+}
+
+const char* isaName(Isa isa) {
+    switch (isa) {
+        case Isa::Scalar: return "scalar";
+        case Isa::SSE2:   return "sse2";
+        case Isa::AVX2:   return "avx2";
+    }
+    return "unknown";
+}
+
+} // namespace scan
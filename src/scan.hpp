@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+
+//------------------------------------------------------------------------------
+// Byte-scanning kernels used by the Lexer
+//------------------------------------------------------------------------------
+// Each kernel has a scalar, an SSE2 and an AVX2 version; the best one the CPU
+// supports is picked the first time a kernel is used. All of them only read
+// bytes in [p, end).
+namespace scan {
+
+enum class Isa {
+    Scalar,
+    SSE2,   // 16 bytes per step
+    AVX2    // 32 bytes per step
+};
+
+// A run of whitespace (' ', '\t', '\n', '\v', '\f', '\r', as std::isspace in
+// the "C" locale)
+struct WhitespaceRun {
+    size_t length;          // Bytes of whitespace at the start of the range
+    size_t newlines;        // Number of '\n' among them
+    size_t afterNewline;    // Offset just past the last '\n', if newlines > 0
+};
+
+WhitespaceRun whitespace(const char* p, const char* end);
+
+// Number of ASCII digits at the start of the range
+size_t digits(const char* p, const char* end);
+
+// Offset of the first '\n' in the range, or end - p if there is none
+size_t findNewline(const char* p, const char* end);
+
+// Number of '\n' in the range
+size_t countNewlines(const char* p, const char* end);
+
+// The implementation in use, and a way to force one (e.g. for benchmarks).
+// Requests for an ISA the CPU lacks fall back to the best supported one.
+Isa activeIsa();
+void setIsa(Isa isa);
+bool isSupported(Isa isa);
+const char* isaName(Isa isa);
+
+} // namespace scan
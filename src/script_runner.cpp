@@ -0,0 +1,19 @@
+#include "script_runner.hpp"
+
+int ScriptRunner::run(std::string_view source, OutputSink& output, std::string& error) {
+    error.clear();
+    if (source.empty()) {
+        return 1; // Nothing to compile
+    }
+    simlan::Error failure;
+    const simlan::Program* program = context.compile(source, options, failure);
+    if (program) {
+        failure = context.run(*program, output);
+    }
+    output.flush(); // Output before the error goes first, as on a terminal
+    if (failure) {
+        error = failure.message + '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "output.hpp"
+#include "simlan.hpp"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+//------------------------------------------------------------------------------
+// ScriptRunner: runs one program after another, as simlanc runs a file
+//------------------------------------------------------------------------------
+// For callers that run many small programs in one process (--serve, several
+// files on the command line). Each program is compiled and run once in the
+// runner's simlan::CompileContext, so the lexer, the node arena and the VM's
+// value stack are kept from one program to the next and, after the first few
+// programs, running one allocates little beyond its own nodes. The runner
+// only adds what simlanc does around that: an empty source fails, and the
+// error message is the line simlanc would print. A runner is used by one
+// thread at a time.
+struct RunOptions : simlan::CompileOptions {
+    NumberFormat numberFormat = NumberFormat::Shortest;
+};
+
+class ScriptRunner {
+public:
+    explicit ScriptRunner(const RunOptions& options) : options(options) {}
+
+    // Compiles and runs source with the engine of options, printing to
+    // output, which is flushed before returning. Returns the exit status
+    // simlanc would have for the file; on failure, error is set to the
+    // message it would print (with its newline), else cleared. An empty
+    // source fails without a message.
+    int run(std::string_view source, OutputSink& output, std::string& error);
+
+private:
+    const RunOptions& options;
+    simlan::CompileContext context;
+};
@@ -0,0 +1,329 @@
+#include "serve.hpp"
+#include "script_runner.hpp"
+#include "thread_pool.hpp"
+#include <algorithm> // For std::min
+#include <atomic>
+#include <cstring>   // For std::memcpy, std::strerror
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SIMLAN_HAVE_SOCKETS 1
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#else
+#define SIMLAN_HAVE_SOCKETS 0
+#endif
+
+#if SIMLAN_HAVE_SOCKETS
+
+namespace {
+
+constexpr size_t MAX_REQUEST = size_t(1) << 30;
+constexpr size_t READ_BUFFER = 64 * 1024;
+
+//------------------------------------------------------------------------------
+// Connection: framed requests in, framed replies out
+//------------------------------------------------------------------------------
+class Connection {
+public:
+    enum class Request { Read, End, Malformed };
+
+    Connection(int inFd, int outFd) : inFd(inFd), outFd(outFd), input(new char[READ_BUFFER]) {}
+
+    // Reads the next request into script. End at a clean end of input (or
+    // one in the middle of a request, which has nobody to answer to).
+    Request readRequest(std::string& script) {
+        size_t length = 0;
+        size_t digits = 0;
+        while (true) {
+            if (inputStart == inputEnd && !fill()) {
+                return digits == 0 ? Request::End : Request::Malformed;
+            }
+            char c = input[inputStart++];
+            if (c == '\n' && digits > 0) {
+                break;
+            }
+            if (c < '0' || c > '9' || ++digits > 10) {
+                return Request::Malformed;
+            }
+            length = length * 10 + static_cast<size_t>(c - '0');
+        }
+        if (length > MAX_REQUEST) {
+            return Request::Malformed;
+        }
+
+        script.resize(length);
+        size_t have = 0;
+        while (have < length) {
+            if (inputStart == inputEnd && !fill()) {
+                return Request::End;
+            }
+            size_t n = std::min(length - have, inputEnd - inputStart);
+            std::memcpy(&script[have], input.get() + inputStart, n);
+            inputStart += n;
+            have += n;
+        }
+        return Request::Read;
+    }
+
+    // Sends "kind <length>\n" and payload; false once the peer is gone
+    bool send(std::string_view kind, std::string_view payload) {
+        std::string header(kind);
+        header += ' ';
+        header += std::to_string(payload.size());
+        header += '\n';
+        return writeAll(header) && writeAll(payload);
+    }
+
+    bool sendExit(int status) {
+        return writeAll("exit " + std::to_string(status) + "\n");
+    }
+
+    bool failed() const { return writeFailed; }
+
+private:
+    int inFd;
+    int outFd;
+    std::unique_ptr<char[]> input;
+    size_t inputStart = 0;
+    size_t inputEnd = 0;
+    bool writeFailed = false;
+
+    bool fill() {
+        while (true) {
+            ssize_t n = ::read(inFd, input.get(), READ_BUFFER);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            inputStart = 0;
+            inputEnd = static_cast<size_t>(n);
+            return true;
+        }
+    }
+
+    bool writeAll(std::string_view data) {
+        while (!data.empty() && !writeFailed) {
+            ssize_t n = ::write(outFd, data.data(), data.size());
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                writeFailed = true;
+                break;
+            }
+            data.remove_prefix(static_cast<size_t>(n));
+        }
+        return !writeFailed;
+    }
+};
+
+// Turns what an OutputSink flushes into "out" frames
+class FrameBuffer : public std::streambuf {
+public:
+    explicit FrameBuffer(Connection& connection) : connection(connection) {}
+
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize count) override {
+        return connection.send("out", std::string_view(data, static_cast<size_t>(count))) ? count : 0;
+    }
+    int_type overflow(int_type c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+        char ch = traits_type::to_char_type(c);
+        return connection.send("out", std::string_view(&ch, 1)) ? c : traits_type::eof();
+    }
+
+private:
+    Connection& connection;
+};
+
+//------------------------------------------------------------------------------
+// Session: one worker's state, kept across programs and clients
+//------------------------------------------------------------------------------
+class Session {
+public:
+    explicit Session(const ServeOptions& options) : options(options), runner(options) {}
+
+    // Answers the requests of one client until it goes away
+    void serve(Connection& connection) {
+        FrameBuffer frames(connection);
+        std::ostream stream(&frames);
+        OutputSink output(stream, options.numberFormat);
+        while (!connection.failed()) {
+            Connection::Request request = connection.readRequest(script);
+            if (request == Connection::Request::End) {
+                break;
+            }
+            if (request == Connection::Request::Malformed) {
+                connection.send("err", "Error: Malformed request header\n");
+                connection.sendExit(1);
+                break;
+            }
+            int status = run(output, connection);
+            connection.sendExit(status);
+        }
+    }
+
+private:
+    const ServeOptions& options;
+    std::string script;  // Request buffer
+    std::string message; // Error of the latest program
+    ScriptRunner runner;
+
+    // Runs script like simlanc runs a file: same output, messages and status
+    int run(OutputSink& output, Connection& connection) {
+        int status = runner.run(script, output, message);
+        if (!message.empty()) {
+            connection.send("err", message);
+        }
+        return status;
+    }
+};
+
+// What the signal handler needs to stop the server: the listening socket,
+// and the client each worker is serving (-1 if none)
+struct StopState {
+    volatile sig_atomic_t requested = 0;
+    int listenFd = -1;
+    std::unique_ptr<std::atomic<int>[]> clients;
+    size_t workers = 0;
+};
+StopState stopState;
+
+extern "C" void handleStopSignal(int) {
+    stopState.requested = 1;
+    // Wakes every worker blocked in accept(), and ends the clients' input so
+    // that workers finish the request at hand and stop. shutdown() is
+    // async-signal-safe, and so are lock-free atomics.
+    ::shutdown(stopState.listenFd, SHUT_RDWR);
+    for (size_t i = 0; i < stopState.workers; ++i) {
+        int client = stopState.clients[i].load();
+        if (client >= 0) {
+            ::shutdown(client, SHUT_RD);
+        }
+    }
+}
+
+// True if path is a socket nobody listens on any more, left behind by a
+// server that was killed
+bool isStaleSocket(const std::string& path, const sockaddr* address, socklen_t length) {
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0 || !S_ISSOCK(info.st_mode)) {
+        return false;
+    }
+    int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        return false;
+    }
+    bool refused = ::connect(probe, address, length) != 0 && errno == ECONNREFUSED;
+    ::close(probe);
+    return refused;
+}
+
+int listenOn(const std::string& path, std::string& error) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof address.sun_path) {
+        error = "Socket path is too long: " + path;
+        return -1;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    const sockaddr* addr = reinterpret_cast<const sockaddr*>(&address);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        error = std::string("Could not create socket: ") + std::strerror(errno);
+        return -1;
+    }
+    int result = ::bind(fd, addr, sizeof address);
+    if (result != 0 && errno == EADDRINUSE) {
+        if (isStaleSocket(path, addr, sizeof address)) {
+            ::unlink(path.c_str());
+            result = ::bind(fd, addr, sizeof address);
+        } else {
+            errno = EADDRINUSE;
+        }
+    }
+    if (result == 0) {
+        result = ::listen(fd, SOMAXCONN);
+    }
+    if (result != 0) {
+        error = "Could not listen on '" + path + "': " + std::strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+bool serve(const std::string& socketPath, const ServeOptions& options, std::string& error) {
+    // A client that goes away must not take the server with it
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (socketPath.empty()) {
+        Connection connection(0, 1);
+        Session session(options);
+        session.serve(connection);
+        return true;
+    }
+
+    int fd = listenOn(socketPath, error);
+    if (fd < 0) {
+        return false;
+    }
+    stopState.listenFd = fd;
+    stopState.clients.reset(new std::atomic<int>[options.workers]);
+    for (size_t i = 0; i < options.workers; ++i) {
+        stopState.clients[i] = -1;
+    }
+    stopState.workers = options.workers;
+    std::signal(SIGINT, handleStopSignal);
+    std::signal(SIGTERM, handleStopSignal);
+
+    ThreadPool pool(options.workers);
+    pool.parallelFor(options.workers, [&](size_t worker) {
+        Session session(options);
+        while (!stopState.requested) {
+            int client = ::accept(fd, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                break; // Shut down, or the socket is unusable
+            }
+            stopState.clients[worker] = client;
+            if (!stopState.requested) {
+                try {
+                    Connection connection(client, client);
+                    session.serve(connection);
+                } catch (const std::exception&) {
+                    // Out of memory for this client: drop it and carry on
+                }
+            }
+            stopState.clients[worker] = -1;
+            ::close(client);
+        }
+    });
+
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    ::close(fd);
+    ::unlink(socketPath.c_str());
+    return true;
+}
+
+#else
+
+bool serve(const std::string&, const ServeOptions&, std::string& error) {
+    error = "--serve is not supported on this host";
+    return false;
+}
+
+#endif
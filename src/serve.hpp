@@ -0,0 +1,32 @@
+#pragma once
+
+#include "script_runner.hpp"
+#include <cstddef>
+#include <string>
+
+//------------------------------------------------------------------------------
+// Server mode (simlanc --serve)
+//------------------------------------------------------------------------------
+// Runs many programs in one process, so that each of them costs only its own
+// lexing, parsing and execution, not a process start. Requests and replies
+// are framed the same way on stdin/stdout and on a Unix domain socket:
+//
+//   request  "<length>\n" followed by <length> bytes of Simlan source
+//   reply    any number of "out <length>\n<bytes>" (program output, streamed
+//            as the output buffer fills) and "err <length>\n<bytes>" (the
+//            error message simlanc would print to stderr, with its newline),
+//            then "exit <status>\n" with simlanc's exit status for the program
+//
+// Requests on one connection are answered in order. On a socket, each
+// worker of a ThreadPool accepts and serves one client at a time, so up to
+// `workers` clients are served at once. Every worker keeps its node arena,
+// request buffer and output buffer from one program to the next.
+struct ServeOptions : RunOptions {
+    size_t workers = 1;         // Clients served at once on a socket
+};
+
+// Serves requests from stdin until it ends (socketPath empty), or clients of
+// a Unix domain socket created at socketPath until SIGINT or SIGTERM. A stale
+// socket file left at socketPath is replaced. Returns false and sets error if
+// the socket cannot be set up or server mode is not available on this host.
+bool serve(const std::string& socketPath, const ServeOptions& options, std::string& error);
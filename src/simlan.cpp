@@ -0,0 +1,308 @@
+#include "simlan.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "ast.hpp"
+#include "optimizer.hpp"
+#include "cse.hpp"
+#include "bytecode.hpp"
+#include "vm.hpp"
+#include "jit.hpp"
+#include "output.hpp"
+#include "parallel_parser.hpp"
+#include "program_cache.hpp"
+#include <stdexcept>
+
+namespace simlan {
+
+namespace {
+
+// Runs action and turns what it throws into an Error, with the message
+// simlanc prints for it
+template <typename Action>
+Error capture(Action&& action) {
+    Error error;
+    try {
+        action();
+    } catch (const LexError& e) {
+        error = Error{ErrorKind::Lexical, e.what(), e.getLine(), e.getColumn()};
+    } catch (const ParseError& e) {
+        error = Error{ErrorKind::Parse, std::string("Parse Error: ") + e.what(), e.getLine(), e.getColumn()};
+    } catch (const std::runtime_error& e) {
+        error = Error{ErrorKind::Runtime, std::string("Runtime Execution Error: ") + e.what()};
+    } catch (const std::exception& e) {
+        error = Error{ErrorKind::Runtime, std::string("An unexpected error occurred: ") + e.what()};
+    }
+    return error;
+}
+
+// Reports a phase to options.onPhase: started now, ended at stop() or at
+// the end of the scope, errors included
+class PhaseNotice {
+public:
+    PhaseNotice(const CompileOptions& options, const char* name) : options(options), name(name) {
+        if (options.onPhase) {
+            options.onPhase(name, true);
+        }
+    }
+    ~PhaseNotice() { stop(); }
+
+    PhaseNotice(const PhaseNotice&) = delete;
+    PhaseNotice& operator=(const PhaseNotice&) = delete;
+
+    void stop() {
+        if (!stopped && options.onPhase) {
+            options.onPhase(name, false);
+        }
+        stopped = true;
+    }
+
+private:
+    const CompileOptions& options;
+    const char* name;
+    bool stopped = false;
+};
+
+// The observer a Parser over lexer gets for options.onToken
+Parser::TokenObserver tokenObserver(const Lexer& lexer, const CompileOptions& options) {
+    if (!options.onToken && !options.tokenCounts) {
+        return nullptr;
+    }
+    return [&lexer, &options](const Token& token) {
+        if (options.tokenCounts) {
+            options.tokenCounts[static_cast<size_t>(token.type)]++;
+        }
+        if (options.onToken) {
+            options.onToken(token, lexer.lexeme(token));
+        }
+    };
+}
+
+// The tree to translate: loaded from the cache, or parsed, optimized and
+// saved to the cache. parse() parses serially and returns the tree; text is
+// the source when it is in memory (null for a stream).
+template <typename Parse>
+std::shared_ptr<const ProgramNode> buildTree(const std::string_view* text, const CompileOptions& options,
+                                             Parse&& parse) {
+    bool useCache = options.cache && text;
+    CacheKey cacheKey;
+    std::string cachePath;
+    if (useCache) {
+        PhaseNotice phase(options, "cache load");
+        cacheKey = CacheKey::of(*text, options.optimizationLevel, options.maxNesting);
+        cachePath = cachePathFor(options.sourcePath, options.cacheDir, cacheKey);
+        std::shared_ptr<const ProgramNode> loaded;
+        if (isSameFile(cachePath, options.sourcePath)) {
+            useCache = false;
+            if (options.onWarning) {
+                options.onWarning("Not caching: " + cachePath + " is the source file");
+            }
+        } else {
+            loaded = loadProgramCache(cachePath, cacheKey);
+        }
+        phase.stop();
+        if (loaded) {
+            if (options.onParsed) {
+                options.onParsed(*loaded, true);
+            }
+            if (options.onTree) {
+                options.onTree(*loaded, nullptr, nullptr);
+            }
+            return loaded;
+        }
+    }
+
+    PhaseNotice parsePhase(options, "parse");
+    std::shared_ptr<const ProgramNode> tree;
+    if (text && options.pool && !options.onToken) {
+        tree = parseProgramParallel(*text, *options.pool, options.maxNesting, options.tokenCounts);
+    } else {
+        tree = parse();
+    }
+    parsePhase.stop();
+    if (options.onParsed) {
+        options.onParsed(*tree, false);
+    }
+
+    Optimizer optimizer;
+    CommonSubexpressions cse;
+    if (options.optimizationLevel >= 1) {
+        PhaseNotice phase(options, "optimize");
+        tree = optimizer.optimize(*tree);
+        if (options.optimizationLevel >= 2) {
+            tree = cse.eliminate(*tree);
+        }
+    }
+
+    if (useCache) {
+        PhaseNotice phase(options, "cache save");
+        std::string error;
+        if (!saveProgramCache(cachePath, cacheKey, *tree, error) && options.onWarning) {
+            options.onWarning(error);
+        }
+    }
+    if (options.onTree) {
+        options.onTree(*tree, options.optimizationLevel >= 1 ? &optimizer : nullptr,
+                       options.optimizationLevel >= 2 ? &cse : nullptr);
+    }
+    return tree;
+}
+
+// Parses all of lexer's input into a new tree
+std::shared_ptr<ProgramNode> parseSource(Lexer& lexer, const CompileOptions& options) {
+    Parser parser(lexer, tokenObserver(lexer, options));
+    parser.setMaxNesting(options.maxNesting);
+    auto tree = std::make_shared<ProgramNode>();
+    parser.parseProgramInto(*tree);
+    return tree;
+}
+
+} // namespace
+
+bool engineFromName(std::string_view name, Engine& engine) {
+    if (name == "ast") {
+        engine = Engine::Ast;
+    } else if (name == "vm") {
+        engine = Engine::Vm;
+    } else if (name == "jit") {
+        engine = Engine::Jit;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+Program::Program() = default;
+Program::~Program() = default;
+
+std::shared_ptr<const Program> Program::compile(std::string_view source, const CompileOptions& options,
+                                                Error& error) {
+    std::shared_ptr<const Program> program;
+    error = capture([&] {
+        auto tree = buildTree(&source, options, [&] {
+            Lexer lexer(source);
+            return parseSource(lexer, options);
+        });
+        std::shared_ptr<Program> compiled(new Program());
+        compiled->build(std::move(tree), options);
+        program = std::move(compiled);
+    });
+    return program;
+}
+
+std::shared_ptr<const Program> Program::compile(InputStream& input, const CompileOptions& options, Error& error) {
+    std::shared_ptr<const Program> program;
+    error = capture([&] {
+        auto tree = buildTree(nullptr, options, [&] {
+            Lexer lexer(input);
+            return parseSource(lexer, options);
+        });
+        std::shared_ptr<Program> compiled(new Program());
+        compiled->build(std::move(tree), options);
+        program = std::move(compiled);
+    });
+    return program;
+}
+
+std::shared_ptr<const Program> Program::fromTree(std::shared_ptr<const ProgramNode> tree, Engine engine,
+                                                bool countOperators) {
+    CompileOptions options;
+    options.engine = engine;
+    options.countOperators = countOperators;
+    std::shared_ptr<Program> program(new Program());
+    program->build(std::move(tree), options);
+    return program;
+}
+
+void Program::build(std::shared_ptr<const ProgramNode> tree, const CompileOptions& options) {
+    root = std::move(tree);
+    selected = Engine::Ast;
+    inputs = root->hasInputs();
+    chunk.reset();
+    jit.reset();
+    if (options.engine != Engine::Ast && !inputs) {
+        PhaseNotice phase(options, "compile");
+        ::Compiler compiler;
+        auto compiled = std::make_unique<Chunk>(compiler.compile(*root));
+        if (options.engine == Engine::Vm) {
+            chunk = std::move(compiled);
+            selected = Engine::Vm;
+        } else {
+            auto native = std::make_unique<JIT>();
+            if (JIT::isSupported() && native->compile(*compiled, options.countOperators)) {
+                jit = std::move(native);
+                selected = Engine::Jit;
+            }
+        }
+    }
+}
+
+Error Program::run(OutputSink& out, OperatorCounts* counts) const {
+    return execute(out, nullptr, counts, nullptr);
+}
+
+Error Program::run(OutputSink& out, ThreadPool& pool, OperatorCounts* counts) const {
+    return execute(out, &pool, counts, nullptr);
+}
+
+Error Program::execute(OutputSink& out, ThreadPool* pool, OperatorCounts* counts, VM* vm) const {
+    if (inputs) {
+        return Error{ErrorKind::Unsupported, INPUT_STATEMENTS_ERROR};
+    }
+    // Everything a run changes is local to it: the variables, and the VM's
+    // stack unless the caller lends its own VM
+    return capture([&] {
+        switch (selected) {
+            case Engine::Vm:
+                if (vm) {
+                    vm->run(*chunk, out, counts);
+                } else {
+                    VM local;
+                    local.run(*chunk, out, counts);
+                }
+                break;
+            case Engine::Jit:
+                if (pool) {
+                    jit->run(out, *pool, counts);
+                } else {
+                    jit->run(out, counts);
+                }
+                break;
+            case Engine::Ast:
+                if (pool) {
+                    root->execute(out, *pool, counts);
+                } else {
+                    root->execute(out, counts);
+                }
+                break;
+        }
+    });
+}
+
+CompileContext::CompileContext()
+    : lexer(std::make_unique<Lexer>(std::string_view())), parser(std::make_unique<Parser>(*lexer)),
+      tree(std::make_shared<ProgramNode>()), program(new Program()), vm(std::make_unique<VM>()) {}
+
+CompileContext::~CompileContext() = default;
+
+const Program* CompileContext::compile(std::string_view source, const CompileOptions& options, Error& error) {
+    bool compiled = false;
+    error = capture([&] {
+        auto parsed = buildTree(&source, options, [&] {
+            lexer->reset(source);
+            parser->setTokenObserver(tokenObserver(*lexer, options));
+            parser->setMaxNesting(options.maxNesting);
+            parser->reset();
+            parser->parseProgramInto(*tree);
+            return tree;
+        });
+        program->build(std::move(parsed), options);
+        compiled = true;
+    });
+    return compiled ? program.get() : nullptr;
+}
+
+Error CompileContext::run(const Program& compiled, OutputSink& out, OperatorCounts* counts) {
+    return compiled.execute(out, nullptr, counts, vm.get());
+}
+
+} // namespace simlan
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "operator_counts.hpp"
+#include "parse_limits.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class OutputSink;   // output.hpp: where a run prints
+class ThreadPool;   // thread_pool.hpp
+class InputStream;  // source.hpp
+struct Token;       // lexer.hpp
+struct ProgramNode; // ast.hpp
+struct Chunk;       // bytecode.hpp
+class JIT;          // jit.hpp
+class Lexer;        // lexer.hpp
+class Parser;       // parser.hpp
+class VM;           // vm.hpp
+class Optimizer;            // optimizer.hpp
+class CommonSubexpressions; // cse.hpp
+
+//------------------------------------------------------------------------------
+// libsimlan: compile a program once, then run it any number of times
+//------------------------------------------------------------------------------
+// The interface of the simlan library, for services that embed Simlan and
+// for simlanc itself. A Program is compiled once (lexed, parsed, optimized
+// and, for the vm and jit engines, translated) and is immutable afterwards:
+// any number of threads may run the same Program at the same time, each
+// printing to its own OutputSink, and every run starts from fresh variables.
+// The library keeps no global state beyond the choice of SIMD kernels, made
+// once from what the CPU supports.
+//
+// A CompileContext compiles one program after another on one thread, for
+// services that run many short programs: its memory is reused from program
+// to program instead of being allocated again for each.
+//
+// Nothing is thrown across this interface; failures come back as Error
+// values, with the same message simlanc prints for them.
+namespace simlan {
+
+enum class ErrorKind : uint8_t {
+    None,
+    Lexical,    // A character or literal the Lexer rejects
+    Parse,      // A statement the Parser rejects
+    Runtime,    // Raised while running, e.g. a division by zero
+    Unsupported // INPUT statements, which only the batch evaluator runs
+};
+
+struct Error {
+    ErrorKind kind = ErrorKind::None;
+    std::string message; // As simlanc prints it, without the newline
+    int line = 0;        // Where a lexing or parse error is, from 1; 0 otherwise
+    int column = 0;
+
+    explicit operator bool() const { return kind != ErrorKind::None; }
+};
+
+// What run() returns (as an Unsupported error) for a program with INPUT
+// statements; simlanc prints the same line for one run without --batch
+constexpr const char* INPUT_STATEMENTS_ERROR = "Error: The program has INPUT statements; run it with --batch=FILE";
+
+// ast: the tree interpreter; vm: bytecode; jit: native x86-64 code, or the
+// tree interpreter where that is not available or the program too deep
+enum class Engine : uint8_t { Ast, Vm, Jit };
+
+// "ast", "vm" or "jit"; false for any other name
+bool engineFromName(std::string_view name, Engine& engine);
+
+// How deep parentheses may be nested by default (simlanc --max-nesting)
+constexpr size_t DEFAULT_MAX_NESTING = ::DEFAULT_MAX_NESTING;
+
+struct CompileOptions {
+    Engine engine = Engine::Ast;
+    int optimizationLevel = 0;  // simlanc -O0, -O1 or -O2
+    size_t maxNesting = DEFAULT_MAX_NESTING;
+    bool countOperators = false; // Lets run() count operators; the jit engine compiles extra code for it
+
+    // An in-memory source is parsed in chunks on pool, if there is one and
+    // onToken is empty (the tokens are then seen out of order)
+    ThreadPool* pool = nullptr;
+
+    // If set, TOKEN_TYPE_COUNT counters (lexer.hpp) indexed by TokenType: the
+    // tokens the parser reads are added to them as it reads them, by a
+    // parallel parse too. Nothing is lexed just to count.
+    uint64_t* tokenCounts = nullptr;
+
+    // Program cache (program_cache.hpp), for in-memory sources: the .simc
+    // file of sourcePath, or under cacheDir if it is not empty, is loaded
+    // instead of parsing and optimizing, and written afterwards if it was
+    // missing or stale
+    bool cache = false;
+    std::string sourcePath;
+    std::string cacheDir;
+
+    // Hooks for tools (simlanc's dumps, --stats), called on the compiling
+    // thread as compilation goes; empty ones cost nothing. They must not
+    // throw.
+    //   onPhase    a phase starts and ends: "cache load", "parse", "optimize",
+    //              "cache save", "compile" (vm and jit translation)
+    //   onToken    every token the parser reads, with its text
+    //   onParsed   the tree as parsed, or as loaded from the cache
+    //   onTree     the tree that will run, with the passes that made it
+    //              (null for those that did not run)
+    //   onWarning  a problem that does not stop compilation, e.g. a cache
+    //              file that could not be written
+    std::function<void(const char* phase, bool started)> onPhase;
+    std::function<void(const Token& token, std::string_view text)> onToken;
+    std::function<void(const ProgramNode& tree, bool fromCache)> onParsed;
+    std::function<void(const ProgramNode& tree, const Optimizer* optimizer, const CommonSubexpressions* cse)> onTree;
+    std::function<void(const std::string& message)> onWarning;
+};
+
+class Program {
+public:
+    // Compiles source. Returns null and sets error if it does not compile;
+    // otherwise error is cleared.
+    static std::shared_ptr<const Program> compile(std::string_view source, const CompileOptions& options,
+                                                  Error& error);
+
+    // Same, reading the source from input (a pipe, stdin) chunk by chunk
+    static std::shared_ptr<const Program> compile(InputStream& input, const CompileOptions& options, Error& error);
+
+    // A program from a tree that is already parsed and optimized (e.g. loaded
+    // from a program cache, or parsed on a thread pool)
+    static std::shared_ptr<const Program> fromTree(std::shared_ptr<const ProgramNode> tree, Engine engine,
+                                                   bool countOperators = false);
+
+    ~Program();
+
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+
+    // Runs the program once, printing to out. out is not flushed; do that
+    // before reporting the error, if any. With a pool, the statements are
+    // evaluated on it (ast and jit engines; vm runs on the calling thread).
+    // Output and errors do not depend on the pool. With counts, the binary
+    // operators evaluated are added to it (jit: if compiled with
+    // countOperators), up to and including one that fails.
+    Error run(OutputSink& out, OperatorCounts* counts = nullptr) const;
+    Error run(OutputSink& out, ThreadPool& pool, OperatorCounts* counts = nullptr) const;
+
+    // The engine run() uses: jit falls back to ast
+    Engine engine() const { return selected; }
+
+    // The compiled tree, for tools that dump or inspect it
+    const ProgramNode& tree() const { return *root; }
+
+    // INPUT statements; run() refuses such a program
+    bool hasInputs() const { return inputs; }
+
+private:
+    friend class CompileContext;
+
+    Program();
+
+    std::shared_ptr<const ProgramNode> root;
+    Engine selected = Engine::Ast;
+    bool inputs = false;
+    std::unique_ptr<Chunk> chunk;  // vm
+    std::unique_ptr<JIT> jit;      // jit
+
+    // Makes this the program of tree, replacing what it held
+    void build(std::shared_ptr<const ProgramNode> tree, const CompileOptions& options);
+    // vm: the VM to run on, or null for one of its own
+    Error execute(OutputSink& out, ThreadPool* pool, OperatorCounts* counts, VM* vm) const;
+};
+
+class CompileContext {
+public:
+    CompileContext();
+    ~CompileContext();
+
+    CompileContext(const CompileContext&) = delete;
+    CompileContext& operator=(const CompileContext&) = delete;
+
+    // Compiles source as Program::compile() does, into this context: the
+    // lexer, the parser and its node arena are those of the previous
+    // program, so once they have grown to fit they are not allocated again.
+    // The Program stays valid until the next compile() on this context.
+    // Returns null and sets error if source does not compile.
+    const Program* compile(std::string_view source, const CompileOptions& options, Error& error);
+
+    // program.run(out, counts), on this context's VM, whose value stack is
+    // likewise kept from run to run
+    Error run(const Program& program, OutputSink& out, OperatorCounts* counts = nullptr);
+
+private:
+    std::unique_ptr<Lexer> lexer;
+    std::unique_ptr<Parser> parser;
+    std::shared_ptr<ProgramNode> tree; // Parsed into by every compile()
+    std::unique_ptr<Program> program;
+    std::unique_ptr<VM> vm;
+};
+
+} // namespace simlan
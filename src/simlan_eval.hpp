@@ -0,0 +1,576 @@
+#pragma once
+
+#include "parser.hpp" // ParseError, LexError
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+//------------------------------------------------------------------------------
+// simlan::eval: a Simlan expression, evaluated at compile time
+//------------------------------------------------------------------------------
+// For C++ code that embeds fixed formulas: header-only, and every function is
+// constexpr, so
+//
+//     constexpr double rate = simlan::eval("2 * (3 + 4 / 2) - 1");
+//     static_assert(simlan::eval("7 / 2") == 3.5);
+//
+// costs nothing at run time. Called with a string that is only known at run
+// time, it evaluates it there, without allocating.
+//
+// The expression is lexed, parsed and evaluated as simlanc would PRINT it:
+// numbers are rounded to the nearest double as the Lexer does (with the same
+// "out of range" rule), the operators group and associate as in
+// Parser::parseExpression(), and each one is the same double operation
+// ProgramNode::evaluate() performs, so the result is the same, bit for bit.
+// Whitespace and // comments are allowed; variables are not (there is no LET
+// to define them), and the expression must be all of the string.
+//
+// Errors are the runtime's: a LexError or ParseError with the message and
+// position Parser would report (positions are those in the string), or
+// std::runtime_error("Runtime Error: Division by zero"), which, as in
+// simlanc, is only raised once the whole expression has parsed. Each is
+// thrown from a function that is not constexpr, so in a constant expression
+// it stops compilation, with the function (e.g. divisionByZero) named in the
+// diagnostic. An expression that overflows to infinity is not a constant
+// expression either (the compiler refuses it); at run time it gives inf, as
+// simlanc does. For run-time calls to give simlanc's values, the caller must
+// not be built with -ffast-math or FP contraction (see simlan_add_executable).
+//
+// Parentheses may be nested MAX_NESTING levels deep. The nesting state lives
+// in a fixed array, since a constexpr function cannot allocate.
+namespace simlan {
+
+constexpr size_t MAX_NESTING = 256;
+
+namespace detail {
+
+// The failures, raised outside constant evaluation (see above)
+[[noreturn]] inline void lexicalError(const std::string& message, int line, int column) {
+    throw LexError(message, line, column);
+}
+
+[[noreturn]] inline void numberOutOfRange(std::string_view literal, int line, int column) {
+    lexicalError("Numeric literal out of range: " + std::string(literal), line, column);
+}
+
+[[noreturn]] inline void unexpectedCharacter(char c, int line, int column) {
+    lexicalError(std::string("Unexpected character: ") + c, line, column);
+}
+
+// As Parser::errorAt(): near is the offending token, empty at the end
+[[noreturn]] inline void syntaxError(const std::string& message, std::string_view near, int line, int column) {
+    std::string full_message = "Parse Error: " + message;
+    if (near.empty()) {
+        full_message += " at end of file.";
+    } else {
+        full_message += " near '" + std::string(near) + "'";
+    }
+    throw ParseError(full_message, line, column);
+}
+
+[[noreturn]] inline void undefinedVariable(std::string_view name, int line, int column) {
+    throw ParseError("Parse Error: Undefined variable '" + std::string(name) + "'", line, column);
+}
+
+[[noreturn]] inline void divisionByZero() {
+    throw std::runtime_error("Runtime Error: Division by zero");
+}
+
+//------------------------------------------------------------------------------
+// Decimal literals to double, correctly rounded
+//------------------------------------------------------------------------------
+// std::from_chars, which the Lexer uses, is not constexpr. A literal is an
+// integer N of significant digits times a power of ten; its double is found
+// by dividing big integers until 55 or more bits of the quotient are known,
+// then rounding to nearest, ties to even. Digits past the 768th only decide
+// a tie, so they are replaced by one sticky digit.
+class BigInt {
+public:
+    static constexpr size_t LIMBS = 128; // 4096 bits, more than any literal in range needs
+
+    constexpr void multiplyAdd(uint32_t factor, uint32_t addend) {
+        uint64_t carry = addend;
+        for (size_t i = 0; i < size; ++i) {
+            uint64_t v = uint64_t(limbs[i]) * factor + carry;
+            limbs[i] = static_cast<uint32_t>(v);
+            carry = v >> 32;
+        }
+        if (carry != 0) {
+            limbs[size++] = static_cast<uint32_t>(carry);
+        }
+    }
+
+    constexpr void multiplyByPowerOfTen(size_t exponent) {
+        for (; exponent >= 9; exponent -= 9) {
+            multiplyAdd(1000000000u, 0);
+        }
+        uint32_t factor = 1;
+        for (; exponent > 0; --exponent) {
+            factor *= 10;
+        }
+        multiplyAdd(factor, 0);
+    }
+
+    constexpr size_t bitLength() const {
+        if (size == 0) {
+            return 0;
+        }
+        size_t bits = (size - 1) * 32;
+        for (uint32_t top = limbs[size - 1]; top != 0; top >>= 1) {
+            ++bits;
+        }
+        return bits;
+    }
+
+    constexpr bool isZero() const { return size == 0; }
+
+    constexpr void shiftLeft(size_t bits) {
+        size_t words = bits / 32;
+        unsigned shift = bits % 32;
+        if (size == 0) {
+            return;
+        }
+        size_t newSize = size + words + 1;
+        for (size_t i = newSize; i-- > 0;) {
+            uint32_t high = i >= words && i - words < size ? limbs[i - words] : 0;
+            uint32_t low = i >= words + 1 && i - words - 1 < size ? limbs[i - words - 1] : 0;
+            limbs[i] = shift == 0 ? high : (high << shift) | (low >> (32 - shift));
+        }
+        size = newSize;
+        trim();
+    }
+
+    constexpr void shiftRightOne() {
+        for (size_t i = 0; i < size; ++i) {
+            uint32_t next = i + 1 < size ? limbs[i + 1] : 0;
+            limbs[i] = (limbs[i] >> 1) | (next << 31);
+        }
+        trim();
+    }
+
+    constexpr bool lessThan(const BigInt& other) const {
+        if (size != other.size) {
+            return size < other.size;
+        }
+        for (size_t i = size; i-- > 0;) {
+            if (limbs[i] != other.limbs[i]) {
+                return limbs[i] < other.limbs[i];
+            }
+        }
+        return false;
+    }
+
+    // this -= other; other must not be larger
+    constexpr void subtract(const BigInt& other) {
+        uint32_t borrow = 0;
+        for (size_t i = 0; i < size; ++i) {
+            uint64_t rhs = uint64_t(i < other.size ? other.limbs[i] : 0) + borrow;
+            borrow = limbs[i] < rhs ? 1 : 0;
+            limbs[i] = static_cast<uint32_t>(uint64_t(limbs[i]) + (uint64_t(borrow) << 32) - rhs);
+        }
+        trim();
+    }
+
+private:
+    uint32_t limbs[LIMBS] = {};
+    size_t size = 0; // Limbs in use; the top one is non-zero
+
+    constexpr void trim() {
+        while (size > 0 && limbs[size - 1] == 0) {
+            --size;
+        }
+    }
+};
+
+constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Sets inRange to false, as from_chars reports result_out_of_range, when the
+// literal overflows or would only fit as a subnormal (the Lexer rejects both)
+constexpr double parseDecimal(std::string_view literal, bool& inRange) {
+    inRange = true;
+    size_t point = literal.find('.');
+    size_t fractionDigits = point == std::string_view::npos ? 0 : literal.size() - point - 1;
+
+    // Significant digits: first and last non-zero digit, skipping the point
+    size_t first = literal.size();
+    size_t last = 0;
+    size_t digitCount = 0;
+    for (size_t i = 0; i < literal.size(); ++i) {
+        if (literal[i] == '.') {
+            continue;
+        }
+        if (literal[i] != '0') {
+            if (first == literal.size()) {
+                first = digitCount;
+            }
+            last = digitCount;
+        }
+        ++digitCount;
+    }
+    if (first == literal.size()) {
+        return 0.0;
+    }
+
+    // value = N * 10^power, and 10^decimalExponent <= value < 10^(decimalExponent + 1)
+    long power = static_cast<long>(digitCount - 1 - last) - static_cast<long>(fractionDigits);
+    long decimalExponent = static_cast<long>(digitCount - 1 - first) - static_cast<long>(fractionDigits);
+    if (decimalExponent > 308 || decimalExponent < -310) {
+        inRange = false; // Far past DBL_MAX, or far below DBL_MIN
+        return 0.0;
+    }
+
+    // Fast path: N and 10^|power| are exact doubles, so one correctly rounded
+    // operation gives the correctly rounded value
+    size_t kept = last - first + 1;
+    if (kept <= 15 && power >= -22 && power <= 22) {
+        constexpr double powersOfTen[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                          1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                          1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        uint64_t significand = 0;
+        size_t index = 0;
+        for (size_t i = 0; i < literal.size() && index <= last; ++i) {
+            if (literal[i] == '.') {
+                continue;
+            }
+            if (index >= first) {
+                significand = significand * 10 + static_cast<uint64_t>(literal[i] - '0');
+            }
+            ++index;
+        }
+        double value = static_cast<double>(significand);
+        return power >= 0 ? value * powersOfTen[power] : value / powersOfTen[-power];
+    }
+
+    constexpr size_t MAX_DIGITS = 768;
+    bool sticky = false;
+    if (kept > MAX_DIGITS) {
+        power += static_cast<long>(kept - MAX_DIGITS) - 1;
+        kept = MAX_DIGITS;
+        sticky = true; // The last digit is non-zero, so the dropped ones are too
+    }
+
+    BigInt numerator;
+    BigInt denominator;
+    denominator.multiplyAdd(1, 1);
+    size_t index = 0;
+    uint32_t chunk = 0;
+    uint32_t chunkScale = 1;
+    for (size_t i = 0; i < literal.size() && index < first + kept; ++i) {
+        if (literal[i] == '.') {
+            continue;
+        }
+        if (index >= first) {
+            chunk = chunk * 10 + static_cast<uint32_t>(literal[i] - '0');
+            chunkScale *= 10;
+            if (chunkScale == 1000000000u) {
+                numerator.multiplyAdd(chunkScale, chunk);
+                chunk = 0;
+                chunkScale = 1;
+            }
+        }
+        ++index;
+    }
+    numerator.multiplyAdd(chunkScale, chunk);
+    if (sticky) {
+        numerator.multiplyAdd(10, 1);
+    }
+    if (power >= 0) {
+        numerator.multiplyByPowerOfTen(static_cast<size_t>(power));
+    } else {
+        denominator.multiplyByPowerOfTen(static_cast<size_t>(-power));
+    }
+
+    // Scale so that the quotient has 56 or 57 bits: value * 2^shift ~ quotient
+    long shift = 56 - (static_cast<long>(numerator.bitLength()) - static_cast<long>(denominator.bitLength()));
+    if (shift > 0) {
+        numerator.shiftLeft(static_cast<size_t>(shift));
+    } else {
+        denominator.shiftLeft(static_cast<size_t>(-shift));
+    }
+    uint64_t quotient = 0;
+    denominator.shiftLeft(57);
+    for (int bit = 57; bit >= 0; --bit) {
+        if (!numerator.lessThan(denominator)) {
+            numerator.subtract(denominator);
+            quotient |= uint64_t(1) << bit;
+        }
+        denominator.shiftRightOne();
+    }
+    bool inexact = !numerator.isZero();
+
+    // Round to 53 bits, or to fewer where the result would be subnormal
+    long quotientBits = 0;
+    for (uint64_t q = quotient; q != 0; q >>= 1) {
+        ++quotientBits;
+    }
+    long binaryExponent = quotientBits - 1 - shift;
+    long lsb = binaryExponent - 52 < -1074 ? -1074 : binaryExponent - 52;
+    long drop = shift - (1 - lsb); // Bits of quotient below the rounding bit
+    uint64_t withRoundBit = 0;
+    if (drop >= 64) {
+        inexact = inexact || quotient != 0;
+    } else {
+        inexact = inexact || (quotient & ((uint64_t(1) << drop) - 1)) != 0;
+        withRoundBit = quotient >> drop;
+    }
+    uint64_t mantissa = withRoundBit >> 1;
+    if ((withRoundBit & 1) != 0 && (inexact || (mantissa & 1) != 0)) {
+        ++mantissa;
+    }
+    if (mantissa == uint64_t(1) << 53) {
+        mantissa >>= 1;
+        ++lsb;
+    }
+    if (mantissa < uint64_t(1) << 52 || lsb + 52 > 1023) {
+        inRange = false;
+        return 0.0;
+    }
+
+    // mantissa * 2^lsb; every step is exact, since the result is a normal double
+    double value = static_cast<double>(mantissa);
+    for (; lsb >= 32; lsb -= 32) {
+        value *= 4294967296.0;
+    }
+    for (; lsb <= -32; lsb += 32) {
+        value *= 1.0 / 4294967296.0;
+    }
+    for (; lsb > 0; --lsb) {
+        value *= 2.0;
+    }
+    for (; lsb < 0; ++lsb) {
+        value *= 0.5;
+    }
+    return value;
+}
+
+//------------------------------------------------------------------------------
+// Lexing, as Lexer::getNextToken() does it for an expression
+//------------------------------------------------------------------------------
+enum class TokenKind : uint8_t {
+    Number, Identifier, LeftParen, RightParen, Plus, Minus, Star, Slash,
+    Other,  // A keyword, ';' or '=': never part of an expression
+    End
+};
+
+struct ExprToken {
+    TokenKind kind = TokenKind::End;
+    size_t offset = 0;
+    size_t length = 0;
+    int line = 1;
+    int column = 1;
+    double value = 0.0;
+};
+
+class ExprLexer {
+public:
+    explicit constexpr ExprLexer(std::string_view source) : source(source) {}
+
+    constexpr std::string_view lexeme(const ExprToken& token) const {
+        return source.substr(token.offset, token.length);
+    }
+
+    constexpr ExprToken next() {
+        skipWhitespaceAndComments();
+        size_t start = pos;
+        if (pos == source.size()) {
+            return make(TokenKind::End, start);
+        }
+        char c = source[pos++];
+        if (isAlpha(c) || c == '_') {
+            while (pos < source.size() && (isAlpha(source[pos]) || isDigit(source[pos]) || source[pos] == '_')) {
+                ++pos;
+            }
+            std::string_view word = source.substr(start, pos - start);
+            bool keyword = word == "PRINT" || word == "LET" || word == "INPUT";
+            return make(keyword ? TokenKind::Other : TokenKind::Identifier, start);
+        }
+        if (isDigit(c)) {
+            skipDigits();
+            if (pos + 1 < source.size() && source[pos] == '.' && isDigit(source[pos + 1])) {
+                ++pos;
+                skipDigits();
+            }
+            bool inRange = true;
+            ExprToken token = make(TokenKind::Number, start);
+            token.value = parseDecimal(source.substr(start, pos - start), inRange);
+            if (!inRange) {
+                numberOutOfRange(source.substr(start, pos - start), line, column(pos));
+            }
+            return token;
+        }
+        switch (c) {
+            case '(': return make(TokenKind::LeftParen, start);
+            case ')': return make(TokenKind::RightParen, start);
+            case '+': return make(TokenKind::Plus, start);
+            case '-': return make(TokenKind::Minus, start);
+            case '*': return make(TokenKind::Star, start);
+            case '/': return make(TokenKind::Slash, start);
+            case ';':
+            case '=': return make(TokenKind::Other, start);
+            default:
+                unexpectedCharacter(c, line, column(pos));
+        }
+    }
+
+private:
+    std::string_view source;
+    size_t pos = 0;
+    int line = 1;
+    size_t lineStart = 0;
+
+    static constexpr bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+    static constexpr bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    }
+
+    constexpr int column(size_t at) const { return static_cast<int>(at - lineStart) + 1; }
+
+    constexpr ExprToken make(TokenKind kind, size_t start) const {
+        ExprToken token;
+        token.kind = kind;
+        token.offset = start;
+        token.length = pos - start;
+        token.line = line;
+        token.column = column(start);
+        return token;
+    }
+
+    constexpr void skipDigits() {
+        while (pos < source.size() && isDigit(source[pos])) {
+            ++pos;
+        }
+    }
+
+    constexpr void skipWhitespaceAndComments() {
+        while (pos < source.size()) {
+            char c = source[pos];
+            if (isSpace(c)) {
+                ++pos;
+                if (c == '\n') {
+                    ++line;
+                    lineStart = pos;
+                }
+            } else if (c == '/' && pos + 1 < source.size() && source[pos + 1] == '/') {
+                while (pos < source.size() && source[pos] != '\n') {
+                    ++pos;
+                }
+            } else {
+                break;
+            }
+        }
+    }
+};
+
+//------------------------------------------------------------------------------
+// Parsing and evaluation, as Parser::parseExpression() builds the tree
+//------------------------------------------------------------------------------
+// An operator is applied where the parser would create its node. Operand
+// values are the same as ProgramNode::evaluate() computes for the node's
+// children, so so is the result. After a division by zero nothing more is
+// computed, but parsing goes on: a syntax error later in the expression is
+// the error to report.
+constexpr double apply(char op, double left, double right, bool& dividedByZero) {
+    if (dividedByZero) {
+        return 0.0;
+    }
+    switch (op) {
+        case '+': return left + right;
+        case '-': return left - right;
+        case '*': return left * right;
+        default:
+            if (right == 0) {
+                dividedByZero = true;
+                return 0.0;
+            }
+            return left / right;
+    }
+}
+
+struct Level {
+    double sum = 0.0;
+    double term = 0.0;
+    char sumOp = 0;
+    char termOp = 0;
+};
+
+constexpr double parseAndEvaluate(std::string_view expression, bool& dividedByZero) {
+    ExprLexer lexer(expression);
+    Level levels[MAX_NESTING + 1] = {};
+    size_t depth = 1;
+    ExprToken token = lexer.next();
+
+    for (;;) {
+        while (token.kind == TokenKind::LeftParen) {
+            if (depth > MAX_NESTING) {
+                syntaxError("Expression nested more than " + std::to_string(MAX_NESTING) + " levels deep.",
+                            lexer.lexeme(token), token.line, token.column);
+            }
+            token = lexer.next();
+            levels[depth++] = Level{};
+        }
+        double value = 0.0;
+        if (token.kind == TokenKind::Number) {
+            value = token.value;
+            token = lexer.next();
+        } else if (token.kind == TokenKind::Identifier) {
+            undefinedVariable(lexer.lexeme(token), token.line, token.column);
+        } else {
+            syntaxError("Expected a number, a variable or a parenthesized expression.", lexer.lexeme(token),
+                        token.line, token.column);
+        }
+
+        for (;;) {
+            Level& level = levels[depth - 1];
+            if (level.termOp) {
+                value = apply(level.termOp, level.term, value, dividedByZero);
+                level.termOp = 0;
+            }
+            if (token.kind == TokenKind::Star || token.kind == TokenKind::Slash) {
+                level.term = value;
+                level.termOp = token.kind == TokenKind::Star ? '*' : '/';
+                token = lexer.next();
+                break;
+            }
+
+            if (level.sumOp) {
+                value = apply(level.sumOp, level.sum, value, dividedByZero);
+                level.sumOp = 0;
+            }
+            if (token.kind == TokenKind::Plus || token.kind == TokenKind::Minus) {
+                level.sum = value;
+                level.sumOp = token.kind == TokenKind::Plus ? '+' : '-';
+                token = lexer.next();
+                break;
+            }
+
+            if (depth == 1) {
+                if (token.kind != TokenKind::End) {
+                    syntaxError("Expected the end of the expression.", lexer.lexeme(token), token.line, token.column);
+                }
+                return value;
+            }
+            if (token.kind != TokenKind::RightParen) {
+                syntaxError("Expected ')' after expression in parentheses.", lexer.lexeme(token), token.line,
+                            token.column);
+            }
+            token = lexer.next();
+            --depth;
+        }
+    }
+}
+
+} // namespace detail
+
+// The value of expression, as simlanc would PRINT it (see above)
+constexpr double eval(std::string_view expression) {
+    bool dividedByZero = false;
+    double value = detail::parseAndEvaluate(expression, dividedByZero);
+    if (dividedByZero) {
+        detail::divisionByZero();
+    }
+    return value;
+}
+
+} // namespace simlan
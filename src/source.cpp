@@ -0,0 +1,143 @@
+#include "source.hpp"
+#include <cerrno>
+#include <cstring>   // For std::strerror
+#include <fstream>
+#include <sstream>
+#include <stdexcept> // For std::runtime_error
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SIMLAN_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define SIMLAN_HAVE_MMAP 0
+#endif
+
+//------------------------------------------------------------------------------
+// SourceFile
+//------------------------------------------------------------------------------
+SourceFile::~SourceFile() {
+    close();
+}
+
+void SourceFile::close() {
+#if SIMLAN_HAVE_MMAP
+    if (mapping) {
+        munmap(mapping, size);
+    }
+#endif
+    mapping = nullptr;
+    data = nullptr;
+    size = 0;
+    owned.clear();
+}
+
+bool SourceFile::open(const std::string& path, std::string& error) {
+    close();
+#if SIMLAN_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Could not open file: " + path + " (" + std::strerror(errno) + ")";
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = "Could not stat file: " + path + " (" + std::strerror(errno) + ")";
+        ::close(fd);
+        return false;
+    }
+    size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+        // mmap rejects empty mappings; an empty file is just empty text
+        ::close(fd);
+        data = "";
+        return true;
+    }
+    void* mem = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps the file alive
+    if (mem == MAP_FAILED) {
+        error = "Could not map file: " + path + " (" + std::strerror(errno) + ")";
+        size = 0;
+        return false;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(mem, size, MADV_SEQUENTIAL); // The lexer reads it front to back
+#endif
+    mapping = mem;
+    data = static_cast<const char*>(mem);
+    return true;
+#else
+    std::ifstream file_stream(path, std::ios::binary);
+    if (!file_stream.is_open()) {
+        error = "Could not open file: " + path;
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << file_stream.rdbuf();
+    owned = buffer.str();
+    data = owned.data();
+    size = owned.size();
+    return true;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// FileDescriptorStream
+//------------------------------------------------------------------------------
+FileDescriptorStream::~FileDescriptorStream() {
+#if SIMLAN_HAVE_MMAP
+    if (owned) {
+        ::close(fd);
+    }
+#endif
+}
+
+size_t FileDescriptorStream::read(char* buffer, size_t capacity) {
+#if SIMLAN_HAVE_MMAP
+    for (;;) {
+        ssize_t n = ::read(fd, buffer, capacity);
+        if (n >= 0) {
+            return static_cast<size_t>(n);
+        }
+        if (errno != EINTR) {
+            throw std::runtime_error(std::string("Error reading input: ") + std::strerror(errno));
+        }
+    }
+#else
+    (void)buffer;
+    (void)capacity;
+    throw std::runtime_error("Error reading input: streaming is not supported on this host");
+#endif
+}
+
+bool isStreamPath(const std::string& path) {
+    if (path == "-") {
+        return true;
+    }
+#if SIMLAN_HAVE_MMAP
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0) {
+        return S_ISFIFO(info.st_mode) || S_ISSOCK(info.st_mode) || S_ISCHR(info.st_mode);
+    }
+#endif
+    return false;
+}
+
+std::unique_ptr<InputStream> openInputStream(const std::string& path, std::string& error) {
+#if SIMLAN_HAVE_MMAP
+    if (path == "-") {
+        return std::make_unique<FileDescriptorStream>(STDIN_FILENO, false);
+    }
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Could not open file: " + path + " (" + std::strerror(errno) + ")";
+        return nullptr;
+    }
+    return std::make_unique<FileDescriptorStream>(fd, true);
+#else
+    error = "Streaming input is not supported on this host: " + path;
+    return nullptr;
+#endif
+}
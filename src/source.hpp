@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+//------------------------------------------------------------------------------
+// SourceFile: the bytes of a regular file, memory-mapped where possible
+//------------------------------------------------------------------------------
+// The Lexer runs directly over text(), so a file is never copied into a
+// std::string. On hosts without mmap the file is read into an owned buffer.
+class SourceFile {
+public:
+    SourceFile() = default;
+    ~SourceFile();
+
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    // Returns false and sets error if the file cannot be opened or mapped
+    bool open(const std::string& path, std::string& error);
+
+    std::string_view text() const { return std::string_view(data, size); }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    void* mapping = nullptr;  // Non-null when data points into an mmap
+    std::string owned;        // Fallback storage when mmap is not used
+
+    void close();
+};
+
+//------------------------------------------------------------------------------
+// InputStream: a source of bytes that can only be read front to back
+//------------------------------------------------------------------------------
+// Used for pipes and stdin, which cannot be mapped. The Lexer pulls from it in
+// fixed-size chunks, so memory use does not grow with the length of the input.
+class InputStream {
+public:
+    virtual ~InputStream() = default;
+
+    // Reads up to capacity bytes into buffer. Returns 0 at end of input.
+    virtual size_t read(char* buffer, size_t capacity) = 0;
+};
+
+class FileDescriptorStream : public InputStream {
+public:
+    // Reads from fd; closes it on destruction if owned is true
+    FileDescriptorStream(int fd, bool owned) : fd(fd), owned(owned) {}
+    ~FileDescriptorStream() override;
+
+    FileDescriptorStream(const FileDescriptorStream&) = delete;
+    FileDescriptorStream& operator=(const FileDescriptorStream&) = delete;
+
+    size_t read(char* buffer, size_t capacity) override;
+
+private:
+    int fd;
+    bool owned;
+};
+
+// True if path names something that must be streamed rather than mapped:
+// "-" (stdin), a pipe, a socket or a character device.
+bool isStreamPath(const std::string& path);
+
+// Opens path ("-" for stdin) as an InputStream. Returns null and sets error
+// if it cannot be opened.
+std::unique_ptr<InputStream> openInputStream(const std::string& path, std::string& error);
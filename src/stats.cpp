@@ -0,0 +1,177 @@
+#include "stats.hpp"
+#include "ast.hpp"
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+
+namespace {
+
+const char OPERATORS[Stats::OPERATOR_COUNT] = {'+', '-', '*', '/'};
+
+uint64_t total(const Stats::OperatorCounts& counts) {
+    uint64_t sum = 0;
+    for (uint64_t count : counts) sum += count;
+    return sum;
+}
+
+void printOperators(std::ostream& out, const Stats::OperatorCounts& counts) {
+    out << total(counts) << " (";
+    for (size_t i = 0; i < Stats::OPERATOR_COUNT; ++i) {
+        out << (i > 0 ? ", " : "") << "'" << OPERATORS[i] << "' " << counts[i];
+    }
+    out << ")";
+}
+
+void printNodes(std::ostream& out, const char* label, const Stats::NodeCounts& nodes) {
+    out << "  " << std::left << std::setw(10) << label << std::right
+        << nodes.statements << " statements, " << nodes.numbers << " numbers, binary ops ";
+    printOperators(out, nodes.binaries);
+    if (nodes.variables > 0) {
+        out << ", " << nodes.variables << " variables";
+    }
+    out << '\n';
+}
+
+// JSON string literal for names made of plain ASCII
+std::string quoted(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+} // namespace
+
+Stats::NodeCounts Stats::countNodes(const ProgramNode& program) {
+    NodeCounts counts;
+    counts.statements = program.statements.size();
+    counts.numbers = program.arena.numbers.size();
+    counts.variables = program.symbols.size();
+    for (const BinaryOpNode& node : program.arena.binaries) {
+        counts.binaries[operatorIndex(node.op)]++;
+    }
+    return counts;
+}
+
+double Stats::sinceOriginUs() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void Stats::printSummary(std::ostream& out) const {
+    out << "--- Simlan Stats ---\n";
+    out << "Phases (ms):\n";
+    for (const Phase& phase : phases) {
+        out << "  " << std::left << std::setw(10) << phase.name << std::right
+            << std::fixed << std::setprecision(3) << std::setw(12) << phase.durationUs / 1000.0 << '\n';
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+
+    uint64_t tokenTotal = 0;
+    for (uint64_t count : tokens) tokenTotal += count;
+    out << "Tokens: " << tokenTotal;
+    bool first = true;
+    for (size_t i = 0; i < TOKEN_TYPE_COUNT; ++i) {
+        if (tokens[i] == 0) continue;
+        Token token;
+        token.type = static_cast<TokenType>(i);
+        out << (first ? " (" : ", ") << token.typeToString() << " " << tokens[i];
+        first = false;
+    }
+    out << (first ? "" : ")") << '\n';
+
+    out << "Nodes:" << (fromCache ? " (loaded from cache)" : "") << '\n';
+    printNodes(out, "parsed", parsedNodes);
+    if (optimized) {
+        printNodes(out, "optimized", optimizedNodes);
+    }
+    if (shared) {
+        out << "  " << std::left << std::setw(10) << "shared" << std::right << sharing.uniqueNodes << " of "
+            << sharing.totalNodes << " nodes unique, " << sharing.temporaries << " temporaries, "
+            << sharing.savedBytes << " bytes saved\n";
+    }
+    out << "Evaluations: ";
+    printOperators(out, evaluations);
+    out << '\n';
+    out << "Allocations: " << allocations << " (" << allocatedBytes << " bytes)\n";
+    out << "Output: " << outputBytes << " bytes\n";
+}
+
+bool Stats::writeTrace(const std::string& path, std::string& error) const {
+    std::ofstream file(path);
+    if (!file) {
+        error = "Could not open trace file: " + path;
+        return false;
+    }
+
+    // Complete ("X") events for the phases, then counter ("C") events
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    file << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"simlanc\"}}";
+    for (const Phase& phase : phases) {
+        file << ",\n  {\"name\": " << quoted(phase.name) << ", \"cat\": \"phase\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1"
+             << ", \"ts\": " << phase.startUs << ", \"dur\": " << phase.durationUs << "}";
+    }
+    double end = phases.empty() ? 0.0 : phases.back().startUs + phases.back().durationUs;
+
+    file << ",\n  {\"name\": \"tokens\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << end << ", \"args\": {";
+    bool first = true;
+    for (size_t i = 0; i < TOKEN_TYPE_COUNT; ++i) {
+        Token token;
+        token.type = static_cast<TokenType>(i);
+        file << (first ? "" : ", ") << quoted(token.typeToString()) << ": " << tokens[i];
+        first = false;
+    }
+    file << "}}";
+
+    auto operatorCounter = [&](const char* name, const OperatorCounts& counts) {
+        file << ",\n  {\"name\": \"" << name << "\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << end << ", \"args\": {";
+        for (size_t i = 0; i < OPERATOR_COUNT; ++i) {
+            file << (i > 0 ? ", " : "") << "\"" << OPERATORS[i] << "\": " << counts[i];
+        }
+        file << "}}";
+    };
+    operatorCounter("parsed binary ops", parsedNodes.binaries);
+    if (optimized) {
+        operatorCounter("optimized binary ops", optimizedNodes.binaries);
+    }
+    if (shared) {
+        file << ",\n  {\"name\": \"shared nodes\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << end << ", \"args\": {"
+             << "\"total\": " << sharing.totalNodes << ", \"unique\": " << sharing.uniqueNodes << "}}";
+    }
+    operatorCounter("evaluations", evaluations);
+
+    file << ",\n  {\"name\": \"nodes\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << end << ", \"args\": {"
+         << "\"statements\": " << parsedNodes.statements << ", \"numbers\": " << parsedNodes.numbers
+         << ", \"binary ops\": " << total(parsedNodes.binaries)
+         << ", \"variables\": " << parsedNodes.variables << "}}";
+    file << ",\n  {\"name\": \"memory\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << end << ", \"args\": {"
+         << "\"allocations\": " << allocations << ", \"allocated bytes\": " << allocatedBytes << "}}";
+    file << ",\n  {\"name\": \"output\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << end << ", \"args\": {"
+         << "\"bytes\": " << outputBytes << "}}";
+    file << "\n]}\n";
+
+    if (!file) {
+        error = "Could not write trace file: " + path;
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// PhaseTimer
+//------------------------------------------------------------------------------
+PhaseTimer::PhaseTimer(Stats* stats, const char* name) : stats(stats), name(name) {
+    if (stats) {
+        startUs = stats->sinceOriginUs();
+    }
+}
+
+void PhaseTimer::stop() {
+    if (stats) {
+        stats->phases.push_back(Stats::Phase{name, startUs, stats->sinceOriginUs() - startUs});
+        stats = nullptr;
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "lexer.hpp"
+#include "operator_counts.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+struct ProgramNode;
+
+//------------------------------------------------------------------------------
+// Stats: phase timings and counters for --stats and --trace
+//------------------------------------------------------------------------------
+// The driver owns one Stats object when instrumentation is requested and
+// passes a Stats* everywhere else; a null pointer means "disabled", so the
+// only cost of instrumentation that is off is a pointer test per phase.
+// Most counters are filled in from data the stages already produce (parser
+// token callbacks, arena sizes, the output sink). Operator evaluations are
+// counted by the engine that runs the program, in a copy of its loop (or, for
+// the JIT, its code) that is only used when there is a Stats object.
+struct Stats {
+    // Operators in the order + - * /
+    static constexpr size_t OPERATOR_COUNT = ::OPERATOR_COUNT;
+    using OperatorCounts = ::OperatorCounts;
+
+    struct Phase {
+        std::string name;
+        double startUs;     // Since the Stats object was created
+        double durationUs;
+    };
+
+    // Nodes of one tree (the parsed one, or the optimized one)
+    struct NodeCounts {
+        uint64_t statements = 0;
+        uint64_t numbers = 0;
+        OperatorCounts binaries{};
+        uint64_t variables = 0;
+    };
+
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::vector<Phase> phases;
+
+    std::array<uint64_t, TOKEN_TYPE_COUNT> tokens{};
+    NodeCounts parsedNodes;
+    NodeCounts optimizedNodes;
+    bool optimized = false;
+
+    // Common subexpressions (-O2): nodes before and after sharing
+    struct Sharing {
+        uint64_t totalNodes = 0;
+        uint64_t uniqueNodes = 0;
+        uint64_t temporaries = 0;
+        int64_t savedBytes = 0;
+    };
+    Sharing sharing;
+    bool shared = false;
+    bool fromCache = false;         // Program loaded from a .simc file, nothing lexed or parsed
+    OperatorCounts evaluations{};   // BinaryOpNode evaluations per operator, counted by the engine
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    uint64_t outputBytes = 0;
+
+    void countToken(const Token& token) { tokens[static_cast<size_t>(token.type)]++; }
+
+    static NodeCounts countNodes(const ProgramNode& program);
+
+    double sinceOriginUs() const;
+
+    // Human-readable summary (--stats)
+    void printSummary(std::ostream& out) const;
+
+    // Chrome trace-event JSON (--trace=file.json), viewable in chrome://tracing
+    // or Perfetto. Returns false and sets error if the file cannot be written.
+    bool writeTrace(const std::string& path, std::string& error) const;
+};
+
+//------------------------------------------------------------------------------
+// PhaseTimer: records the wall time of a scope as a phase (no-op if null)
+//------------------------------------------------------------------------------
+class PhaseTimer {
+public:
+    PhaseTimer(Stats* stats, const char* name);
+    ~PhaseTimer() { stop(); }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    void stop(); // Ends the phase early
+
+private:
+    Stats* stats;
+    const char* name;
+    double startUs = 0.0;
+};
+
+//------------------------------------------------------------------------------
+// Heap allocation counting
+//------------------------------------------------------------------------------
+// Implemented by a replacement global operator new (alloc_stats.cpp) that is
+// linked into simlanc only. Counting starts when enabled; until then the
+// replacement just forwards to malloc.
+void enableAllocationCounting();
+void readAllocationCounts(uint64_t& allocations, uint64_t& bytes);
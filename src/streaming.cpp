@@ -0,0 +1,36 @@
+#include "streaming.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "output.hpp"
+
+StreamingInterpreter::StreamingInterpreter(OutputSink& output, size_t maxNesting)
+    : output(output), maxNesting(maxNesting) {}
+
+bool StreamingInterpreter::run(Lexer& lexer) {
+    Parser parser(lexer);
+    parser.setMaxNesting(maxNesting);
+    // A statement runs as soon as its ';' is read, not once the next token is
+    parser.setLazyStatementEnd(true);
+
+    while (parser.nextStatement()) {
+        // The previous statement's nodes are no longer needed; the vectors
+        // keep their capacity, so a run of similar statements allocates nothing
+        program.arena.numbers.clear();
+        program.arena.binaries.clear();
+
+        StatementNode stmt = parser.parseStatementInto(program);
+        if (stmt.kind == StatementKind::Input) {
+            return false;
+        }
+        if (variables.size() < program.symbols.size()) {
+            variables.resize(program.symbols.size());
+        }
+        program.executeStatement(stmt, output, variables.data());
+    }
+    return true;
+}
+
+size_t FlushingInputStream::read(char* buffer, size_t capacity) {
+    output.flush();
+    return input.read(buffer, capacity);
+}
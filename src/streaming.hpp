@@ -0,0 +1,56 @@
+#pragma once
+
+#include "ast.hpp"
+#include "source.hpp"
+#include <cstddef>
+#include <vector>
+
+class Lexer;
+class OutputSink;
+
+//------------------------------------------------------------------------------
+// StreamingInterpreter: runs each statement as soon as it is parsed
+//------------------------------------------------------------------------------
+// simlanc --stream. Parser::parseProgram() holds every statement of the
+// program before the first one runs; here the parser hands over one statement
+// at a time, the AST interpreter runs it, and its nodes are dropped before the
+// next statement is parsed. Memory therefore depends on the largest statement
+// and the number of variables, not on the length of the program, and output
+// starts with the first statement.
+//
+// A runtime error stops at the same statement, with the same message, as
+// running the whole program. A lexing or parse error is only found when the
+// parser gets there, so unlike a whole-program run, the statements before it
+// have run and printed their output.
+class StreamingInterpreter {
+public:
+    // maxNesting: Parser::setMaxNesting()
+    StreamingInterpreter(OutputSink& output, size_t maxNesting);
+
+    // Parses and runs the statements of lexer until the end of its input.
+    // Throws what parsing and executing a whole program throw (LexError,
+    // ParseError, std::runtime_error). Returns false when it reaches an INPUT
+    // statement, which has no value outside --batch; that statement does not
+    // run, and neither does any after it.
+    bool run(Lexer& lexer);
+
+private:
+    OutputSink& output;
+    size_t maxNesting;
+    ProgramNode program;            // Symbols of the whole run, nodes of one statement
+    std::vector<double> variables;  // By slot
+};
+
+// Reads from input, flushing output first, so that what the statements read
+// so far printed is not held back while simlanc waits for more of the
+// program (e.g. from a generator on a pipe)
+class FlushingInputStream : public InputStream {
+public:
+    FlushingInputStream(InputStream& input, OutputSink& output) : input(input), output(output) {}
+
+    size_t read(char* buffer, size_t capacity) override;
+
+private:
+    InputStream& input;
+    OutputSink& output;
+};
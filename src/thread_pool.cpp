@@ -0,0 +1,121 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(size_t workers) {
+    if (workers == 0) {
+        workers = 1;
+    }
+    for (size_t i = 0; i < workers; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 1; i < workers; ++i) {
+        threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// Own queue first (front), then the other queues (back)
+bool ThreadPool::takeTask(size_t self, size_t& task) {
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        Queue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runTasks(size_t self, const std::function<void(size_t)>& body) {
+    size_t task;
+    size_t done = 0;
+    while (takeTask(self, task)) {
+        body(task);
+        done++;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    pending -= done;
+    if (self != 0) {
+        active--;
+    }
+    if (pending == 0 && active == 0) {
+        finished.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    uint64_t seen = 0;
+    for (;;) {
+        const std::function<void(size_t)>* body;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            body = job;
+            if (!body) {
+                continue; // Woke up after that job had already finished
+            }
+            active++;
+        }
+        // parallelFor() does not return (and so body stays valid) until
+        // every worker that picked up the job has left runTasks().
+        runTasks(self, *body);
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    if (queues.size() == 1) {
+        for (size_t i = 0; i < count; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Contiguous ranges, so each worker starts on neighbouring tasks
+        size_t workers = queues.size();
+        for (size_t w = 0; w < workers; ++w) {
+            std::lock_guard<std::mutex> queueLock(queues[w]->mutex);
+            for (size_t i = count * w / workers; i < count * (w + 1) / workers; ++i) {
+                queues[w]->tasks.push_back(i);
+            }
+        }
+        job = &body;
+        pending = count;
+        generation++;
+    }
+    wake.notify_all();
+
+    runTasks(0, body);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&] { return pending == 0 && active == 0; });
+    job = nullptr;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// ThreadPool: a fixed set of workers with work stealing
+//------------------------------------------------------------------------------
+// parallelFor() splits its tasks evenly over one queue per worker. A worker
+// takes tasks from the front of its own queue and, once that is empty, steals
+// from the back of the others, so uneven tasks still keep every core busy.
+// The calling thread is worker 0, so a pool of size N starts N - 1 threads.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t workers);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return queues.size(); }
+
+    // Calls body(task) for every task in [0, count) and returns when all of
+    // them are done. body must not throw; calls may run concurrently.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // One per worker
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;                   // Guards everything below
+    std::condition_variable wake;       // A new job was posted, or stopping
+    std::condition_variable finished;   // pending or active reached zero
+    const std::function<void(size_t)>* job = nullptr;
+    uint64_t generation = 0;            // Bumped for every parallelFor()
+    size_t pending = 0;                 // Tasks of the current job not yet done
+    size_t active = 0;                  // Workers (other than the caller) holding the job
+    bool stopping = false;
+
+    bool takeTask(size_t self, size_t& task);
+    void runTasks(size_t self, const std::function<void(size_t)>& body);
+    void workerLoop(size_t self);
+};
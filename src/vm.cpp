@@ -0,0 +1,83 @@
+#include "vm.hpp"
+#include <cstring>   // For std::memcpy
+#include <stdexcept> // For std::runtime_error
+
+void VM::run(const Chunk& chunk, OutputSink& out, OperatorCounts* counts) {
+    // Two copies of the loop, so that a run without counts has nothing to test
+    if (counts) {
+        execute<true>(chunk, out, counts);
+    } else {
+        execute<false>(chunk, out, nullptr);
+    }
+}
+
+template <bool Counting>
+void VM::execute(const Chunk& chunk, OutputSink& out, OperatorCounts* counts) {
+    // The compiler knows the deepest the stack can get, so the loop below can
+    // push and pop through a raw pointer without any bounds checks.
+    stack.resize(chunk.maxStackDepth + 1);
+    double* sp = stack.data();
+    variables.assign(chunk.variableCount, 0.0);
+    double* vars = variables.data();
+
+    const uint8_t* ip = chunk.code.data();
+    const double* constants = chunk.constants.data();
+
+    for (;;) {
+        switch (static_cast<OpCode>(*ip++)) {
+            case OpCode::OP_CONSTANT: {
+                uint32_t index;
+                std::memcpy(&index, ip, sizeof(index));
+                ip += sizeof(index);
+                *sp++ = constants[index];
+                break;
+            }
+            case OpCode::OP_ADD:
+                if constexpr (Counting) (*counts)[operatorIndex('+')]++;
+                sp--;
+                sp[-1] = sp[-1] + sp[0];
+                break;
+            case OpCode::OP_SUBTRACT:
+                if constexpr (Counting) (*counts)[operatorIndex('-')]++;
+                sp--;
+                sp[-1] = sp[-1] - sp[0];
+                break;
+            case OpCode::OP_MULTIPLY:
+                if constexpr (Counting) (*counts)[operatorIndex('*')]++;
+                sp--;
+                sp[-1] = sp[-1] * sp[0];
+                break;
+            case OpCode::OP_DIVIDE:
+                if constexpr (Counting) (*counts)[operatorIndex('/')]++;
+                sp--;
+                if (sp[0] == 0) {
+                    throw std::runtime_error("Runtime Error: Division by zero");
+                }
+                sp[-1] = sp[-1] / sp[0];
+                break;
+            case OpCode::OP_PRINT:
+                sp--;
+                out.printNumber(sp[0]);
+                break;
+            case OpCode::OP_LOAD: {
+                uint32_t slot;
+                std::memcpy(&slot, ip, sizeof(slot));
+                ip += sizeof(slot);
+                *sp++ = vars[slot];
+                break;
+            }
+            case OpCode::OP_STORE: {
+                uint32_t slot;
+                std::memcpy(&slot, ip, sizeof(slot));
+                ip += sizeof(slot);
+                sp--;
+                vars[slot] = sp[0];
+                break;
+            }
+            case OpCode::OP_HALT:
+                return;
+            default:
+                throw std::runtime_error("Runtime Error: Invalid opcode");
+        }
+    }
+}
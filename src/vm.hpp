@@ -0,0 +1,25 @@
+#pragma once
+
+#include "bytecode.hpp"
+#include "operator_counts.hpp"
+#include "output.hpp"
+#include <vector>
+
+//------------------------------------------------------------------------------
+// VM: executes a compiled Chunk on a value stack
+//------------------------------------------------------------------------------
+// Produces exactly the same output and runtime errors as ProgramNode::execute(),
+// which remains the reference engine.
+class VM {
+public:
+    // With counts, every arithmetic instruction executed is counted there,
+    // including a division that fails
+    void run(const Chunk& chunk, OutputSink& out, OperatorCounts* counts = nullptr);
+
+private:
+    std::vector<double> stack;
+    std::vector<double> variables; // One per slot, zeroed for every run
+
+    template <bool Counting>
+    void execute(const Chunk& chunk, OutputSink& out, OperatorCounts* counts);
+};
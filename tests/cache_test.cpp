@@ -0,0 +1,121 @@
+// cache_test - the program cache is only used for the exact source it was
+// built from, and never written over a source file.
+
+#include "test_support.hpp"
+#include "program_cache.hpp"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Two sources of the same size and hashSource(), which once shared a cache
+// entry: the second printed what the first did
+const std::string COLLIDING_A = "LET q=1;//AAAAAA\nPRINT q;\n";
+const std::string COLLIDING_B = "LET q=2;//(^AA(^\nPRINT q;\n";
+
+void writeFile(const fs::path& path, const std::string& text) {
+    std::ofstream out(path, std::ios::binary);
+    out << text;
+}
+
+std::string readFile(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+// Runs source as simlanc --cache (or --cache-dir) would for the file at path
+struct CachedRun {
+    test::Outcome outcome;
+    bool fromCache = false;
+    std::string warnings;
+};
+
+CachedRun runCached(const std::string& source, const fs::path& path, const fs::path& cacheDir = fs::path()) {
+    CachedRun result;
+    simlan::CompileOptions options;
+    options.cache = true;
+    options.sourcePath = path.string();
+    options.cacheDir = cacheDir.string();
+    options.onParsed = [&](const ProgramNode&, bool fromCache) { result.fromCache = fromCache; };
+    options.onWarning = [&](const std::string& message) { result.warnings += message + "\n"; };
+    result.outcome = test::compileAndRun(source, options);
+    return result;
+}
+
+void checkCollision(const fs::path& dir) {
+    // The premise: the hash alone cannot tell them apart
+    CHECK(COLLIDING_A.size() == COLLIDING_B.size());
+    CHECK(hashSource(COLLIDING_A) == hashSource(COLLIDING_B));
+    CHECK(cachePathFor("x", (dir / "cache").string(), CacheKey::of(COLLIDING_A, 0, DEFAULT_MAX_NESTING)) ==
+          cachePathFor("x", (dir / "cache").string(), CacheKey::of(COLLIDING_B, 0, DEFAULT_MAX_NESTING)));
+
+    // Content-addressed: both land on the same file name
+    fs::create_directories(dir / "cache");
+    CHECK_EQUAL(runCached(COLLIDING_A, dir / "a.simlan", dir / "cache").outcome.output, std::string("1\n"), "a, cold");
+    CachedRun b = runCached(COLLIDING_B, dir / "b.simlan", dir / "cache");
+    CHECK_EQUAL(b.outcome.output, std::string("2\n"), "b after a");
+    CHECK(!b.fromCache);
+    CachedRun a = runCached(COLLIDING_A, dir / "a.simlan", dir / "cache");
+    CHECK_EQUAL(a.outcome.output, std::string("1\n"), "a after b");
+
+    // Next to the source: the file was edited into its twin
+    writeFile(dir / "prog.simlan", COLLIDING_A);
+    CHECK_EQUAL(runCached(COLLIDING_A, dir / "prog.simlan").outcome.output, std::string("1\n"), "prog, cold");
+    CHECK(runCached(COLLIDING_A, dir / "prog.simlan").fromCache);
+    writeFile(dir / "prog.simlan", COLLIDING_B);
+    b = runCached(COLLIDING_B, dir / "prog.simlan");
+    CHECK_EQUAL(b.outcome.output, std::string("2\n"), "prog edited");
+    CHECK(!b.fromCache);
+}
+
+void checkSourcePaths(const fs::path& dir) {
+    const std::string source = "LET x = 6;\nPRINT x * 7;\n";
+
+    // A source named like a cache file gets a cache of its own
+    fs::path simc = dir / "prog.simc";
+    writeFile(simc, source);
+    CHECK_EQUAL(cachePathFor(simc.string(), "", CacheKey::of(source, 0, DEFAULT_MAX_NESTING)),
+                simc.string() + ".simc", "cache path of prog.simc");
+    CHECK_EQUAL(runCached(source, simc).outcome.output, std::string("42\n"), "prog.simc, cold");
+    CHECK_EQUAL(readFile(simc), source, "prog.simc after a run");
+    CHECK(fs::exists(simc.string() + ".simc"));
+    CachedRun warm = runCached(source, simc);
+    CHECK_EQUAL(warm.outcome.output, std::string("42\n"), "prog.simc, warm");
+    CHECK(warm.fromCache);
+    CHECK_EQUAL(readFile(simc), source, "prog.simc after a warm run");
+
+#ifndef _WIN32
+    // A source reached through a link named like its own cache file: the
+    // cache path is the source itself, so nothing is cached
+    fs::path target = dir / "target.simlan";
+    fs::path link = dir / "link.simlan";
+    writeFile(target, source);
+    fs::create_symlink(target, link.string() + ".simc");
+    fs::create_symlink(link.string() + ".simc", link);
+    CHECK(isSameFile(link.string() + ".simc", link.string()));
+    for (int i = 0; i < 2; ++i) {
+        CachedRun run = runCached(source, link);
+        CHECK_EQUAL(run.outcome.output, std::string("42\n"), "through a link");
+        CHECK(!run.fromCache);
+        CHECK(run.warnings.find("is the source file") != std::string::npos);
+        CHECK_EQUAL(readFile(target), source, "link target after a run");
+    }
+#endif
+}
+
+} // namespace
+
+int main() {
+    fs::path dir = fs::current_path() / "cache_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    checkCollision(dir);
+    checkSourcePaths(dir);
+    return test::finish("cache_test");
+}
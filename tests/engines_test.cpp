@@ -0,0 +1,255 @@
+// engines_test - every engine prints the same for the same program: the
+// tree interpreter, the VM and the JIT at each optimization level and in
+// each number format, the batch evaluator (per ISA) against one run per
+// input row, and the C translation once compiled.
+
+#include "test_support.hpp"
+#include "batch.hpp"
+#include "c_emitter.hpp"
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef SIMLAN_TEST_C_COMPILER
+#include <cstdlib>    // For std::system
+#include <filesystem>
+#include <sys/wait.h> // For WEXITSTATUS
+#endif
+
+namespace {
+
+const NumberFormat FORMATS[] = {NumberFormat::Shortest, NumberFormat::Legacy};
+
+// Programs that need no input
+std::vector<std::string> programs() {
+    std::vector<std::string> sources = {
+        "PRINT 10 + 2 * 3;\nPRINT (10 + 2) * 3;\nPRINT 100 / 4 - 5;\nPRINT 7.5 * 2 + 1.0;\n",
+        // Evaluation order, reassignment, and values that print specially
+        "LET a = 0.1;\nLET b = a + 0.2;\nPRINT b;\nLET a = a * 3;\nPRINT a - b;\nPRINT 1 - a - b;\n",
+        // Literals have no exponent, so 1e308 is spelled out; the last value
+        // is subnormal
+        "LET big = 1" + std::string(308, '0') + ";\nPRINT big * 10;\nPRINT big * 10 - big * 10;\nPRINT 0 * 5;\n" +
+            "PRINT 1 / big / 100000000000000;\n",
+        "PRINT 123456789012345678901234567890;\nPRINT 0.000001;\nPRINT 1000000000000000000000;\nPRINT 2 / 3;\n",
+        // The division by zero stops the run after what was printed
+        "LET a = 3;\nPRINT a * 2;\nPRINT 1 / (a - 3);\nPRINT 5;\n",
+        "LET z = 0;\nPRINT 0 / z;\n",
+        // Folding must not change the value or the error
+        "LET x = 4;\nPRINT x * 1 + 0 - x * 0;\nPRINT (x + 2) * (x + 2) / (x - 4 + 1);\nPRINT 2 * 3 * x / (6 - 6);\n",
+        // Repeated subexpressions (CSE at -O2)
+        "LET p = 1.5;\nLET q = 2.5;\nPRINT (p * q + 1) * (p * q + 1) - (p * q + 1);\nLET p = q;\nPRINT p * q + 1;\n",
+        "// nothing but a comment\n",
+    };
+
+    // Deeper than the JIT's value stack, so it falls back to the interpreter
+    std::string deep = "PRINT ";
+    for (int i = 0; i < 20000; ++i) {
+        deep += "(1 + ";
+    }
+    deep += "1";
+    deep.append(20000, ')');
+    sources.push_back(deep + ";\n");
+
+    // Random programs with variables; a divisor can come out zero
+    for (uint32_t seed = 1; seed <= 8; ++seed) {
+        std::mt19937 rng(seed);
+        std::string source;
+        int defined = 0;
+        auto operand = [&]() {
+            if (defined > 0 && rng() % 2 == 0) {
+                return "v" + std::to_string(rng() % defined);
+            }
+            static const char* literals[] = {"0", "1", "2", "0.1", "3.75", "10000000000", "0.00001", "9999.99"};
+            return std::string(literals[rng() % 8]);
+        };
+        std::function<std::string(int)> expression = [&](int depth) {
+            std::string text = depth > 0 && rng() % 3 == 0 ? "(" + expression(depth - 1) + ")" : operand();
+            for (int terms = static_cast<int>(rng() % 4); terms > 0; --terms) {
+                text += std::string(" ") + "+-*/"[rng() % 4] + " ";
+                text += depth > 0 && rng() % 3 == 0 ? "(" + expression(depth - 1) + ")" : operand();
+            }
+            return text;
+        };
+        for (int i = 0; i < 300; ++i) {
+            if (rng() % 3 == 0 && defined < 6) {
+                source += "LET v" + std::to_string(defined) + " = " + expression(3) + ";\n";
+                defined++;
+            } else if (rng() % 4 == 0 && defined > 0) {
+                source += "LET v" + std::to_string(rng() % defined) + " = " + expression(3) + ";\n";
+            } else {
+                source += "PRINT " + expression(3) + ";\n";
+            }
+        }
+        sources.push_back(source);
+    }
+    return sources;
+}
+
+void checkInterpreters(const std::vector<std::string>& sources) {
+    for (size_t i = 0; i < sources.size(); ++i) {
+        for (NumberFormat format : FORMATS) {
+            simlan::CompileOptions options;
+            test::Outcome expected = test::compileAndRun(sources[i], options, format);
+            CHECK(expected.error.empty() || expected.error.find("Division by zero") != std::string::npos);
+
+            simlan::CompileContext context;
+            for (simlan::Engine engine : {simlan::Engine::Ast, simlan::Engine::Vm, simlan::Engine::Jit}) {
+                for (int level = 0; level <= 2; ++level) {
+                    options.engine = engine;
+                    options.optimizationLevel = level;
+                    std::string what = "program " + std::to_string(i) + ", engine " +
+                                       std::to_string(static_cast<int>(engine)) + ", -O" + std::to_string(level);
+                    CHECK_EQUAL(test::compileAndRun(sources[i], options, format), expected, what);
+
+                    // The same through a context that is reused
+                    simlan::Error error;
+                    const simlan::Program* program = context.compile(sources[i], options, error);
+                    CHECK(program != nullptr);
+                    if (program) {
+                        std::ostringstream text;
+                        {
+                            OutputSink out(text, format);
+                            error = context.run(*program, out);
+                        }
+                        test::Outcome outcome{text.str(), error ? error.message : std::string()};
+                        CHECK_EQUAL(outcome, expected, what + ", context");
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Batch rows against one run per row with the INPUTs turned into LETs
+void checkBatch() {
+    const std::string body =
+        "LET c = a / b;\nPRINT c;\nPRINT a - b * 0.5;\nLET a = a * a + c;\nPRINT a;\nPRINT (a + 1) / (b - 2);\n";
+    simlan::Error error;
+    std::shared_ptr<const simlan::Program> program =
+        simlan::Program::compile("INPUT a;\nINPUT b;\n" + body, simlan::CompileOptions(), error);
+    CHECK(program && program->hasInputs());
+    if (!program) {
+        return;
+    }
+
+    const char* values[] = {"0", "1", "2", "0.5", "3.25", "100000000000000000000", "0.0000000001", "7"};
+    std::vector<std::vector<double>> columns(2);
+    std::vector<std::string> expected;
+    for (const char* a : values) {
+        for (const char* b : values) {
+            columns[0].push_back(std::stod(a));
+            columns[1].push_back(std::stod(b));
+            test::Outcome row = test::compileAndRun("LET a = " + std::string(a) + ";\nLET b = " + b + ";\n" + body,
+                                                    simlan::CompileOptions());
+            // The values printed, empty fields for the PRINTs after an error,
+            // then the error column
+            std::string line;
+            size_t fields = 0;
+            for (char c : row.output) {
+                if (c == '\n') {
+                    line += ',';
+                    fields++;
+                } else {
+                    line += c;
+                }
+            }
+            for (; fields < 4; ++fields) {
+                line += ',';
+            }
+            line += row.error.empty() ? "" : "Division by zero";
+            expected.push_back(line);
+        }
+    }
+
+    BatchEvaluator evaluator(program->tree());
+    CHECK(evaluator.inputNames() == (std::vector<std::string>{"a", "b"}));
+    BatchEvaluator::Isa active = BatchEvaluator::activeIsa();
+    for (BatchEvaluator::Isa isa : {BatchEvaluator::Isa::Scalar, BatchEvaluator::Isa::AVX, BatchEvaluator::Isa::AVX512}) {
+        if (!BatchEvaluator::isSupported(isa)) {
+            continue;
+        }
+        BatchEvaluator::setIsa(isa);
+        std::ostringstream text;
+        {
+            OutputSink out(text);
+            evaluator.run(columns, expected.size(), out);
+        }
+        std::istringstream lines(text.str());
+        std::string line;
+        std::getline(lines, line);
+        CHECK_EQUAL(line, std::string("c,print2,a,print4,error"), BatchEvaluator::isaName(isa));
+        for (size_t row = 0; row < expected.size(); ++row) {
+            std::getline(lines, line);
+            CHECK_EQUAL(line, expected[row], std::string(BatchEvaluator::isaName(isa)) + ", row " + std::to_string(row));
+        }
+    }
+    BatchEvaluator::setIsa(active);
+}
+
+#ifdef SIMLAN_TEST_C_COMPILER
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+// Compiles the C translation of each program with the flags
+// simlan_add_executable() uses and runs it, in the directory engines_test
+void checkC(const std::vector<std::string>& sources) {
+    std::filesystem::path dir = std::filesystem::current_path() / "engines_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::string flags = "-std=c99 -ffp-contract=off";
+    if (std::string(SIMLAN_TEST_C_COMPILER_ID) == "GNU") {
+        flags += " -fsignaling-nans";
+    }
+    for (size_t i = 0; i < sources.size(); ++i) {
+        NumberFormat format = FORMATS[i % 2];
+        simlan::CompileOptions options;
+        options.optimizationLevel = static_cast<int>(i % 3);
+        simlan::Error error;
+        std::shared_ptr<const simlan::Program> program = simlan::Program::compile(sources[i], options, error);
+        CHECK(program != nullptr);
+        if (!program) {
+            continue;
+        }
+        test::Outcome expected = test::run(*program, format);
+
+        std::string name = (dir / ("program" + std::to_string(i))).string();
+        {
+            std::ofstream c(name + ".c");
+            CEmitter(format, name + ".simlan").emit(program->tree(), c);
+        }
+        std::string compile = std::string(SIMLAN_TEST_C_COMPILER) + " " + flags + " -o " + name + " " + name + ".c -lm";
+        int status = std::system(compile.c_str());
+        CHECK_EQUAL(status, 0, compile);
+        if (status != 0) {
+            continue;
+        }
+        status = std::system((name + " > " + name + ".out 2> " + name + ".err").c_str());
+        std::string errors = readFile(name + ".err");
+        if (!errors.empty() && errors.back() == '\n') {
+            errors.pop_back();
+        }
+        test::Outcome outcome{readFile(name + ".out"), errors};
+        CHECK_EQUAL(outcome, expected, "C translation of program " + std::to_string(i));
+        CHECK_EQUAL(WEXITSTATUS(status), expected.error.empty() ? 0 : 1, "exit status of program " + std::to_string(i));
+    }
+}
+#endif
+
+} // namespace
+
+int main() {
+    std::vector<std::string> sources = programs();
+    checkInterpreters(sources);
+    checkBatch();
+#ifdef SIMLAN_TEST_C_COMPILER
+    checkC(sources);
+#endif
+    return test::finish("engines_test");
+}
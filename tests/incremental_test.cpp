@@ -0,0 +1,127 @@
+// incremental_test - after any edit, IncrementalParser holds what a full
+// parse of the new text gives: the same statements and values, or the same
+// first error with the same line and column.
+
+#include "test_support.hpp"
+#include "incremental.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include <random>
+#include <string>
+
+namespace {
+
+// A full parse: the description of the program, or the error it throws
+std::string parseFully(const std::string& text) {
+    try {
+        Lexer lexer(text);
+        Parser parser(lexer);
+        return test::describe(*parser.parseProgram());
+    } catch (const LexError& e) {
+        return std::string("lexical ") + e.what();
+    } catch (const ParseError& e) {
+        return e.what();
+    }
+}
+
+std::string describe(const IncrementalParser& incremental) {
+    try {
+        incremental.throwError();
+    } catch (const LexError& e) {
+        return std::string("lexical ") + e.what();
+    } catch (const ParseError& e) {
+        return e.what();
+    }
+    return test::describe(incremental.program());
+}
+
+// Applies edit to text and incremental and compares with a full parse
+void edit(IncrementalParser& incremental, std::string& text, const TextEdit& edit, const std::string& what) {
+    text = text.substr(0, edit.offset) + std::string(edit.inserted) + text.substr(edit.offset + edit.removed);
+    incremental.applyEdit(edit, text);
+    std::string expected = parseFully(text);
+    CHECK_EQUAL(describe(incremental), expected, what);
+    if (!incremental.hasError()) {
+        CHECK_EQUAL(incremental.statementCount(), incremental.program().statements.size(), what);
+    }
+}
+
+// Random edits made of statement fragments, comments and stray characters
+void checkRandomEdits(uint32_t seed, size_t initial, size_t maxSize, int edits) {
+    static const char* fragments[] = {
+        "PRINT 1;", "LET a = 2;", "PRINT (2+3)*4;\n", "LET b = a*3;", "PRINT a+b;", "// c;o;m\n", "PRINT 1/0;",
+        "PRINT 1 +", ";", "/", "//", "\n", " ", "7", "PRINT", "(", ")", "*", "-", "+", "$", "PRINT 5 // x\n;",
+        "1.5e3", "  ;\n", "PRINT 2;PRINT 3;", "a", "b", "c", "LET", "=", "LET c = b / a;", "PRINT c;",
+        "LET a = a + 1;\n"};
+    const size_t count = sizeof fragments / sizeof *fragments;
+    std::mt19937 rng(seed);
+    std::string text;
+    for (size_t i = 0; i < initial; ++i) {
+        text += fragments[rng() % 5];
+    }
+    IncrementalParser incremental(text);
+    CHECK_EQUAL(describe(incremental), parseFully(text), "seed " + std::to_string(seed) + ", initial");
+    for (int i = 0; i < edits && test::failures() == 0; ++i) {
+        std::string what = "seed " + std::to_string(seed) + ", edit " + std::to_string(i);
+        if (text.size() > maxSize) {
+            edit(incremental, text, TextEdit{0, text.size(), ""}, what);
+            continue;
+        }
+        size_t offset = rng() % (text.size() + 1);
+        size_t removed = rng() % 4 == 0 ? 0 : rng() % std::min<size_t>(text.size() - offset + 1, 12);
+        if (rng() % 10 == 0) {
+            offset = text.size();
+            removed = 0;
+        }
+        std::string inserted;
+        for (int k = static_cast<int>(rng() % 3); k > 0; --k) {
+            inserted += fragments[rng() % count];
+        }
+        edit(incremental, text, TextEdit{offset, removed, inserted}, what);
+    }
+}
+
+// Many blocks of statements: adding and removing statements far from the
+// ends, errors whose column depends on a long line before them, and an
+// undefined variable that appears when its LET goes away
+void checkLargeSource() {
+    std::string text = "LET a = 1;\n";
+    for (int i = 0; i < 5000; ++i) {
+        text += "PRINT a + " + std::to_string(i) + ";" + (i % 7 == 0 ? "\n" : " ");
+    }
+    IncrementalParser incremental(text);
+    CHECK_EQUAL(describe(incremental), parseFully(text), "large, initial");
+
+    size_t middle = text.find("PRINT a + 2500;");
+    edit(incremental, text, TextEdit{middle, 0, "LET b = a * 2; PRINT b;"}, "statements added in the middle");
+    CHECK_EQUAL(incremental.lastParsedCount(), size_t(3), "statements parsed for an insertion");
+    edit(incremental, text, TextEdit{middle, 23, ""}, "statements removed in the middle");
+
+    size_t late = text.find("PRINT a + 4001;");
+    edit(incremental, text, TextEdit{late + 8, 0, "* $"}, "lexical error on a long line");
+    edit(incremental, text, TextEdit{late + 10, 1, ""}, "parse error on a long line");
+    edit(incremental, text, TextEdit{late + 8, 2, ""}, "error fixed");
+    edit(incremental, text, TextEdit{0, 0, "\n\n"}, "lines added before everything");
+    edit(incremental, text, TextEdit{6, 1, "c"}, "undefined variable");
+    edit(incremental, text, TextEdit{6, 1, "a"}, "defined again");
+
+    // Replacing everything a few times leaves most nodes dead, which
+    // compacts the arena
+    std::string original = text;
+    for (int i = 0; i < 6; ++i) {
+        edit(incremental, text, TextEdit{0, text.size(), original}, "replaced " + std::to_string(i));
+    }
+    edit(incremental, text, TextEdit{text.size(), 0, "PRINT a * 3;"}, "appended after compaction");
+}
+
+} // namespace
+
+int main() {
+    for (uint32_t seed = 1; seed <= 4; ++seed) {
+        checkRandomEdits(seed, 20, 4000, 2000);
+    }
+    // Sources of several blocks
+    checkRandomEdits(101, 3000, 80000, 200);
+    checkLargeSource();
+    return test::finish("incremental_test");
+}
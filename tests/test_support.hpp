@@ -0,0 +1,118 @@
+// test_support.hpp - checks shared by the tests. Each test is a plain
+// executable that CTest runs; it prints every failed check and exits with
+// status 1 if there was one.
+#pragma once
+
+#include "ast.hpp"
+#include "output.hpp"
+#include "simlan.hpp"
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace test {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline void fail(const char* file, int line, const std::string& what) {
+    std::cerr << file << ":" << line << ": " << what << "\n";
+    failures()++;
+}
+
+// Exit status for main()
+inline int finish(const char* name) {
+    if (failures() == 0) {
+        std::cout << name << ": ok\n";
+        return 0;
+    }
+    std::cerr << name << ": " << failures() << " failed\n";
+    return 1;
+}
+
+// What a run printed, and the error it ended with ("" if none), as simlanc
+// would show them
+struct Outcome {
+    std::string output;
+    std::string error;
+
+    bool operator==(const Outcome& other) const { return output == other.output && error == other.error; }
+    bool operator!=(const Outcome& other) const { return !(*this == other); }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const Outcome& outcome) {
+    return out << "output:\n" << outcome.output << "error: " << outcome.error;
+}
+
+inline Outcome run(const simlan::Program& program, NumberFormat format) {
+    std::ostringstream text;
+    simlan::Error error;
+    {
+        OutputSink out(text, format);
+        error = program.run(out);
+    }
+    return Outcome{text.str(), error ? error.message : std::string()};
+}
+
+// Compiles and runs source; a compile error is the outcome's error
+inline Outcome compileAndRun(std::string_view source, const simlan::CompileOptions& options,
+                             NumberFormat format = NumberFormat::Shortest) {
+    simlan::Error error;
+    std::shared_ptr<const simlan::Program> program = simlan::Program::compile(source, options, error);
+    if (!program) {
+        return Outcome{"", error.message};
+    }
+    return run(*program, format);
+}
+
+// One line per statement: its kind, the variable it assigns and the bits
+// of its value, evaluated in order as a run would (errors included), so two
+// trees that describe the same are the same program
+inline std::string describe(const ProgramNode& program) {
+    std::string text;
+    std::vector<double> variables(program.symbols.size() + 1, 0.0);
+    for (const StatementNode& stmt : program.statements) {
+        text += std::to_string(static_cast<int>(stmt.kind));
+        if (stmt.assigns()) {
+            text += " " + std::string(program.symbols.name(stmt.slot));
+        }
+        try {
+            double value = program.evaluate(stmt.expression, variables.data());
+            char bits[64];
+            std::snprintf(bits, sizeof bits, " %a", value);
+            text += bits;
+            if (stmt.assigns()) {
+                variables[stmt.slot] = value;
+            }
+        } catch (const std::exception& e) {
+            text += std::string(" error ") + e.what();
+        }
+        text += "\n";
+    }
+    return text;
+}
+
+} // namespace test
+
+#define CHECK(condition)                                            \
+    do {                                                            \
+        if (!(condition)) {                                         \
+            test::fail(__FILE__, __LINE__, "CHECK(" #condition ")"); \
+        }                                                           \
+    } while (false)
+
+// Shows both sides (and what) when they differ
+#define CHECK_EQUAL(actual, expected, what)                                                  \
+    do {                                                                                     \
+        if (!((actual) == (expected))) {                                                     \
+            std::ostringstream message_;                                                     \
+            message_ << #actual " != " #expected " (" << (what) << ")\n--- actual\n"         \
+                     << (actual) << "\n--- expected\n" << (expected);                        \
+            test::fail(__FILE__, __LINE__, message_.str());                                  \
+        }                                                                                    \
+    } while (false)